@@ -0,0 +1,27 @@
+#!/bin/bash
+# GC mark pause scaling from 1 to N marker threads.
+# Usage: benchmarks/gcMarkScaling.sh [maxThreads] [buildDir]
+# Without a build directory, builds into a temporary one that is removed on exit.
+set -e
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+MAX_THREADS="${1:-$(nproc)}"
+BUILD="$2"
+if [ -z "$BUILD" ]; then
+    BUILD="$(mktemp -d)"
+    trap 'rm -rf "$BUILD"' EXIT
+fi
+
+cmake -S "$ROOT" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DCMAKE_C_FLAGS="-DPRINT_GC_PAUSE" > /dev/null
+cmake --build "$BUILD" > /dev/null
+cc -shared -fPIC -O2 -I"$ROOT" -o "$BUILD/userFunctions.so" "$ROOT/userFunctions.c"
+# Run a copy, so bytecode cache files land in the build directory
+cp "$ROOT/benchmarks/gcMarkSource" "$BUILD/gcMarkSource"
+
+printf "%-8s %-8s %-16s %-16s\n" threads GCs "max mark (ms)" "total mark (ms)"
+threads=1
+while [ "$threads" -le "$MAX_THREADS" ]; do
+    CJ_GC_THREADS=$threads "$BUILD/CJ_2" "$BUILD/userFunctions.so" "$BUILD/gcMarkSource" \
+        | awk -v t="$threads" '/^GC pause/ { n++; m = $4; s += m; if (m > max) max = m }
+            END { printf "%-8d %-8d %-16.3f %-16.3f\n", t, n, max, s }'
+    threads=$((threads * 2))
+done
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Tokenizer throughput on a generated multi-MB source.
+# Usage: benchmarks/lexThroughput.sh [loopsPerFunction] [buildDir]
+# Without a build directory, builds into a temporary one that is removed on exit.
+set -e
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+LOOPS="${1:-80}"
+BUILD="$2"
+if [ -z "$BUILD" ]; then
+    BUILD="$(mktemp -d)"
+    trap 'rm -rf "$BUILD"' EXIT
+fi
+SOURCE="$BUILD/lexSource"
+
+cmake -S "$ROOT" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DCMAKE_C_FLAGS="-DPRINT_TOKENIZE_TIME" > /dev/null
+cmake --build "$BUILD" > /dev/null
+cc -shared -fPIC -O2 -I"$ROOT" -o "$BUILD/userFunctions.so" "$ROOT/userFunctions.c"
+
+# Each function mixes identifiers, keywords, numbers, strings and comments,
+# function count stays under the reference table limit and lines under 16 bits
+awk -v loops="$LOOPS" 'BEGIN {
+    for (i = 0; i < 200; i++) {
+        printf "# Generated function %d, comments are skipped by the lexer\n", i
+        printf "function generated_%d(alpha, beta) {\n", i
+        printf "    total = 0;\n"
+        for (j = 0; j < loops; j++) {
+            printf "    for (index_%d = 0; index_%d < %d; index_%d += 1) {\n", j % 16, j % 16, i + j, j % 16
+            printf "        total += alpha * %d.25 - beta / 3;\n", j
+            printf "        if (total >= 1000000 && alpha == beta) { label = \"iteration %d of %d\"; }\n", j, i
+            printf "    }\n"
+        }
+        printf "    return total;\n}\n\n"
+    }
+    printf "void function main() {\n    println(generated_0(1, 2));\n}\n"
+}' > "$SOURCE"
+# A cache hit would skip the tokenizer
+rm -f "${SOURCE}c" "${SOURCE}m"
+
+"$BUILD/CJ_2" "$BUILD/userFunctions.so" "$SOURCE" | grep "^Tokenized"
@@ -8,6 +8,8 @@
 #include "objectManager.h"
 #include "objClass.h"
 #include "object.h"
+#include "numKernels.h"
+#include "vm.h"
 
 #include <math.h>
 #include <string.h>
@@ -18,6 +20,7 @@
 #define DEF_BUILTIN_CFUNC_FUNCTION_VALUE(in, out, cFunc) OBJECT_VAL(createConstCallableObject(CREATE_CFUNC_FUNCTION(in, out, cFunc)), BUILTIN_CALLABLE)
 
 #define CHECK_NUM_TYPE(val) if (VALUE_TYPE(val) != VAL_NUMBER) runtimeError("Value is not of type num")
+#define CHECK_NUM_ARRAY_TYPE(val) if (VALUE_TYPE(val) != BUILTIN_NUM_ARRAY) runtimeError("Value is not of type numArray")
 
 // Builtin classes
 objClass* callableClass;
@@ -28,6 +31,7 @@ objClass* stringClass;
 objClass* listClass;
 objClass* dictClass;
 objClass* setClass;
+objClass* numArrayClass;
 
 void addGlobalReference(refTable* globalRefTable, runtimeList* globalRefList, Value val, char* name) {
     if (refTableContains(globalRefTable, name)) compilationError(0, 0, 0, "global reference already exists");
@@ -60,7 +64,7 @@ Value equalPrim(Value self, Value* args, int numArgs) {
             resultBool = VALUE_BOOL_VALUE(self) == VALUE_BOOL_VALUE(otherObj);
             break;
         case BUILTIN_STR:
-            resultBool = strcmp(VALUE_STR_VALUE(self), VALUE_STR_VALUE(otherObj)) == 0;
+            resultBool = VALUE_STR_VALUE(self) == VALUE_STR_VALUE(otherObj);
             break;
         default:
             runtimeError("Unsupported type for equalPrim");
@@ -112,6 +116,40 @@ Value listIndexOf(Value self, Value* args, int numArgs) {
     return resultObj;
 }
 
+Value listSort(Value self, Value* args, int numArgs) {
+    if (numArgs > 1) runtimeError("List sort takes an optional comparator");
+    listSortElements(VALUE_LIST_VALUE(self), numArgs == 1 ? args[0] : INTERNAL_NULL_VAL);
+}
+
+static inline uint32_t listRangeArg(Value val) {
+    CHECK_NUM_TYPE(val);
+    double index = VALUE_NUMBER_VALUE(val);
+    if (!(index >= 0 && index < UINT32_MAX) || index != (double) (uint32_t) index) listError("List range must be non-negative integers");
+    return (uint32_t) index;
+}
+
+Value listSlice(Value self, Value* args, int numArgs) {
+    uint32_t start = listRangeArg(args[0]);
+    uint32_t end = listRangeArg(args[1]);
+    Value result = OBJECT_VAL(createRuntimeListObject(), BUILTIN_LIST);
+    listAppendRange(VALUE_LIST_VALUE(result), VALUE_LIST_VALUE(self), start, end);
+    return result;
+}
+
+Value listExtend(Value self, Value* args, int numArgs) {
+    if (VALUE_TYPE(args[0]) != BUILTIN_LIST) runtimeError("Value is not of type list");
+    runtimeList* other = VALUE_LIST_VALUE(args[0]);
+    listAppendRange(VALUE_LIST_VALUE(self), other, 0, other->size);
+}
+
+Value listReverse(Value self, Value* args, int numArgs) {
+    listReverseElements(VALUE_LIST_VALUE(self));
+}
+
+Value listClear(Value self, Value* args, int numArgs) {
+    listClearElements(VALUE_LIST_VALUE(self));
+}
+
 // Dict
 Value initDict(Value self, Value* args, int numArgs) {
     if (numArgs % 2 != 0) runtimeError("Dict init must have even number of arguments");
@@ -155,6 +193,150 @@ Value setRemove(Value self, Value* args, int numArgs) {
     setRemoveElement(VALUE_SET_VALUE(self), args[0]);
 }
 
+typedef void (*setAlgebraFunc)(runtimeSet* result, runtimeSet* a, runtimeSet* b);
+
+static inline Value setAlgebra(Value self, Value other, setAlgebraFunc func) {
+    if (VALUE_TYPE(other) != BUILTIN_SET) runtimeError("Value is not of type set");
+    Value result = OBJECT_VAL(createRuntimeSetObject(), BUILTIN_SET);
+    // Key _eq methods may collect, keep the result on the stack meanwhile
+    *vm->stackTop++ = result;
+    func(VALUE_SET_VALUE(result), VALUE_SET_VALUE(self), VALUE_SET_VALUE(other));
+    vm->stackTop--;
+    return result;
+}
+
+Value setUnionMethod(Value self, Value* args, int numArgs) {
+    return setAlgebra(self, args[0], &setUnion);
+}
+
+Value setIntersectMethod(Value self, Value* args, int numArgs) {
+    return setAlgebra(self, args[0], &setIntersect);
+}
+
+Value setDifferenceMethod(Value self, Value* args, int numArgs) {
+    return setAlgebra(self, args[0], &setDifference);
+}
+
+Value setIsSubsetMethod(Value self, Value* args, int numArgs) {
+    if (VALUE_TYPE(args[0]) != BUILTIN_SET) runtimeError("Value is not of type set");
+    return setIsSubset(VALUE_SET_VALUE(self), VALUE_SET_VALUE(args[0])) ? BOOL_VAL(true) : BOOL_VAL(false);
+}
+
+Value setFromList(Value self, Value* args, int numArgs) {
+    if (VALUE_TYPE(args[0]) != BUILTIN_LIST) runtimeError("Value is not of type list");
+    setAddList(VALUE_SET_VALUE(self), VALUE_LIST_VALUE(args[0]));
+}
+
+// Num array
+
+static inline uint32_t numArrayIndexArg(Value val) {
+    CHECK_NUM_TYPE(val);
+    double index = VALUE_NUMBER_VALUE(val);
+    if (!(index >= 0 && index < UINT32_MAX) || index != (double) (uint32_t) index) numArrayError("numArray index must be a non-negative integer");
+    return (uint32_t) index;
+}
+
+static inline runtimeNumArray* sameSizeNumArrayArg(Value self, Value val) {
+    CHECK_NUM_ARRAY_TYPE(val);
+    runtimeNumArray* other = VALUE_NUM_ARRAY_VALUE(val);
+    if (other->size != VALUE_NUM_ARRAY_VALUE(self)->size) numArrayError("numArray size mismatch");
+    return other;
+}
+
+Value initNumArray(Value self, Value* args, int numArgs) {
+    if (numArgs > 2) runtimeError("numArray init takes a size and an optional fill value");
+    uint32_t size = numArgs > 0 ? numArrayIndexArg(args[0]) : 0;
+    VALUE_NUM_ARRAY_VALUE(self) = createRuntimeNumArray(size);
+    if (numArgs == 2) {
+        CHECK_NUM_TYPE(args[1]);
+        activeNumKernels.fill(VALUE_NUM_ARRAY_VALUE(self)->data, VALUE_NUMBER_VALUE(args[1]), size);
+    }
+}
+
+Value numArrayAdd(Value self, Value* args, int numArgs) {
+    CHECK_NUM_TYPE(args[0]);
+    numArrayAddElement(VALUE_NUM_ARRAY_VALUE(self), VALUE_NUMBER_VALUE(args[0]));
+}
+
+Value numArraySet(Value self, Value* args, int numArgs) {
+    CHECK_NUM_TYPE(args[1]);
+    numArraySetElement(VALUE_NUM_ARRAY_VALUE(self), numArrayIndexArg(args[0]), VALUE_NUMBER_VALUE(args[1]));
+}
+
+Value numArrayGet(Value self, Value* args, int numArgs) {
+    return NUMBER_VAL(numArrayGetElement(VALUE_NUM_ARRAY_VALUE(self), numArrayIndexArg(args[0])));
+}
+
+Value numArraySize(Value self, Value* args, int numArgs) {
+    return NUMBER_VAL(VALUE_NUM_ARRAY_VALUE(self)->size);
+}
+
+Value numArrayFill(Value self, Value* args, int numArgs) {
+    CHECK_NUM_TYPE(args[0]);
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    activeNumKernels.fill(array->data, VALUE_NUMBER_VALUE(args[0]), array->size);
+}
+
+Value numArraySum(Value self, Value* args, int numArgs) {
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    return NUMBER_VAL(activeNumKernels.sum(array->data, array->size));
+}
+
+Value numArrayMin(Value self, Value* args, int numArgs) {
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    if (array->size == 0) numArrayError("min of empty numArray");
+    return NUMBER_VAL(activeNumKernels.min(array->data, array->size));
+}
+
+Value numArrayMax(Value self, Value* args, int numArgs) {
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    if (array->size == 0) numArrayError("max of empty numArray");
+    return NUMBER_VAL(activeNumKernels.max(array->data, array->size));
+}
+
+Value numArrayDot(Value self, Value* args, int numArgs) {
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    runtimeNumArray* other = sameSizeNumArrayArg(self, args[0]);
+    return NUMBER_VAL(activeNumKernels.dot(array->data, other->data, array->size));
+}
+
+// self += scale * other
+Value numArrayAddScaled(Value self, Value* args, int numArgs) {
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    runtimeNumArray* other = sameSizeNumArrayArg(self, args[0]);
+    CHECK_NUM_TYPE(args[1]);
+    activeNumKernels.addScaled(array->data, other->data, VALUE_NUMBER_VALUE(args[1]), array->size);
+}
+
+// Elementwise operators take a numArray of the same size or a num, and return a new numArray
+static inline Value numArrayOperation(Value self, Value other, numKernelOp op) {
+    runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(self);
+    Value result = OBJECT_VAL(createRuntimeNumArrayObject(array->size), BUILTIN_NUM_ARRAY);
+    runtimeNumArray* resultArray = VALUE_NUM_ARRAY_VALUE(result);
+    if (VALUE_TYPE(other) == VAL_NUMBER) {
+        activeNumKernels.scalarOp(resultArray->data, array->data, VALUE_NUMBER_VALUE(other), array->size, op);
+    } else {
+        activeNumKernels.arrayOp(resultArray->data, array->data, sameSizeNumArrayArg(self, other)->data, array->size, op);
+    }
+    return result;
+}
+
+Value numArrayOpAdd(Value self, Value* args, int numArgs) {
+    return numArrayOperation(self, args[0], NUM_KERNEL_ADD);
+}
+
+Value numArrayOpSub(Value self, Value* args, int numArgs) {
+    return numArrayOperation(self, args[0], NUM_KERNEL_SUB);
+}
+
+Value numArrayOpMul(Value self, Value* args, int numArgs) {
+    return numArrayOperation(self, args[0], NUM_KERNEL_MUL);
+}
+
+Value numArrayOpDiv(Value self, Value* args, int numArgs) {
+    return numArrayOperation(self, args[0], NUM_KERNEL_DIV);
+}
+
 Value print(Value self, Value* args, int numArgs) {
     for (uint32_t i=0; i<numArgs; i++) DSPrintValue(args[i]);
 }
@@ -233,6 +415,11 @@ void constructBuiltinClasses(refTable* globalRefTable, runtimeList* globalRefLis
     CLASS_ADD_ATTR(listClass, "get", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &listGet));
     CLASS_ADD_ATTR(listClass, "contains", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &listContains));
     CLASS_ADD_ATTR(listClass, "index", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &listIndexOf));
+    CLASS_ADD_ATTR(listClass, "sort", DEF_BUILTIN_CFUNC_METHOD_VALUE(-1, 0, &listSort));
+    CLASS_ADD_ATTR(listClass, "slice", DEF_BUILTIN_CFUNC_METHOD_VALUE(2, 1, &listSlice));
+    CLASS_ADD_ATTR(listClass, "extend", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 0, &listExtend));
+    CLASS_ADD_ATTR(listClass, "reverse", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 0, &listReverse));
+    CLASS_ADD_ATTR(listClass, "clear", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 0, &listClear));
 
     // Dict class
     dictClass = DEF_BUILTIN_CFUNC_INIT_CLASS("dict", getRefIndex(globalClassTable, "dict"), -1, 0, &initDict);
@@ -248,6 +435,30 @@ void constructBuiltinClasses(refTable* globalRefTable, runtimeList* globalRefLis
     CLASS_ADD_ATTR(setClass, "add", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 0, &setInsert));
     CLASS_ADD_ATTR(setClass, "contains", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &setContains));
     CLASS_ADD_ATTR(setClass, "remove", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 0, &setRemove));
+    CLASS_ADD_ATTR(setClass, "union", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &setUnionMethod));
+    CLASS_ADD_ATTR(setClass, "intersect", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &setIntersectMethod));
+    CLASS_ADD_ATTR(setClass, "difference", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &setDifferenceMethod));
+    CLASS_ADD_ATTR(setClass, "isSubset", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &setIsSubsetMethod));
+    CLASS_ADD_ATTR(setClass, "fromList", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 0, &setFromList));
+
+    // Num array class
+    initNumKernels();
+    numArrayClass = DEF_BUILTIN_CFUNC_INIT_CLASS("numArray", getRefIndex(globalClassTable, "numArray"), -1, 0, &initNumArray);
+    CLASS_ADD_ATTR(numArrayClass, "print", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 0, &printPrim));
+    CLASS_ADD_ATTR(numArrayClass, "add", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 0, &numArrayAdd));
+    CLASS_ADD_ATTR(numArrayClass, "set", DEF_BUILTIN_CFUNC_METHOD_VALUE(2, 0, &numArraySet));
+    CLASS_ADD_ATTR(numArrayClass, "get", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &numArrayGet));
+    CLASS_ADD_ATTR(numArrayClass, "size", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 1, &numArraySize));
+    CLASS_ADD_ATTR(numArrayClass, "fill", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 0, &numArrayFill));
+    CLASS_ADD_ATTR(numArrayClass, "sum", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 1, &numArraySum));
+    CLASS_ADD_ATTR(numArrayClass, "min", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 1, &numArrayMin));
+    CLASS_ADD_ATTR(numArrayClass, "max", DEF_BUILTIN_CFUNC_METHOD_VALUE(0, 1, &numArrayMax));
+    CLASS_ADD_ATTR(numArrayClass, "dot", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &numArrayDot));
+    CLASS_ADD_ATTR(numArrayClass, "addScaled", DEF_BUILTIN_CFUNC_METHOD_VALUE(2, 0, &numArrayAddScaled));
+    CLASS_ADD_ATTR(numArrayClass, "_add", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &numArrayOpAdd));
+    CLASS_ADD_ATTR(numArrayClass, "_sub", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &numArrayOpSub));
+    CLASS_ADD_ATTR(numArrayClass, "_mul", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &numArrayOpMul));
+    CLASS_ADD_ATTR(numArrayClass, "_div", DEF_BUILTIN_CFUNC_METHOD_VALUE(1, 1, &numArrayOpDiv));
 
     // Builtin functions
     Value printFunc = DEF_BUILTIN_CFUNC_FUNCTION_VALUE(-1, 0, &print);
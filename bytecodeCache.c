@@ -0,0 +1,909 @@
+#include "bytecodeCache.h"
+#include "objectManager.h"
+#include "objClass.h"
+#include "errors.h"
+#include "tokenizer.h"
+#include "builtinClasses.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "CJC"
+#define MODULE_CACHE_MAGIC "CJM"
+#define CACHE_VERSION 4
+#define CACHE_ALIGN 8
+#define CACHE_NO_CLASS UINT32_MAX
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+#define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
+#define SET_WORD(data, shift, word) (((data) & ~(0xFFFFULL << ((shift) * 8))) | ((uint64_t)(word) << ((shift) * 8)))
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
+// Attribute ops hold a program symbol, module images store it by name
+#define HAS_SYMBOL(op) ((op) == OP_GET_ATTR || (op) == OP_GET_ATTR_CALL || (op) == OP_SET_ATTR || (op) == OP_GET_CLASS_ATTR_CALL)
+
+typedef enum cacheValueTag {
+    CACHE_INTERNAL_NULL,
+    CACHE_NONE,
+    CACHE_BOOL,
+    CACHE_NUMBER,
+    CACHE_STR,
+    CACHE_FUNCTION, // Chunk function by index in the file
+    CACHE_GLOBAL, // Builtin or user function by its global ref index
+    CACHE_CLASS_ATTR, // Method of a builtin class
+} cacheValueTag;
+
+typedef struct cacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t runtimeHash;
+    uint64_t payloadHash; // Everything after the header
+    uint32_t startupSymbols;
+    uint32_t startupGlobals;
+    uint32_t symbolCount;
+    uint32_t functionCount;
+    uint32_t classCount;
+    uint32_t functionArraySize;
+    uint32_t globalArraySize;
+    uint32_t moduleCount; // Included sources, the main source excluded
+} cacheHeader;
+
+typedef struct moduleCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t runtimeHash;
+    uint64_t payloadHash; // Everything after the header
+} moduleCacheHeader;
+
+typedef struct cacheBuffer {
+    uint8_t* data;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} cacheBuffer;
+
+typedef struct cacheReader {
+    uint8_t* data;
+    size_t pos;
+    size_t size;
+} cacheReader;
+
+// Distinct chunk functions in the order they are written
+typedef struct functionSet {
+    callable** list;
+    uint32_t count;
+    uint32_t capacity;
+} functionSet;
+
+static uint32_t startupSymbols = 0;
+static uint32_t startupGlobals = 0;
+static uint64_t runtimeHash = 0;
+static runtimeList* startupRefList = NULL;
+static void* mappedFile = NULL;
+static size_t mappedSize = 0;
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hashSource(char* source) {
+    return hashBytes(FNV_OFFSET, source, strlen(source));
+}
+
+static char* suffixPath(char* sourcePath, char suffix) {
+    size_t length = strlen(sourcePath);
+    char* path = malloc(length + 2);
+    if (path == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    memcpy(path, sourcePath, length);
+    path[length] = suffix;
+    path[length + 1] = '\0';
+    return path;
+}
+
+char* bytecodeCachePath(char* sourcePath) {
+    return suffixPath(sourcePath, 'c');
+}
+
+void beginBytecodeCache(refTable* globalRefTable, runtimeList* globalRefList) {
+    startupSymbols = symbolTotal();
+    startupGlobals = globalRefList->size;
+    startupRefList = globalRefList;
+    uint64_t hash = FNV_OFFSET;
+    // Optimizer passes change the code of the same source
+    uint32_t flags = 0;
+#ifdef OPTIMIZE_CONST_PAYLOAD
+    flags |= 1 << 0;
+#endif
+#ifdef OPTIMIZE_CHUNK
+    flags |= 1 << 1;
+#endif
+#ifdef SPECIALIZE_TYPES
+    flags |= 1 << 2;
+#endif
+#ifdef INLINE_FUNCTIONS
+    flags |= 1 << 3;
+#endif
+#ifdef RESOLVE_SCOPES
+    flags |= 1 << 4;
+#endif
+#ifdef ELIMINATE_REDUNDANCY
+    flags |= 1 << 5;
+#endif
+#ifdef FUSE_BINARY_OPERANDS
+    flags |= 1 << 6;
+#endif
+    hash = hashBytes(hash, &flags, sizeof(flags));
+    hash = hashBytes(hash, &startupSymbols, sizeof(startupSymbols));
+    hash = hashBytes(hash, &startupGlobals, sizeof(startupGlobals));
+    // Global names with their arity, table order is fixed for the same loading order
+    for (uint32_t i = 0; i < globalRefTable->tableSize; i++) {
+        for (refTableEntry* entry = globalRefTable->entries[i]; entry != NULL; entry = entry->next) {
+            hash = hashBytes(hash, entry->key, strlen(entry->key) + 1);
+            hash = hashBytes(hash, &entry->value, sizeof(entry->value));
+            Value value = globalRefList->list[entry->value];
+            if (VALUE_TYPE(value) != BUILTIN_CALLABLE) continue;
+            hash = hashBytes(hash, &VALUE_CALLABLE_VALUE(value)->in, sizeof(int32_t));
+            hash = hashBytes(hash, &VALUE_CALLABLE_VALUE(value)->out, sizeof(int32_t));
+        }
+    }
+    runtimeHash = hash;
+}
+
+// Writing
+
+static void putBytes(cacheBuffer* b, const void* data, size_t size) {
+    if (b->failed) return;
+    if (b->count + size > b->capacity) {
+        size_t capacity = b->capacity == 0 ? 4096 : b->capacity;
+        while (b->count + size > capacity) capacity *= 2;
+        uint8_t* newData = realloc(b->data, capacity);
+        if (newData == NULL) {
+            b->failed = true;
+            return;
+        }
+        b->data = newData;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->count, data, size);
+    b->count += size;
+}
+
+static void putU8(cacheBuffer* b, uint8_t value) { putBytes(b, &value, sizeof(value)); }
+static void putU16(cacheBuffer* b, uint16_t value) { putBytes(b, &value, sizeof(value)); }
+static void putU32(cacheBuffer* b, uint32_t value) { putBytes(b, &value, sizeof(value)); }
+static void putU64(cacheBuffer* b, uint64_t value) { putBytes(b, &value, sizeof(value)); }
+
+static void putString(cacheBuffer* b, char* str) {
+    uint32_t length = (uint32_t) strlen(str);
+    putU32(b, length);
+    putBytes(b, str, length + 1);
+}
+
+static void putAlign(cacheBuffer* b) {
+    static const uint8_t zeros[CACHE_ALIGN] = {0};
+    if (b->count % CACHE_ALIGN != 0) putBytes(b, zeros, CACHE_ALIGN - b->count % CACHE_ALIGN);
+}
+
+static uint32_t functionIndex(functionSet* set, callable* call) {
+    for (uint32_t i = 0; i < set->count; i++) if (set->list[i] == call) return i;
+    return UINT32_MAX;
+}
+
+static void collectCallable(functionSet* set, callable* call) {
+    if (call == NULL || call->func == NULL || functionIndex(set, call) != UINT32_MAX) return;
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity == 0 ? 16 : set->capacity * 2;
+        callable** newList = realloc(set->list, sizeof(callable*) * set->capacity);
+        if (newList == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+        set->list = newList;
+    }
+    set->list[set->count++] = call;
+}
+
+static void collectValue(functionSet* set, Value value) {
+    if (VALUE_TYPE(value) == BUILTIN_CALLABLE) collectCallable(set, VALUE_CALLABLE_VALUE(value));
+}
+
+static void putCallable(cacheBuffer* b, functionSet* set, runtimeList* globalRefList, callable* call) {
+    if (call->func != NULL) {
+        putU8(b, CACHE_FUNCTION);
+        putU32(b, functionIndex(set, call));
+        return;
+    }
+    // C functions are found again through the runtime that loads the file
+    for (uint32_t i = 0; i < startupGlobals; i++) {
+        Value global = globalRefList->list[i];
+        if (VALUE_TYPE(global) != BUILTIN_CALLABLE || VALUE_CALLABLE_VALUE(global) != call) continue;
+        putU8(b, CACHE_GLOBAL);
+        putU32(b, i);
+        return;
+    }
+    for (uint32_t i = 0; IS_SYSTEM_DEFINED_TYPE(i); i++) {
+        attrTable* table = classArray[i]->predefinedAttrs;
+        for (uint32_t j = 0; j < table->table_size; j++) {
+            attrEntry* entry = &table->entries[j];
+            if (!ATTR_ENTRY_USED(entry) || VALUE_TYPE(entry->value) != BUILTIN_CALLABLE) continue;
+            if (VALUE_CALLABLE_VALUE(entry->value) != call) continue;
+            putU8(b, CACHE_CLASS_ATTR);
+            putU32(b, i);
+            putU16(b, entry->symbol);
+            return;
+        }
+    }
+    b->failed = true;
+}
+
+static void putValue(cacheBuffer* b, functionSet* set, runtimeList* globalRefList, Value value) {
+    switch (VALUE_TYPE(value)) {
+        case VAL_INTERNAL_NULL:
+            putU8(b, CACHE_INTERNAL_NULL);
+            break;
+        case VAL_NONE:
+            putU8(b, CACHE_NONE);
+            break;
+        case VAL_BOOL:
+            putU8(b, CACHE_BOOL);
+            putU8(b, VALUE_BOOL_VALUE(value));
+            break;
+        case VAL_NUMBER:
+            putU8(b, CACHE_NUMBER);
+            putBytes(b, &VALUE_NUMBER_VALUE(value), sizeof(double));
+            break;
+        case BUILTIN_STR:
+            putU8(b, CACHE_STR);
+            putString(b, VALUE_STR_VALUE(value));
+            break;
+        case BUILTIN_CALLABLE:
+            putCallable(b, set, globalRefList, VALUE_CALLABLE_VALUE(value));
+            break;
+        default:
+            // Compiled programs hold no other constants
+            b->failed = true;
+    }
+}
+
+static void putChunkCode(cacheBuffer* b, callable* call) {
+    Chunk* c = call->func;
+    putU32(b, (uint32_t) call->in);
+    putU32(b, (uint32_t) call->out);
+    putU32(b, call->type);
+    putU32(b, c->count);
+    putU32(b, c->localRefArraySize);
+    putU32(b, c->inlineSiteCount);
+    // Code arrays are mapped in place, so each starts aligned
+    putAlign(b);
+    putBytes(b, c->code, sizeof(uint64_t) * c->count);
+    putBytes(b, c->lines, sizeof(uint16_t) * c->count);
+    putAlign(b);
+    putBytes(b, c->indices, sizeof(uint8_t) * c->count);
+    putAlign(b);
+    putBytes(b, c->sourceIndices, sizeof(uint8_t) * c->count);
+    putAlign(b);
+    // Site indices only exist once a call was inlined, which always adds a site
+    if (c->inlineSiteCount == 0) return;
+    putBytes(b, c->siteIndices, sizeof(uint16_t) * c->count);
+    putAlign(b);
+    putBytes(b, c->inlineSites, sizeof(inlineSite) * c->inlineSiteCount);
+    putAlign(b);
+}
+
+static bool writeFile(char* cachePath, void* header, size_t headerSize, cacheBuffer* b) {
+    // Written aside and renamed, so a reader never maps a partial file
+    size_t length = strlen(cachePath);
+    char* tempPath = malloc(length + 5);
+    if (tempPath == NULL) return false;
+    memcpy(tempPath, cachePath, length);
+    memcpy(tempPath + length, ".tmp", 5);
+    FILE* file = fopen(tempPath, "wb");
+    bool written = file != NULL;
+    if (written) {
+        written = fwrite(header, headerSize, 1, file) == 1 && fwrite(b->data, 1, b->count, file) == b->count;
+        written = fclose(file) == 0 && written;
+    }
+    if (written) written = rename(tempPath, cachePath) == 0;
+    if (!written) remove(tempPath);
+    free(tempPath);
+    return written;
+}
+
+void writeBytecodeCache(char* cachePath, char* source, runtimeList* globalRefList, Value mainFunc, callable** functionArray, uint32_t functionArraySize, Value* globalArray, uint32_t globalArraySize) {
+    // Every chunk function reachable from the program, functions never referenced are dropped
+    functionSet set = {NULL, 0, 0};
+    collectValue(&set, mainFunc);
+    for (uint32_t i = 0; i < functionArraySize; i++) collectCallable(&set, functionArray[i]);
+    for (uint32_t i = 0; i < globalArraySize; i++) collectValue(&set, globalArray[i]);
+    for (uint32_t i = 0; i < classCount; i++) {
+        if (IS_SYSTEM_DEFINED_TYPE(i)) continue;
+        collectValue(&set, classArray[i]->initFunc);
+        attrTable* table = classArray[i]->predefinedAttrs;
+        for (uint32_t j = 0; j < table->table_size; j++) {
+            if (ATTR_ENTRY_USED(&table->entries[j])) collectValue(&set, table->entries[j].value);
+        }
+    }
+    for (uint32_t i = 0; i < set.count; i++) {
+        valueArray* constants = set.list[i]->func->constants;
+        for (int j = 0; j < constants->count; j++) collectValue(&set, constants->data[j]);
+    }
+
+    cacheBuffer b = {NULL, 0, 0, false};
+    // Included modules in the order they were attached, so chunk source indices stay valid
+    for (uint32_t i = 1; i < sourceCount; i++) {
+        putString(&b, fileNameArray[i]);
+        putU64(&b, hashSource(sourceArray[i]));
+    }
+    // Symbols interned by the compiler, in order
+    for (uint32_t i = startupSymbols; i < symbolTotal(); i++) putString(&b, symbolName((uint16_t) i));
+    putAlign(&b);
+    for (uint32_t i = 0; i < set.count; i++) putChunkCode(&b, set.list[i]);
+    for (uint32_t i = 0; i < set.count; i++) {
+        valueArray* constants = set.list[i]->func->constants;
+        putU32(&b, constants->count);
+        for (int j = 0; j < constants->count; j++) putValue(&b, &set, globalRefList, constants->data[j]);
+    }
+    // Class tables are already flattened
+    for (uint32_t i = 0; i < classCount; i++) {
+        if (IS_SYSTEM_DEFINED_TYPE(i)) continue;
+        objClass* c = classArray[i];
+        putString(&b, c->className);
+        putU32(&b, c->parentClass == NULL ? CACHE_NO_CLASS : c->parentClass->classID);
+        putU32(&b, c->initType);
+        putValue(&b, &set, globalRefList, c->initFunc);
+        putU32(&b, c->predefinedAttrs->num_entries);
+        for (uint32_t j = 0; j < c->predefinedAttrs->table_size; j++) {
+            attrEntry* entry = &c->predefinedAttrs->entries[j];
+            if (!ATTR_ENTRY_USED(entry)) continue;
+            putU16(&b, entry->symbol);
+            putValue(&b, &set, globalRefList, entry->value);
+        }
+    }
+    for (uint32_t i = 0; i < functionArraySize; i++) {
+        if (functionArray[i] == NULL) putU8(&b, CACHE_INTERNAL_NULL);
+        else putCallable(&b, &set, globalRefList, functionArray[i]);
+    }
+    for (uint32_t i = 0; i < globalArraySize; i++) putValue(&b, &set, globalRefList, globalArray[i]);
+    putValue(&b, &set, globalRefList, mainFunc);
+
+    if (!b.failed) {
+        cacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.sourceHash = hashSource(source);
+        header.runtimeHash = runtimeHash;
+        header.payloadHash = hashBytes(FNV_OFFSET, b.data, b.count);
+        header.startupSymbols = startupSymbols;
+        header.startupGlobals = startupGlobals;
+        header.symbolCount = symbolTotal() - startupSymbols;
+        header.functionCount = set.count;
+        header.classCount = classCount;
+        header.functionArraySize = functionArraySize;
+        header.globalArraySize = globalArraySize;
+        header.moduleCount = sourceCount - 1;
+        // A cache that cannot be written only costs the next startup
+        writeFile(cachePath, &header, sizeof(header), &b);
+    }
+    free(b.data);
+    free(set.list);
+}
+
+// Loading
+
+static void* getBytes(cacheReader* r, size_t size) {
+    if (r->pos + size > r->size) compilationError(0, 0, 0, "Truncated bytecode cache");
+    void* data = r->data + r->pos;
+    r->pos += size;
+    return data;
+}
+
+static uint8_t getU8(cacheReader* r) { return *(uint8_t*) getBytes(r, sizeof(uint8_t)); }
+
+static uint16_t getU16(cacheReader* r) {
+    uint16_t value;
+    memcpy(&value, getBytes(r, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static uint32_t getU32(cacheReader* r) {
+    uint32_t value;
+    memcpy(&value, getBytes(r, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static uint64_t getU64(cacheReader* r) {
+    uint64_t value;
+    memcpy(&value, getBytes(r, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static char* getString(cacheReader* r) {
+    uint32_t length = getU32(r);
+    return getBytes(r, length + 1);
+}
+
+static void getAlign(cacheReader* r) {
+    if (r->pos % CACHE_ALIGN != 0) getBytes(r, CACHE_ALIGN - r->pos % CACHE_ALIGN);
+}
+
+static Value getValue(cacheReader* r, Object** functions, uint32_t functionCount, runtimeList* globalRefList) {
+    switch (getU8(r)) {
+        case CACHE_INTERNAL_NULL:
+            return INTERNAL_NULL_VAL;
+        case CACHE_NONE:
+            return NONE_VAL;
+        case CACHE_BOOL:
+            return BOOL_VAL(getU8(r));
+        case CACHE_NUMBER: {
+            double num;
+            memcpy(&num, getBytes(r, sizeof(num)), sizeof(num));
+            return NUMBER_VAL(num);
+        }
+        case CACHE_STR:
+            return OBJECT_VAL(createConstStringObject(getString(r)), BUILTIN_STR);
+        case CACHE_FUNCTION: {
+            uint32_t index = getU32(r);
+            if (index >= functionCount) break;
+            return OBJECT_VAL(functions[index], BUILTIN_CALLABLE);
+        }
+        case CACHE_GLOBAL: {
+            uint32_t index = getU32(r);
+            if (index >= startupGlobals) break;
+            return globalRefList->list[index];
+        }
+        case CACHE_CLASS_ATTR: {
+            uint32_t classID = getU32(r);
+            uint16_t symbol = getU16(r);
+            if (!IS_SYSTEM_DEFINED_TYPE(classID)) break;
+            Value method = CLASS_FIND_ATTR(classArray[classID], symbol);
+            if (IS_INTERNAL_NULL(method)) break;
+            return method;
+        }
+        default:
+            break;
+    }
+    compilationError(0, 0, 0, "Corrupt bytecode cache");
+    return INTERNAL_NULL_VAL;
+}
+
+static Object* getChunkFunction(cacheReader* r) {
+    int32_t in = (int32_t) getU32(r);
+    int32_t out = (int32_t) getU32(r);
+    callableType type = getU32(r);
+    uint32_t count = getU32(r);
+    uint16_t localRefArraySize = getU32(r);
+    uint16_t inlineSiteCount = getU32(r);
+    Chunk* c = malloc(sizeof(Chunk));
+    if (c == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    c->count = count;
+    c->capacity = count;
+    c->currIndexAtLine = 0;
+    c->localRefArraySize = localRefArraySize;
+    c->mapped = true;
+    getAlign(r);
+    c->code = getBytes(r, sizeof(uint64_t) * count);
+    c->lines = getBytes(r, sizeof(uint16_t) * count);
+    getAlign(r);
+    c->indices = getBytes(r, sizeof(uint8_t) * count);
+    getAlign(r);
+    c->sourceIndices = getBytes(r, sizeof(uint8_t) * count);
+    getAlign(r);
+    c->siteIndices = NULL;
+    c->inlineSites = NULL;
+    c->inlineSiteCount = inlineSiteCount;
+    if (inlineSiteCount > 0) {
+        c->siteIndices = getBytes(r, sizeof(uint16_t) * count);
+        getAlign(r);
+        c->inlineSites = getBytes(r, sizeof(inlineSite) * inlineSiteCount);
+        getAlign(r);
+    }
+    c->constants = NULL;
+    return createConstCallableObject(createCallable(in, out, NULL, c, type));
+}
+
+// Loads every included module, all of which must still hash the same
+static bool loadModules(cacheReader* r, uint32_t moduleCount) {
+    char** sources = malloc(sizeof(char*) * (moduleCount + 1));
+    char** names = malloc(sizeof(char*) * (moduleCount + 1));
+    if (sources == NULL || names == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    uint32_t loaded = 0;
+    bool valid = true;
+    while (valid && loaded < moduleCount) {
+        names[loaded] = getString(r);
+        uint64_t hash = getU64(r);
+        sources[loaded] = access(names[loaded], R_OK) == 0 ? loadFile(names[loaded]) : NULL;
+        if (sources[loaded] == NULL) break;
+        valid = hashSource(sources[loaded++]) == hash;
+    }
+    valid = valid && loaded == moduleCount;
+    // Attached only once all match, the error tracer cannot drop a source
+    for (uint32_t i = 0; i < loaded; i++) {
+        if (valid) attachSource(sources[i], names[i]);
+        else free(sources[i]);
+    }
+    free(sources);
+    free(names);
+    return valid;
+}
+
+static bool validHeader(cacheHeader* header, char* source, size_t size) {
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return false;
+    if (header->version != CACHE_VERSION || header->runtimeHash != runtimeHash) return false;
+    if (header->startupSymbols != startupSymbols || header->startupGlobals != startupGlobals) return false;
+    // Nothing may have been interned or attached since the runtime was recorded
+    if (symbolTotal() != startupSymbols || sourceCount != 1) return false;
+    if (header->sourceHash != hashSource(source)) return false;
+    return header->payloadHash == hashBytes(FNV_OFFSET, (uint8_t*) header + sizeof(cacheHeader), size - sizeof(cacheHeader));
+}
+
+Value loadBytecodeCache(char* cachePath, char* source, runtimeList* globalRefList, callable*** functionArray, Value** globalArray, uint32_t* globalArraySize) {
+    int fd = open(cachePath, O_RDONLY);
+    if (fd < 0) return INTERNAL_NULL_VAL;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(cacheHeader)) {
+        close(fd);
+        return INTERNAL_NULL_VAL;
+    }
+    size_t size = (size_t) fileStat.st_size;
+    // Code is never written after compile, so the pages stay shared with the page cache
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return INTERNAL_NULL_VAL;
+    cacheHeader* header = data;
+    cacheReader r = {data, sizeof(cacheHeader), size};
+    if (!validHeader(header, source, size) || !loadModules(&r, header->moduleCount)) {
+        munmap(data, size);
+        return INTERNAL_NULL_VAL;
+    }
+    mappedFile = data;
+    mappedSize = size;
+
+    for (uint32_t i = 0; i < header->symbolCount; i++) {
+        if (internSymbol(getString(&r)) != startupSymbols + i) compilationError(0, 0, 0, "Corrupt bytecode cache");
+    }
+    getAlign(&r);
+    // Every function exists before any constant refers to one
+    uint32_t functionCount = header->functionCount;
+    Object** functions = malloc(sizeof(Object*) * (functionCount + 1));
+    Chunk** ca = malloc(sizeof(Chunk*) * (functionCount + 1));
+    if (functions == NULL || ca == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    for (uint32_t i = 0; i < functionCount; i++) {
+        functions[i] = getChunkFunction(&r);
+        ca[i] = functions[i]->primValue.call->func;
+    }
+    for (uint32_t i = 0; i < functionCount; i++) {
+        uint32_t count = getU32(&r);
+        valueArray* constants = createValueArray(count + 1);
+        for (uint32_t j = 0; j < count; j++) addValToList(constants, getValue(&r, functions, functionCount, globalRefList));
+        ca[i]->constants = constants;
+    }
+    // Parents may be defined after their subclasses
+    uint32_t* parents = malloc(sizeof(uint32_t) * (header->classCount + 1));
+    if (parents == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    for (uint32_t i = 0; i < header->classCount; i++) {
+        if (IS_SYSTEM_DEFINED_TYPE(i)) continue;
+        char* name = getString(&r);
+        parents[i] = getU32(&r);
+        initFuncType initType = getU32(&r);
+        Value initFunc = getValue(&r, functions, functionCount, globalRefList);
+        objClass* c = createClass(name, i, initFunc, NULL, initType);
+        uint32_t attrCount = getU32(&r);
+        for (uint32_t j = 0; j < attrCount; j++) {
+            uint16_t symbol = getU16(&r);
+            attrTableInsert(c->predefinedAttrs, symbol, getValue(&r, functions, functionCount, globalRefList));
+        }
+    }
+    for (uint32_t i = 0; i < header->classCount; i++) {
+        if (IS_SYSTEM_DEFINED_TYPE(i) || parents[i] == CACHE_NO_CLASS) continue;
+        if (parents[i] >= header->classCount) compilationError(0, 0, 0, "Corrupt bytecode cache");
+        classArray[i]->parentClass = classArray[parents[i]];
+    }
+    free(parents);
+    setTotalClassCount(header->classCount);
+
+    *functionArray = malloc(sizeof(callable*) * (header->functionArraySize + 1));
+    *globalArray = malloc(sizeof(Value) * (header->globalArraySize + 1));
+    if (*functionArray == NULL || *globalArray == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    for (uint32_t i = 0; i < header->functionArraySize; i++) {
+        Value function = getValue(&r, functions, functionCount, globalRefList);
+        (*functionArray)[i] = IS_INTERNAL_NULL(function) ? NULL : VALUE_CALLABLE_VALUE(function);
+    }
+    for (uint32_t i = 0; i < header->globalArraySize; i++) (*globalArray)[i] = getValue(&r, functions, functionCount, globalRefList);
+    *globalArraySize = header->globalArraySize;
+    Value mainFunc = getValue(&r, functions, functionCount, globalRefList);
+    free(functions);
+
+    attachChunkArray(ca, functionCount);
+    return mainFunc;
+}
+
+void closeBytecodeCache() {
+    if (mappedFile != NULL) munmap(mappedFile, mappedSize);
+    mappedFile = NULL;
+    mappedSize = 0;
+}
+
+// Module images
+
+// Program symbols used by a module, numbered in first use order
+typedef struct symbolMap {
+    uint16_t* local; // By program symbol, UINT16_MAX until used
+    uint16_t* symbols;
+    uint32_t count;
+} symbolMap;
+
+static uint16_t localSymbol(symbolMap* m, uint16_t symbol) {
+    if (m->local[symbol] == UINT16_MAX) {
+        m->local[symbol] = (uint16_t) m->count;
+        m->symbols[m->count++] = symbol;
+    }
+    return m->local[symbol];
+}
+
+static void putNames(cacheBuffer* b, refTable* table) {
+    char** names = refTableKeys(table);
+    putU32(b, table->numEntries);
+    for (uint32_t i = 0; i < table->numEntries; i++) putString(b, names[i]);
+    free(names);
+}
+
+// Names keep their index, the table must be empty
+static void getNames(cacheReader* r, refTable* table) {
+    uint32_t count = getU32(r);
+    for (uint32_t i = 0; i < count; i++) getRefIndex(table, getString(r));
+}
+
+void writeModuleCache(moduleUnit* unit) {
+    functionSet set = {NULL, 0, 0};
+    for (uint32_t i = 0; i < unit->functions->size; i++) collectValue(&set, unit->functions->list[i]);
+    symbolMap m = {malloc(sizeof(uint16_t) * (symbolTotal() + 1)), malloc(sizeof(uint16_t) * (symbolTotal() + 1)), 0};
+    if (m.local == NULL || m.symbols == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    memset(m.local, 0xFF, sizeof(uint16_t) * symbolTotal());
+    for (uint32_t i = 0; i < set.count; i++) {
+        Chunk* c = set.list[i]->func;
+        for (uint32_t j = 0; j < c->count; j++) if (HAS_SYMBOL(OPCODE(c->code[j]))) localSymbol(&m, GET_WORD(c->code[j], 1));
+    }
+    for (uint32_t i = 0; i < unit->classCount; i++) {
+        for (uint32_t j = 0; j < unit->classes[i].methodCount; j++) localSymbol(&m, unit->classes[i].methodSymbols[j]);
+    }
+
+    cacheBuffer b = {NULL, 0, 0, false};
+    // Interface, read before any module is compiled
+    putU32(&b, unit->includeCount);
+    for (uint32_t i = 0; i < unit->includeCount; i++) {
+        putString(&b, unit->includes[i].name);
+        putU32(&b, unit->includes[i].line);
+        putU32(&b, unit->includes[i].index);
+    }
+    putNames(&b, unit->declaredGlobals);
+    putNames(&b, unit->declaredUses);
+    putNames(&b, unit->undeclaredUses);
+    // Body, as the front end left it before linking
+    putU32(&b, m.count);
+    for (uint32_t i = 0; i < m.count; i++) putString(&b, symbolName(m.symbols[i]));
+    putU32(&b, set.count);
+    for (uint32_t i = 0; i < set.count; i++) {
+        callable* call = set.list[i];
+        Chunk* c = call->func;
+        // Calls are only inlined once modules are linked
+        if (c->inlineSiteCount != 0) b.failed = true;
+        putU32(&b, (uint32_t) call->in);
+        putU32(&b, (uint32_t) call->out);
+        putU32(&b, call->type);
+        putU32(&b, c->count);
+        putU32(&b, c->localRefArraySize);
+        for (uint32_t j = 0; j < c->count; j++) {
+            uint64_t line = c->code[j];
+            if (HAS_SYMBOL(OPCODE(line))) line = SET_WORD(line, 1, m.local[GET_WORD(line, 1)]);
+            putU64(&b, line);
+            putU16(&b, c->lines[j]);
+            putU8(&b, c->indices[j]);
+        }
+    }
+    for (uint32_t i = 0; i < set.count; i++) {
+        valueArray* constants = set.list[i]->func->constants;
+        putU32(&b, constants->count);
+        for (int j = 0; j < constants->count; j++) putValue(&b, &set, startupRefList, constants->data[j]);
+    }
+    char** names = refTableKeys(unit->globalTable);
+    putU32(&b, unit->globalTable->numEntries);
+    for (uint32_t i = 0; i < unit->globalTable->numEntries; i++) {
+        putString(&b, names[i]);
+        putValue(&b, &set, startupRefList, unit->globalList->list[i]);
+    }
+    free(names);
+    putNames(&b, unit->classTable);
+    putNames(&b, unit->functionTable);
+    uint32_t callCount = 0;
+    for (preLinkedCallNode* node = unit->calls; node != NULL; node = node->next) callCount++;
+    putU32(&b, callCount);
+    for (preLinkedCallNode* node = unit->calls; node != NULL; node = node->next) {
+        putU64(&b, node->command);
+        putString(&b, node->name);
+        putU32(&b, node->line);
+        putU32(&b, node->index);
+    }
+    putU32(&b, unit->classCount);
+    for (uint32_t i = 0; i < unit->classCount; i++) {
+        moduleClass* c = &unit->classes[i];
+        putU16(&b, c->classID);
+        putU16(&b, c->parentID);
+        putValue(&b, &set, startupRefList, c->initFunc);
+        putU32(&b, c->methodCount);
+        for (uint32_t j = 0; j < c->methodCount; j++) {
+            putU16(&b, m.local[c->methodSymbols[j]]);
+            putValue(&b, &set, startupRefList, c->methods[j]);
+        }
+    }
+
+    if (!b.failed) {
+        moduleCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MODULE_CACHE_MAGIC, sizeof(MODULE_CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.sourceHash = hashSource(unit->source);
+        header.runtimeHash = runtimeHash;
+        header.payloadHash = hashBytes(FNV_OFFSET, b.data, b.count);
+        char* cachePath = suffixPath(unit->path, 'm');
+        writeFile(cachePath, &header, sizeof(header), &b);
+        free(cachePath);
+    }
+    free(b.data);
+    free(set.list);
+    free(m.local);
+    free(m.symbols);
+}
+
+bool openModuleCache(moduleUnit* unit) {
+    char* cachePath = suffixPath(unit->path, 'm');
+    int fd = open(cachePath, O_RDONLY);
+    free(cachePath);
+    if (fd < 0) return false;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(moduleCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t) fileStat.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    moduleCacheHeader* header = data;
+    bool valid = memcmp(header->magic, MODULE_CACHE_MAGIC, sizeof(MODULE_CACHE_MAGIC)) == 0;
+    valid = valid && header->version == CACHE_VERSION && header->runtimeHash == runtimeHash;
+    valid = valid && header->sourceHash == hashSource(unit->source);
+    valid = valid && header->payloadHash == hashBytes(FNV_OFFSET, (uint8_t*) data + sizeof(moduleCacheHeader), size - sizeof(moduleCacheHeader));
+    if (!valid) {
+        munmap(data, size);
+        return false;
+    }
+    // Names are used in place, so the file stays mapped until the modules are freed
+    unit->cacheData = data;
+    unit->cacheSize = size;
+    cacheReader r = {data, sizeof(moduleCacheHeader), size};
+    uint32_t includeCount = getU32(&r);
+    for (uint32_t i = 0; i < includeCount; i++) {
+        char* name = getString(&r);
+        uint32_t line = getU32(&r);
+        uint32_t index = getU32(&r);
+        addModuleInclude(unit, name, line, index);
+    }
+    getNames(&r, unit->declaredGlobals);
+    getNames(&r, unit->declaredUses);
+    getNames(&r, unit->undeclaredUses);
+    unit->cacheBodyPos = r.pos;
+    return true;
+}
+
+// Every name must still be declared global, or still not be
+static bool usesHold(refTable* uses, refTable* declTable, bool declared) {
+    char** names = refTableKeys(uses);
+    bool hold = true;
+    for (uint32_t i = 0; i < uses->numEntries && hold; i++) hold = refTableContains(declTable, names[i]) == declared;
+    free(names);
+    return hold;
+}
+
+static Object* getModuleFunction(cacheReader* r, uint32_t sourceIndex, uint16_t* symbols, uint32_t symbolCount) {
+    int32_t in = (int32_t) getU32(r);
+    int32_t out = (int32_t) getU32(r);
+    callableType type = getU32(r);
+    uint32_t count = getU32(r);
+    uint16_t localRefArraySize = getU32(r);
+    // Linking rewrites the code, so it is copied out of the file
+    Chunk* c = createChunk();
+    c->localRefArraySize = localRefArraySize;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t line = getU64(r);
+        if (HAS_SYMBOL(OPCODE(line))) {
+            if (GET_WORD(line, 1) >= symbolCount) compilationError(0, 0, 0, "Corrupt bytecode cache");
+            line = SET_WORD(line, 1, symbols[GET_WORD(line, 1)]);
+        }
+        uint16_t lineNumber = getU16(r);
+        uint8_t index = getU8(r);
+        writeLine(c, line, lineNumber, index, sourceIndex);
+    }
+    return createConstCallableObject(createCallable(in, out, NULL, c, type));
+}
+
+bool loadModuleCache(moduleUnit* unit, refTable* declTable) {
+    if (unit->cacheData == NULL) return false;
+    if (!usesHold(unit->declaredUses, declTable, true) || !usesHold(unit->undeclaredUses, declTable, false)) {
+        // Compiling again records the uses afresh
+        freeRefTable(unit->declaredUses);
+        freeRefTable(unit->undeclaredUses);
+        unit->declaredUses = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+        unit->undeclaredUses = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+        return false;
+    }
+    cacheReader r = {unit->cacheData, unit->cacheBodyPos, unit->cacheSize};
+    uint32_t symbolCount = getU32(&r);
+    uint16_t* symbols = malloc(sizeof(uint16_t) * (symbolCount + 1));
+    if (symbols == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    for (uint32_t i = 0; i < symbolCount; i++) symbols[i] = internSymbol(getString(&r));
+    // Every function exists before any constant refers to one
+    uint32_t functionCount = getU32(&r);
+    Object** functions = malloc(sizeof(Object*) * (functionCount + 1));
+    if (functions == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    for (uint32_t i = 0; i < functionCount; i++) {
+        functions[i] = getModuleFunction(&r, unit->sourceIndex, symbols, symbolCount);
+        listAddElement(unit->functions, OBJECT_VAL(functions[i], BUILTIN_CALLABLE));
+    }
+    for (uint32_t i = 0; i < functionCount; i++) {
+        valueArray* constants = functions[i]->primValue.call->func->constants;
+        uint32_t count = getU32(&r);
+        for (uint32_t j = 0; j < count; j++) addValToList(constants, getValue(&r, functions, functionCount, startupRefList));
+    }
+    uint32_t globalCount = getU32(&r);
+    for (uint32_t i = 0; i < globalCount; i++) {
+        char* name = getString(&r);
+        addGlobalReference(unit->globalTable, unit->globalList, getValue(&r, functions, functionCount, startupRefList), name);
+    }
+    getNames(&r, unit->classTable);
+    getNames(&r, unit->functionTable);
+    // Calls keep their order
+    uint32_t callCount = getU32(&r);
+    preLinkedCallNode** tail = &unit->calls;
+    for (uint32_t i = 0; i < callCount; i++) {
+        preLinkedCallNode* node = malloc(sizeof(preLinkedCallNode));
+        if (node == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+        node->command = getU64(&r);
+        node->name = getString(&r);
+        node->line = getU32(&r);
+        node->index = getU32(&r);
+        node->sourceIndex = unit->sourceIndex;
+        node->next = NULL;
+        *tail = node;
+        tail = &node->next;
+    }
+    uint32_t classCount = getU32(&r);
+    for (uint32_t i = 0; i < classCount; i++) {
+        uint16_t classID = getU16(&r);
+        uint16_t parentID = getU16(&r);
+        moduleClass* c = addModuleClass(unit, classID, parentID, getValue(&r, functions, functionCount, startupRefList));
+        uint32_t methodCount = getU32(&r);
+        for (uint32_t j = 0; j < methodCount; j++) {
+            uint16_t symbol = getU16(&r);
+            if (symbol >= symbolCount) compilationError(0, 0, 0, "Corrupt bytecode cache");
+            addModuleMethod(c, symbols[symbol], getValue(&r, functions, functionCount, startupRefList));
+        }
+    }
+    free(symbols);
+    free(functions);
+    return true;
+}
+
+void closeModuleCache(moduleUnit* unit) {
+    if (unit->cacheData != NULL) munmap(unit->cacheData, unit->cacheSize);
+    unit->cacheData = NULL;
+    unit->cacheSize = 0;
+}
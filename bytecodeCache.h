@@ -0,0 +1,29 @@
+#ifndef CJ_2_BYTECODECACHE_H
+#define CJ_2_BYTECODECACHE_H
+
+#include "object.h"
+#include "refManager.h"
+#include "module.h"
+
+// Compiled programs are stored next to their source as <source>c, keyed by hashes of the source and every include.
+// Each module is also stored on its own as <source>m, so a program missing the first only compiles the modules that changed.
+// A cache file is only valid for the runtime that wrote it, builtins and user functions included.
+
+char* bytecodeCachePath(char* sourcePath);
+// Records the builtins and user functions, call once they are loaded and before compiling
+void beginBytecodeCache(refTable* globalRefTable, runtimeList* globalRefList);
+// Maps a cache file and rebuilds the program around its code arrays, internal null when stale or missing
+Value loadBytecodeCache(char* cachePath, char* source, runtimeList* globalRefList, callable*** functionArray, Value** globalArray, uint32_t* globalArraySize);
+// Writes everything reachable from the compiled program, must run before the global ref list is freed
+void writeBytecodeCache(char* cachePath, char* source, runtimeList* globalRefList, Value mainFunc, callable** functionArray, uint32_t functionArraySize, Value* globalArray, uint32_t globalArraySize);
+void closeBytecodeCache();
+
+// Maps a module image and reads its includes and global declarations, false when stale or missing
+bool openModuleCache(moduleUnit* unit);
+// Reads the module body, false when a name the module's code depended on changed its global declaration
+bool loadModuleCache(moduleUnit* unit, refTable* declTable);
+// Writes a freshly compiled module, must run before the module is linked
+void writeModuleCache(moduleUnit* unit);
+void closeModuleCache(moduleUnit* unit);
+
+#endif //CJ_2_BYTECODECACHE_H
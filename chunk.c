@@ -49,7 +49,7 @@ bool areValuesEqual(Value v1, Value v2) {
         case VAL_NUMBER:
             return v1.num == v2.num;
         case BUILTIN_STR:
-            return strcmp(VALUE_STR_VALUE(v1), VALUE_STR_VALUE(v2)) == 0;
+            return VALUE_STR_VALUE(v1) == VALUE_STR_VALUE(v2);
         default:
             return v1.obj == v2.obj;
     }
@@ -78,10 +78,14 @@ Chunk* createChunk() {
     c->currIndexAtLine = 0;
     // Local ref array will be set after chunk compilation
     c->localRefArraySize = 0;
+    c->mapped = false;
     c->code = malloc(c->capacity*sizeof(uint64_t));
     c->lines = malloc(c->capacity*sizeof(uint16_t));
     c->indices = malloc(c->capacity*sizeof(uint8_t));
     c->sourceIndices = malloc(c->capacity*sizeof(uint8_t));
+    c->siteIndices = NULL;
+    c->inlineSites = NULL;
+    c->inlineSiteCount = 0;
     // Check if memory allocation succeeded
     if (c->code == NULL || c->lines == NULL || c->indices == NULL || c->sourceIndices == NULL) {
         compilationError(0, 0, 0, "Memory allocation failed.");
@@ -94,10 +98,14 @@ Chunk* createChunk() {
 void freeChunk(Chunk* c) {
     // Free objArray
     freeObjArray(c->constants);
-    free(c->code);
-    free(c->lines);
-    free(c->indices);
-    free(c->sourceIndices);
+    if (!c->mapped) {
+        free(c->code);
+        free(c->lines);
+        free(c->indices);
+        free(c->sourceIndices);
+        free(c->siteIndices);
+        free(c->inlineSites);
+    }
     free(c);
 }
 
@@ -54,6 +54,22 @@ typedef enum OpCode {
     OP_RETURN_NONE,
     OP_JUMP,
     OP_JUMP_IF_FALSE,
+    OP_ITER_INIT, // Pops an iterable into the for-in state slots
+    OP_ITER_NEXT, // Stores the next element in the loop variable, or jumps when exhausted
+    OP_FOR_STEP, // Steps a counted loop variable, compares against the bound and jumps back while true
+    // Emitted by the optimizer when both operands are proven numbers, same layout as the generic ops
+    OP_ADD_NUM,
+    OP_SUB_NUM,
+    OP_MUL_NUM,
+    OP_DIV_NUM,
+    OP_MOD_NUM,
+    OP_POW_NUM,
+    OP_LESS_NUM,
+    OP_MORE_NUM,
+    OP_LESS_EQUAL_NUM,
+    OP_MORE_EQUAL_NUM,
+    OP_EQUAL_NUM,
+    OP_GET_CLASS_ATTR_CALL, // OP_GET_ATTR_CALL on a receiver of a known builtin class
 } OpCode;
 
 typedef enum specialAssignment {
@@ -66,26 +82,46 @@ typedef enum specialAssignment {
     ASSIGNMENT_POWER,
 } specialAssignment;
 
+// OP_FOR_STEP flag byte, low bits hold the step assignment
+#define FOR_STEP_CONST_BOUND 0x80
+// Binary op word holding the destination local plus one, zero pushes the result.
+// Never set alongside a payload operand, which owns the same bytes.
+#define BINARY_DEST_WORD 6
+
 typedef struct objArray {
     int count;
     int capacity;
     Value* data;
 } valueArray;
 
+// Call site of an inlined body, chained to the site its caller was itself inlined at
+typedef struct inlineSite {
+    uint16_t line;
+    uint8_t index;
+    uint8_t sourceIndex;
+    uint16_t parent; // Site plus one, zero when the call is in the chunk's own code
+} inlineSite;
+
 typedef struct Chunk {
     uint32_t count;
     uint32_t capacity;
     uint8_t currIndexAtLine; // Current index of the line within the 64 bits
     uint16_t localRefArraySize;
+    bool mapped; // Code arrays point into a bytecode cache file
     uint64_t* code;
     uint16_t* lines;
     uint8_t* indices;
     uint8_t* sourceIndices;
+    // Inline site plus one per instruction, NULL until the inliner expands a call into the chunk
+    uint16_t* siteIndices;
+    inlineSite* inlineSites;
+    uint16_t inlineSiteCount;
     valueArray* constants;
 } Chunk;
 
 valueArray* createValueArray(uint16_t size);
 uint16_t addValToList(valueArray* array, Value obj);
+uint8_t addObj(valueArray* array, Value obj);
 
 bool areValuesEqual(Value v1, Value v2);
 void freeObjArray(valueArray* array);
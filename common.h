@@ -6,8 +6,9 @@
 #define CJ_2_COMMON_H
 
 #define STRING_TABLE_INIT_SIZE 8
+#define SYMBOL_TABLE_INIT_SIZE 64
 
-#define OBJECT_ATTR_TABLE_INIT_SIZE 8
+#define OBJECT_ATTR_TABLE_INIT_SIZE 4
 #define CLASS_ATTR_TABLE_INIT_SIZE 8
 
 #define CHUNK_INIT_SIZE 16
@@ -26,6 +27,11 @@
 #define RUNTIME_LIST_INIT_SIZE 8
 #define RUNTIME_DICT_INIT_SIZE 8
 #define RUNTIME_SET_INIT_SIZE 8
+#define RUNTIME_NUM_ARRAY_INIT_SIZE 8
+// Integer keyed dicts and sets switch to hashing past this key, or when keys get sparse
+#define RUNTIME_INT_INDEX_MAX_KEY (1 << 24)
+#define RUNTIME_INT_INDEX_MIN_SIZE 16
+#define RUNTIME_INT_INDEX_MAX_SPARSITY 4
 
 // VM
 #define GLOBAL_REF_TABLE_INIT_SIZE 8
@@ -38,8 +44,23 @@
 #define CONTINUE_JUMP_LIST_INIT_SIZE 32
 #define BREAK_JUMP_LIST_INIT_SIZE 32
 #define INCLUDE_STACK_SIZE 32
+#define SOURCE_EXTENSION ".cj"
 #define MAX_SOURCE_SIZE 128
+#define FOR_IN_MAX_DEPTH 16
+#define TOKEN_ARENA_BLOCK_SIZE 65536
+//#define PRINT_TOKENIZE_TIME
 #define OPTIMIZE_CONST_PAYLOAD
+#define OPTIMIZE_CHUNK
+#define OPTIMIZER_MAX_PASSES 8
+#define SPECIALIZE_TYPES
+#define IR_MAX_STACK_DEPTH 32
+#define INLINE_FUNCTIONS
+#define INLINE_MAX_INSTRUCTIONS 24
+#define RESOLVE_SCOPES
+#define ELIMINATE_REDUNDANCY
+#define FUSE_BINARY_OPERANDS
+#define BYTECODE_CACHE
+//#define PRINT_MODULE_LOADS
 
 //#define DEBUG_PRINT_VM_STACK
 //#define DEBUG_PRINT_TOKENS
@@ -48,20 +69,33 @@
 //#define DEBUG_PRINT_CHUNK_AFTER_GLOBAL_OPTIMIZATION
 //#define DEBUG_PRINT_LOCAL_REF_TABLE
 //#define DEBUG_PRINT_PRELINKED_FUNC_LIST
+//#define DEBUG_PRINT_OPTIMIZER_STATS
 
 // Constant List
 #define CONST_BLOCK_SIZE 32
 
 // Runtime Memory Management
 #define RUNTIME_BLOCK_SIZE 64
-#define FREE_STACK_SIZE 128
+#define GC_HEAP_GROWTH_FACTOR 2
 //#define PRINT_MEMORY_INFO
 
+// Slab Allocator
+#define SLAB_PAGE_SIZE 65536
+//#define PRINT_SLAB_STATS
+
 // Error Tracing
 #define PRINT_ERROR_OP
 
 // GC
 //#define PRINT_GC_INFO
 //#define PRINT_GC_REMOVAL
+//#define PRINT_GC_PAUSE
+
+// Parallel marking, thread count can be overridden by CJ_GC_THREADS
+#define GC_MARK_THREAD_COUNT 1
+#define GC_MAX_MARK_THREADS 64
+#define GC_MARK_STACK_INIT_SIZE 256
+#define GC_STEAL_BATCH_SIZE 64
+#define GC_DONATE_THRESHOLD 128
 
 #endif //CJ_2_COMMON_H
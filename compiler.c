@@ -13,6 +13,14 @@
 #include "builtinClasses.h"
 #include "objectManager.h"
 #include "objClass.h"
+#include "optimizer.h"
+#include "inliner.h"
+#include "redundancy.h"
+#include "scope.h"
+#include "module.h"
+#ifdef BYTECODE_CACHE
+#include "bytecodeCache.h"
+#endif
 
 
 // Increment current token
@@ -23,6 +31,8 @@
 #define GET_BYTE(data, shift)  ((uint8_t) (((data) >> ((shift) * 8)) & 0xFF))
 #define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
 #define SET_BOTTOM_8_BITS(data, byteVal)  (((data) & 0xFFFFFFFFFFFFFF00) | (uint64_t)(byteVal))
+#define SET_WORD(data, shift, word) (((data) & ~(0xFFFFULL << ((shift) * 8))) | ((uint64_t)(word) << ((shift) * 8)))
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
 
 
 refTable* globalRefTable = NULL;
@@ -31,6 +41,9 @@ refTable* globalClassRefTable = NULL;
 refTable* prelinkedFuncTable = NULL;
 refTable* globalDeclTable = NULL;
 
+// Module being compiled, its references are numbered on their own
+moduleUnit* currentModule = NULL;
+
 Chunk* currentChunk = NULL;
 refTable* currentLocalRefTable = NULL;
 uint32_t* GAsize = NULL;
@@ -60,6 +73,10 @@ uint8_t breakJumpIndex;
 uint16_t chunkSetIndexArray[512];
 uint16_t chunkSetIndexArrayIndex;
 
+// Hidden local names for the for-in state slots, one triple per nesting depth
+char forInSlotNames[FOR_IN_MAX_DEPTH][3][IDENTIFIER_BUFFER_SIZE];
+uint8_t forInDepth;
+
 // Optimization for left hand size binary number operation
 captureType capturedOperand;
 int32_t capturedValue;
@@ -164,23 +181,60 @@ void clearCurrentChunk() {
             currentChunk->code[i] &= ~(0xFFFFULL << 8);
             // Set the next 16 bits to the new mapped index
             currentChunk->code[i] |= ((uint64_t)localIndexArray[localIndex] << 8);
+        } else if ((op >= OP_ADD && op <= OP_MORE_EQUAL) || op == OP_EQUAL || op == OP_POW) {
+            // Remap captured local operands, right capture takes the first address slot
+            uint8_t localAddrSlot = 2;
+            for (int nibble = 3; nibble >= 2; nibble--) {
+                captureType capture = (captureType) ((currentChunk->code[i] >> (nibble * 4)) & 0xF);
+                if (capture != CAPTURE_VARIABLE) continue;
+                uint16_t localIndex = (uint16_t)((currentChunk->code[i] >> (localAddrSlot * 8)) & 0xFFFF);
+                if (localIndexArray[localIndex] != -1) {
+                    currentChunk->code[i] &= ~(0xFFFFULL << (localAddrSlot * 8));
+                    currentChunk->code[i] |= ((uint64_t)localIndexArray[localIndex] << (localAddrSlot * 8));
+                }
+                localAddrSlot += 2;
+            }
+        } else if (op == OP_ITER_INIT) {
+            uint16_t stateIndex = (uint16_t)((currentChunk->code[i] >> (1 * 8)) & 0xFFFF);
+            currentChunk->code[i] &= ~(0xFFFFULL << 8);
+            currentChunk->code[i] |= ((uint64_t)localIndexArray[stateIndex] << 8);
+        } else if (op == OP_ITER_NEXT) {
+            // Remap state and loop variable, the jump address stays in the first word
+            uint16_t stateIndex = (uint16_t)((currentChunk->code[i] >> (3 * 8)) & 0xFFFF);
+            uint16_t varIndex = (uint16_t)((currentChunk->code[i] >> (5 * 8)) & 0xFFFF);
+            currentChunk->code[i] &= ~(0xFFFFFFFFULL << (3 * 8));
+            currentChunk->code[i] |= ((uint64_t)localIndexArray[stateIndex] << (3 * 8));
+            currentChunk->code[i] |= ((uint64_t)localIndexArray[varIndex] << (5 * 8));
+        } else if (op == OP_FOR_STEP) {
+            // Remap counter, and bound when it is a local
+            uint8_t varIndex = GET_BYTE(currentChunk->code[i], 3);
+            currentChunk->code[i] &= ~(0xFFULL << (3 * 8));
+            currentChunk->code[i] |= ((uint64_t)localIndexArray[varIndex] << (3 * 8));
+            if (!(GET_BYTE(currentChunk->code[i], 7) & FOR_STEP_CONST_BOUND)) {
+                uint8_t boundIndex = GET_BYTE(currentChunk->code[i], 5);
+                currentChunk->code[i] &= ~(0xFFULL << (5 * 8));
+                currentChunk->code[i] |= ((uint64_t)localIndexArray[boundIndex] << (5 * 8));
+            }
         }
     }
     // Free
     free(localIndexArray);
     // Set chunk local ref array size
     currentChunk->localRefArraySize = localRefSize - frontShift;
+#ifdef OPTIMIZE_CHUNK
+    optimizeChunk(currentChunk);
+#endif
     // Calculate jump lengths
     for (int i=0; i<currentChunk->count; i++) {
         uint64_t* currentCode = &currentChunk->code[i];
         OpCode op = (uint8_t)(currentChunk->code[i] & 0xFF);
-        if (op == OP_JUMP || op == OP_JUMP_IF_FALSE) {
+        if (op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_ITER_NEXT || op == OP_FOR_STEP) {
             uint16_t jumpAddr = GET_WORD(*currentCode, 1);
             int16_t jumpAddrDiff = (int16_t) (jumpAddr - i);
             // Clear the next 16 bits after the 8-bit opcode
             *currentCode &= ~(0xFFFFULL << 8);
             // Set the next 16 bits to the new mapped index
-            *currentCode |= ((int64_t)jumpAddrDiff << 8);
+            *currentCode |= ((uint64_t)(uint16_t)jumpAddrDiff << 8);
         }
     }
 #ifdef DEBUG_PRINT_CHUNK_AFTER_CREATION
@@ -203,12 +257,38 @@ Value createStringConst(char* str) {
     return builtinVal;
 }
 
-uint16_t getGlobalRefIndex(char* identifier) {
-    if (globalRefTable == NULL || globalRefList == NULL) compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Null global refTable or refList");
-    if (refTableContains(globalRefTable, identifier)) return getRefIndex(globalRefTable, identifier);
+static uint16_t refIndexIn(refTable* table, runtimeList* list, char* identifier) {
+    if (refTableContains(table, identifier)) return getRefIndex(table, identifier);
     // Add to refTable
-    addGlobalReference(globalRefTable, globalRefList, INTERNAL_NULL_VAL, identifier);
-    return getRefIndex(globalRefTable, identifier);
+    addGlobalReference(table, list, INTERNAL_NULL_VAL, identifier);
+    return getRefIndex(table, identifier);
+}
+
+// Module relative, relocated when the module is linked
+uint16_t getGlobalRefIndex(char* identifier) {
+    if (currentModule == NULL) compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Null global refTable or refList");
+    return refIndexIn(currentModule->globalTable, currentModule->globalList, identifier);
+}
+
+// Program wide, once modules are linked
+static uint16_t getLinkedRefIndex(char* identifier) {
+    return refIndexIn(globalRefTable, globalRefList, identifier);
+}
+
+// Builtin classes keep their IDs, user classes are module relative
+static uint16_t getClassRefIndex(char* identifier) {
+    if (refTableContains(globalClassRefTable, identifier)) {
+        uint16_t classID = getRefIndex(globalClassRefTable, identifier);
+        if (IS_SYSTEM_DEFINED_TYPE(classID)) return classID;
+    }
+    return MODULE_CLASS_BASE + getRefIndex(currentModule->classTable, identifier);
+}
+
+// Answers are recorded, a cached module is only reused while they still hold
+static bool isDeclaredGlobal(char* identifier) {
+    bool declared = refTableContains(globalDeclTable, identifier);
+    getRefIndex(declared ? currentModule->declaredUses : currentModule->undeclaredUses, identifier);
+    return declared;
 }
 
 void patchContinueJumps(uint16_t jumpAddr) {
@@ -273,6 +353,7 @@ ParseRule rules[] = {
         [KEYWORD_ELSE]        = {NULL,     NULL,   PREC_NONE},
         [KEYWORD_WHILE]       = {NULL,     NULL,   PREC_NONE},
         [KEYWORD_FOR]         = {NULL,     NULL,   PREC_NONE},
+        [KEYWORD_IN]          = {NULL,     NULL,   PREC_NONE},
         [KEYWORD_BREAK]       = {NULL,     NULL,   PREC_NONE},
         [KEYWORD_CONTINUE]    = {NULL,     NULL,   PREC_NONE},
         [KEYWORD_RETURN]      = {NULL,     NULL,   PREC_NONE},
@@ -332,7 +413,7 @@ void newObject(bool enforceReturn) {
     token* newToken = getPrevToken();
     checkType(IDENTIFIER, "Expected class name");
     WRITEOP_CURRENT_CHUNK(OP_INIT, newToken->line, newToken->index, newToken->sourceIndex);
-    writeChunk16(currentChunk, getRefIndex(globalClassRefTable, TOKEN_VALUE(currentToken)));
+    writeChunk16(currentChunk, getClassRefIndex(TOKEN_VALUE(currentToken)));
     // Load in arguments
     incCheckType(LEFT_PARENTHESES, "Expected '(' after class name");
     incCheckNull();
@@ -355,7 +436,7 @@ void list(bool enforceReturn) {
     // Create list object
     token* listToken = getPrevToken();
     WRITEOP_CURRENT_CHUNK(OP_INIT, listToken->line, listToken->index, listToken->sourceIndex);
-    writeChunk16(currentChunk, getRefIndex(globalClassRefTable, "list"));
+    writeChunk16(currentChunk, getClassRefIndex("list"));
     // Collect arguments
     uint8_t argCount = parseCommaSequence(RIGHT_BRACKET);
     // Skip right bracket
@@ -368,7 +449,7 @@ void set(bool enforceReturn) {
     // Create list object
     token* setToken = getPrevToken();
     WRITEOP_CURRENT_CHUNK(OP_INIT, setToken->line, setToken->index, setToken->sourceIndex);
-    writeChunk16(currentChunk, getRefIndex(globalClassRefTable, "set"));
+    writeChunk16(currentChunk, getClassRefIndex("set"));
     // Collect arguments
     uint8_t argCount = parseCommaSequence(RIGHT_BRACE);
     // Skip right bracket
@@ -386,10 +467,11 @@ void string(bool enforceReturn) {
 void dot(bool enforceReturn) {
     token* dotToken = getPrevToken();
     if (TOKEN_TYPE(currentToken) != IDENTIFIER) compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Expected identifier after '.'");
-    Value attrName = createStringConst(TOKEN_VALUE(currentToken));
+    // Attribute names are resolved to symbols here, the VM never hashes them
+    uint16_t attrSymbol = internSymbol(TOKEN_VALUE(currentToken));
     incCheckNull();
     WRITEOP_CURRENT_CHUNK(TOKEN_TYPE(currentToken) == LEFT_PARENTHESES ? OP_GET_ATTR_CALL : OP_GET_ATTR, dotToken->line, dotToken->index, dotToken->sourceIndex);
-    writeValConstant(currentChunk, attrName);
+    writeChunk16(currentChunk, attrSymbol);
 }
 
 void binary(bool enforceReturn) {
@@ -472,7 +554,7 @@ void binary(bool enforceReturn) {
         case LESS: {
             if (leftCapture == CAPTURE_PAYLOAD && rightCapture == CAPTURE_PAYLOAD) {
                 WRITEOP_CURRENT_CHUNK(OP_CONSTANT, prevToken->line, prevToken->index, prevToken->sourceIndex);
-                writeValConstant(currentChunk, BOOL_VAL(leftCapture < rightCapture));
+                writeValConstant(currentChunk, BOOL_VAL(capturedLeftValue < capturedRightValue));
                 return;
             } else {
                 WRITEOP_CURRENT_CHUNK(OP_LESS, prevToken->line, prevToken->index, prevToken->sourceIndex);
@@ -482,7 +564,7 @@ void binary(bool enforceReturn) {
         case MORE: {
             if (leftCapture == CAPTURE_PAYLOAD && rightCapture == CAPTURE_PAYLOAD) {
                 WRITEOP_CURRENT_CHUNK(OP_CONSTANT, prevToken->line, prevToken->index, prevToken->sourceIndex);
-                writeValConstant(currentChunk, BOOL_VAL(leftCapture > rightCapture));
+                writeValConstant(currentChunk, BOOL_VAL(capturedLeftValue > capturedRightValue));
                 return;
             } else {
                 WRITEOP_CURRENT_CHUNK(OP_MORE, prevToken->line, prevToken->index, prevToken->sourceIndex);
@@ -492,7 +574,7 @@ void binary(bool enforceReturn) {
         case LESS_EQUAL: {
             if (leftCapture == CAPTURE_PAYLOAD && rightCapture == CAPTURE_PAYLOAD) {
                 WRITEOP_CURRENT_CHUNK(OP_CONSTANT, prevToken->line, prevToken->index, prevToken->sourceIndex);
-                writeValConstant(currentChunk, BOOL_VAL(leftCapture <= rightCapture));
+                writeValConstant(currentChunk, BOOL_VAL(capturedLeftValue <= capturedRightValue));
                 return;
             } else {
                 WRITEOP_CURRENT_CHUNK(OP_LESS_EQUAL, prevToken->line, prevToken->index, prevToken->sourceIndex);
@@ -502,7 +584,7 @@ void binary(bool enforceReturn) {
         case MORE_EQUAL: {
             if (leftCapture == CAPTURE_PAYLOAD && rightCapture == CAPTURE_PAYLOAD) {
                 WRITEOP_CURRENT_CHUNK(OP_CONSTANT, prevToken->line, prevToken->index, prevToken->sourceIndex);
-                writeValConstant(currentChunk, BOOL_VAL(leftCapture >= rightCapture));
+                writeValConstant(currentChunk, BOOL_VAL(capturedLeftValue >= capturedRightValue));
                 return;
             } else {
                 WRITEOP_CURRENT_CHUNK(OP_MORE_EQUAL, prevToken->line, prevToken->index, prevToken->sourceIndex);
@@ -512,7 +594,7 @@ void binary(bool enforceReturn) {
         case DOUBLE_EQUAL: {
             if (leftCapture == CAPTURE_PAYLOAD && rightCapture == CAPTURE_PAYLOAD) {
                 WRITEOP_CURRENT_CHUNK(OP_CONSTANT, prevToken->line, prevToken->index, prevToken->sourceIndex);
-                writeValConstant(currentChunk, BOOL_VAL(leftCapture == rightCapture));
+                writeValConstant(currentChunk, BOOL_VAL(capturedLeftValue == capturedRightValue));
                 return;
             } else {
                 WRITEOP_CURRENT_CHUNK(OP_EQUAL, prevToken->line, prevToken->index, prevToken->sourceIndex);
@@ -599,7 +681,7 @@ void dictionary(bool enforceReturn) {
     // Create list object
     token* dictToken = getPrevToken();
     WRITEOP_CURRENT_CHUNK(OP_INIT, dictToken->line, dictToken->index, dictToken->sourceIndex);
-    writeChunk16(currentChunk, getRefIndex(globalClassRefTable, "dict"));
+    writeChunk16(currentChunk, getClassRefIndex("dict"));
     // Collect arguments
     uint8_t argCount = 0;
     while (TOKEN_TYPE(currentToken) != RIGHT_BRACE) { // Init list with items
@@ -685,14 +767,17 @@ void functionCall(bool enforceReturn) {
     incCheckNull();
     WRITEOP_CURRENT_CHUNK(enforceReturn ? OP_EXEC_FUNCTION_ENFORCE_RETURN : OP_EXEC_FUNCTION_IGNORE_RETURN, callToken->line, callToken->index, callToken->sourceIndex);
     writeChunk8(currentChunk, argCount);
-    uint16_t functionIndex = getRefIndex(prelinkedFuncTable, TOKEN_VALUE(functionToken));
+    uint16_t functionIndex = getRefIndex(currentModule->functionTable, TOKEN_VALUE(functionToken));
     writeChunk16(currentChunk, functionIndex);
-    // Add to prelinked call list
+    // Add to the module's prelinked call list
     preLinkedCallNode* node = malloc(sizeof(preLinkedCallNode));
     node->command = currentChunk->code[currentChunk->count-1];
-    node->callToken = functionToken;
-    node->next = preLinkedCallHead;
-    preLinkedCallHead = node;
+    node->name = TOKEN_VALUE(functionToken);
+    node->line = functionToken->line;
+    node->index = functionToken->index;
+    node->sourceIndex = functionToken->sourceIndex;
+    node->next = currentModule->calls;
+    currentModule->calls = node;
     // Set flag
     emittedCall = true;
 }
@@ -706,7 +791,7 @@ void getVar(bool enforceReturn) {
             } else { // Get local ref
 #ifdef OPTIMIZE_CONST_PAYLOAD
                 // If not a global ref, check if compiler optimization for left and right hand binary number operation available
-                if (!refTableContains(globalDeclTable, TOKEN_VALUE(prevToken))) {
+                if (!isDeclaredGlobal(TOKEN_VALUE(prevToken))) {
                     token* priorToken = prevToken->prevToken;
                     if (isValidCapturingNeighbor(TOKEN_TYPE(currentToken)) || (priorToken != NULL && isValidCapturingNeighbor(TOKEN_TYPE(priorToken)))) {
                         capturedOperand = CAPTURE_VARIABLE;
@@ -801,7 +886,7 @@ uint8_t opArgCount(OpCode op) {
         case OP_GET_GLOBAL_REF_ATTR: return 2;
         case OP_GET_COMBINED_REF_ATTR: return 4;
         case OP_GET_INDEX_REF: return 0;
-        case OP_GET_ATTR: return 1;
+        case OP_GET_ATTR: return 2;
         default:
             compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Invalid end operation swap");
             return 0;
@@ -1008,11 +1093,139 @@ void standardStatement() {
     }
 }
 
+void forInStatement(token* forToken) {
+    token* varToken = currentToken;
+    // Skip identifier and 'in'
+    incCheckNull();
+    incCheckNull();
+    if (forInDepth >= FOR_IN_MAX_DEPTH) compilationError(forToken->line, forToken->index, forToken->sourceIndex, "For-in nesting too deep");
+    // Reserve consecutive state slots for this depth, reused by sibling loops
+    uint16_t stateIndex = 0;
+    for (int i=0; i<3; i++) {
+        if (forInSlotNames[forInDepth][i][0] == '\0') snprintf(forInSlotNames[forInDepth][i], IDENTIFIER_BUFFER_SIZE, "@for%u.%d", forInDepth, i);
+        uint16_t slotIndex = getRefIndex(currentLocalRefTable, forInSlotNames[forInDepth][i]);
+        if (i == 0) stateIndex = slotIndex;
+        chunkSetIndexArray[chunkSetIndexArrayIndex++] = slotIndex;
+    }
+    forInDepth++;
+    uint16_t varIndex = getRefIndex(currentLocalRefTable, TOKEN_VALUE(varToken));
+    chunkSetIndexArray[chunkSetIndexArrayIndex++] = varIndex;
+    // Parse iterable
+    expression(true);
+    checkType(RIGHT_PARENTHESES, "Expected ')' after for-in iterable");
+    incCheckType(LEFT_BRACE, "Expected '{' after for-in iterable");
+    incCheckNull();
+    WRITEOP_CURRENT_CHUNK(OP_ITER_INIT, forToken->line, forToken->index, forToken->sourceIndex);
+    writeChunk16(currentChunk, stateIndex);
+    // Loop head, exits when the iterable is exhausted
+    uint16_t iterNextChunkIndex = writeJump(currentChunk, OP_ITER_NEXT, forToken->line, forToken->index, forToken->sourceIndex);
+    writeChunk16(currentChunk, stateIndex);
+    writeChunk16(currentChunk, varIndex);
+
+    // Store previous jump list pointers
+    uint16_t* prevContinueJumpList = continueJumpList;
+    uint16_t* prevBreakJumpList = breakJumpList;
+    uint8_t prevContinueJumpIndex = continueJumpIndex;
+    uint8_t prevBreakJumpIndex = breakJumpIndex;
+
+    // Create new jump list pointers
+    continueJumpList = malloc(sizeof(uint16_t) * CONTINUE_JUMP_LIST_INIT_SIZE);
+    breakJumpList = malloc(sizeof(uint16_t) * BREAK_JUMP_LIST_INIT_SIZE);
+    continueJumpIndex = 0;
+    breakJumpIndex = 0;
+
+    // Parse for body
+    while (TOKEN_TYPE(currentToken) != RIGHT_BRACE) statement();
+
+    // Add jump back instruction
+    writeJumpBack(currentChunk, OP_JUMP, iterNextChunkIndex, currentToken->line, currentToken->index, currentToken->sourceIndex);
+    incCheckNull();
+
+    // Patch break & continue jumps
+    patchBreakJumpsAtCurrent();
+    patchContinueJumps(iterNextChunkIndex);
+
+    // Patch exit jump
+    patchJumpAtCurrent(currentChunk, iterNextChunkIndex);
+
+    // Free current jump list pointers
+    free(continueJumpList);
+    free(breakJumpList);
+
+    // Replace previous jump list pointers
+    continueJumpList = prevContinueJumpList;
+    breakJumpList = prevBreakJumpList;
+    continueJumpIndex = prevContinueJumpIndex;
+    breakJumpIndex = prevBreakJumpIndex;
+
+    forInDepth--;
+}
+
+bool isLocalSet(uint16_t localIndex) {
+    for (int i=0; i<chunkSetIndexArrayIndex; i++) if (chunkSetIndexArray[i] == localIndex) return true;
+    return false;
+}
+
+// Checks whether code from start on may write the given local
+bool chunkWritesLocal(Chunk* c, uint32_t start, uint16_t localIndex) {
+    for (uint32_t i=start; i<c->count; i++) {
+        OpCode op = (uint8_t)(c->code[i] & 0xFF);
+        if (op == OP_SET_COMBINED_REF_ATTR && GET_WORD(c->code[i], 1) == localIndex) return true;
+        if (op == OP_ITER_NEXT && GET_WORD(c->code[i], 5) == localIndex) return true;
+        if (op == OP_FOR_STEP && GET_BYTE(c->code[i], 3) == localIndex) return true;
+    }
+    return false;
+}
+
+// A counted loop assigns a local in the pre-loop statement, compares it against a
+// constant or an already set local, and steps it by a constant. Fills the
+// OP_FOR_STEP operands, the bound is checked for writes after the body
+bool matchCountedLoop(uint32_t conditionIndex, Chunk* postLoopChunk, uint64_t* stepLine, uint16_t* boundIndex) {
+    if (conditionIndex == 0 || postLoopChunk->count != 2) return false;
+    uint64_t preLine = currentChunk->code[conditionIndex - 1];
+    uint64_t conditionLine = currentChunk->code[conditionIndex];
+    uint64_t constLine = postLoopChunk->code[0];
+    uint64_t postLine = postLoopChunk->code[1];
+    // Condition compares a captured local
+    OpCode compareOp = (uint8_t)(conditionLine & 0xFF);
+    if (compareOp != OP_LESS && compareOp != OP_MORE && compareOp != OP_LESS_EQUAL && compareOp != OP_MORE_EQUAL) return false;
+    captureType leftCapture = (captureType) ((conditionLine >> (2 * 4)) & 0xF);
+    captureType rightCapture = (captureType) ((conditionLine >> (3 * 4)) & 0xF);
+    if (leftCapture != CAPTURE_VARIABLE || rightCapture == CAPTURE_NONE) return false;
+    uint16_t varIndex = GET_WORD(conditionLine, rightCapture == CAPTURE_VARIABLE ? 4 : 2);
+    // Pre-loop statement assigns the counter
+    if ((uint8_t)(preLine & 0xFF) != OP_SET_COMBINED_REF_ATTR || GET_WORD(preLine, 1) != varIndex || GET_BYTE(preLine, 5) != ASSIGNMENT_NONE) return false;
+    // Post-loop statement steps the counter by a number constant
+    if ((uint8_t)(constLine & 0xFF) != OP_CONSTANT || VALUE_TYPE(currentChunk->constants->data[GET_BYTE(constLine, 1)]) != VAL_NUMBER) return false;
+    if ((uint8_t)(postLine & 0xFF) != OP_SET_COMBINED_REF_ATTR || GET_WORD(postLine, 1) != varIndex) return false;
+    specialAssignment sa = GET_BYTE(postLine, 5);
+    if (sa != ASSIGNMENT_ADD && sa != ASSIGNMENT_SUB) return false;
+    uint8_t flags = sa;
+    uint8_t bound;
+    if (rightCapture == CAPTURE_VARIABLE) {
+        *boundIndex = GET_WORD(conditionLine, 2);
+        if (*boundIndex == varIndex || !isLocalSet(*boundIndex)) return false;
+        bound = *boundIndex;
+    } else {
+        *boundIndex = UINT16_MAX;
+        bound = addObj(currentChunk->constants, NUMBER_VAL((double)(uint32_t)(conditionLine >> (4 * 8))));
+        flags |= FOR_STEP_CONST_BOUND;
+    }
+    *stepLine = OP_FOR_STEP | ((uint64_t)varIndex << (3 * 8)) | ((uint64_t)GET_BYTE(constLine, 1) << (4 * 8)) |
+                ((uint64_t)bound << (5 * 8)) | ((uint64_t)compareOp << (6 * 8)) | ((uint64_t)flags << (7 * 8));
+    return true;
+}
+
 void forStatement() {
     token* forToken = currentToken;
     // Check formatting
     incCheckType(LEFT_PARENTHESES, "Expected '(' after 'for'");
     incCheckNull();
+    // For-in loop
+    if (TOKEN_TYPE(currentToken) == IDENTIFIER && currentToken->nextToken != NULL && TOKEN_TYPE(currentToken->nextToken) == KEYWORD_IN) {
+        forInStatement(forToken);
+        return;
+    }
     // Pre-loop statement
     standardStatement();
     // Check formatting
@@ -1022,6 +1235,7 @@ void forStatement() {
     uint16_t expressionStartChunkIndex = CURR_CHUNK_INDEX;
     // Parse condition
     expression(true);
+    uint32_t conditionEndChunkIndex = CURR_CHUNK_INDEX;
     // Check formatting
     checkType(SEMICOLON, "Expected ';' after condition");
     incCheckNull();
@@ -1037,6 +1251,11 @@ void forStatement() {
     incCheckNull();
     // Crop post-loop chunk
     Chunk* postLoopChunk = cropChunk(currentChunk, postLoopChunkIndex);
+    // Check for a counted loop, before the jump is counted in
+    uint64_t stepLine = 0;
+    uint16_t boundIndex = 0;
+    bool countedLoop = conditionEndChunkIndex == expressionStartChunkIndex + 1 &&
+                       matchCountedLoop(expressionStartChunkIndex, postLoopChunk, &stepLine, &boundIndex);
 
     // Store previous jump list pointers
     uint16_t* prevContinueJumpList = continueJumpList;
@@ -1057,12 +1276,17 @@ void forStatement() {
     // Patch continue jumps
     patchContinueJumps(CURR_CHUNK_INDEX);
 
-    // Copy post-loop chunk
-    copyChunk(currentChunk, postLoopChunk);
+    if (countedLoop && (boundIndex == UINT16_MAX || !chunkWritesLocal(currentChunk, postLoopChunkIndex, boundIndex))) {
+        // Fused step, compare and jump back to the body
+        writeLine(currentChunk, stepLine | ((uint64_t)postLoopChunkIndex << 8), postLoopChunk->lines[1], postLoopChunk->indices[1], postLoopChunk->sourceIndices[1]);
+    } else {
+        // Copy post-loop chunk
+        copyChunk(currentChunk, postLoopChunk);
+        // Add jump back instruction
+        writeJumpBack(currentChunk, OP_JUMP, expressionStartChunkIndex, currentToken->line, currentToken->index, currentToken->sourceIndex);
+    }
     // Free post-loop chunk
     freeChunk(postLoopChunk);
-    // Add jump back instruction
-    writeJumpBack(currentChunk, OP_JUMP, expressionStartChunkIndex, currentToken->line, currentToken->index, currentToken->sourceIndex);
 
     // Patch break jumps
     patchBreakJumpsAtCurrent();
@@ -1184,7 +1408,7 @@ Value defMethod(bool isVoidReturn, bool isInit) {
     Value methodObject = OBJECT_VAL(createConstCallableObject(CREATE_CHUNK_METHOD(inCount, isVoidReturn ? 0 : 1, methodChunk)), BUILTIN_CALLABLE);
 
     // Add to chunk list
-    listAddElement(chunkArray, methodObject);
+    listAddElement(currentModule->functions, methodObject);
 
     // Parse function body
     while (TOKEN_TYPE(currentToken) != RIGHT_BRACE) statement();
@@ -1222,16 +1446,14 @@ void defClass() {
     char* className = TOKEN_VALUE(currentToken);
 
     incCheckNull();
-    uint32_t pClassID;
-    bool hasParent = false;
+    uint16_t pClassID = MODULE_NO_PARENT;
     // Determine if class is a subclass
     if (TOKEN_TYPE(currentToken) == LEFT_PARENTHESES) {
         incCheckType(IDENTIFIER, "Expected parent class name");
         // Get parent class
-        pClassID = getRefIndex(globalClassRefTable,TOKEN_VALUE(currentToken));
+        pClassID = getClassRefIndex(TOKEN_VALUE(currentToken));
         incCheckType(RIGHT_PARENTHESES, "Expected ')' after parent class name");
         incCheckNull();
-        hasParent = true;
     }
     // Check for opening brace
     if (TOKEN_TYPE(currentToken) != LEFT_BRACE) compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Expected '{' after class name");
@@ -1242,22 +1464,21 @@ void defClass() {
     if (TOKEN_TYPE(currentToken) != KEYWORD_INIT) compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Expected init method");
     Value initMethod = defMethod(true, true);
 
-    // Create class
-    objClass* currClass = createClass(className, getRefIndex(globalClassRefTable,className), initMethod, hasParent ? classArray[pClassID] : NULL, CHUNK_FUNC_INIT_TYPE);
+    // Record class, it is created when the module is linked
+    moduleClass* currClass = addModuleClass(currentModule, getClassRefIndex(className), pClassID, initMethod);
 
     while (TOKEN_TYPE(currentToken) == KEYWORD_VOID || TOKEN_TYPE(currentToken) == IDENTIFIER) {
         bool isVoidReturn = TOKEN_TYPE(currentToken) == KEYWORD_VOID;
         if (TOKEN_TYPE(currentToken) == KEYWORD_VOID) incCheckType(IDENTIFIER, "Expected method name");
         char* methodName = TOKEN_VALUE(currentToken);
         Value methodObject = defMethod(isVoidReturn, false);
-        CLASS_ADD_ATTR(currClass, methodName, methodObject);
+        addModuleMethod(currClass, internSymbol(methodName), methodObject);
     }
 
     checkType(RIGHT_BRACE, "Expected '}' after class body");
 
 #ifdef DEBUG_PRINT_PRIOR_TO_OPTIMIZATION
-    printf("\nClass \"%s\" defined:\n", className);
-    printObjClass((Value) currClass);
+    printf("\nClass \"%s\" defined with %u methods\n", className, currClass->methodCount);
 #endif
 }
 
@@ -1310,10 +1531,10 @@ void defFunction(bool isVoidReturn) {
     // Create new object
     Value functionObject = OBJECT_VAL(CREATE_BUILTIN_CHUNK_FUNCTION_OBJECT(functionChunk, inCount, isVoidReturn ? 0 : 1), BUILTIN_CALLABLE);
     // Add to chunk list
-    listAddElement(chunkArray, functionObject);
+    listAddElement(currentModule->functions, functionObject);
 
     // Add function object to global reference table
-    addGlobalReference(globalRefTable, globalRefList, functionObject, funcName);
+    addGlobalReference(currentModule->globalTable, currentModule->globalList, functionObject, funcName);
 
     // Parse function body
     while (TOKEN_TYPE(currentToken) != RIGHT_BRACE) statement();
@@ -1345,12 +1566,12 @@ callable** checkPrelinkedCall() {
     preLinkedCallNode* currNode = preLinkedCallHead;
     while (currNode != NULL) {
         uint64_t command = currNode->command;
-        token* callToken = currNode->callToken;
-        Value targetFunc = listGetElement(globalRefList, getGlobalRefIndex(callToken->value));
+        Value targetFunc = INTERNAL_NULL_VAL;
+        if (refTableContains(globalRefTable, currNode->name)) targetFunc = listGetElement(globalRefList, getRefIndex(globalRefTable, currNode->name));
         // Check if function exists
-        if (IS_INTERNAL_NULL(targetFunc)) compilationError(callToken->line, callToken->index, callToken->sourceIndex, "Undefined function");
-        if (VALUE_TYPE(targetFunc) != BUILTIN_CALLABLE) compilationError(callToken->line, callToken->index, callToken->sourceIndex, "Object is not callable");
-        if (VALUE_CALLABLE_VALUE(targetFunc)->in != -1 && VALUE_CALLABLE_VALUE(targetFunc)->in != GET_BYTE(command, 1)) compilationError(callToken->line, callToken->index, callToken->sourceIndex, "Incorrect number of arguments");
+        if (IS_INTERNAL_NULL(targetFunc)) compilationError(currNode->line, currNode->index, currNode->sourceIndex, "Undefined function");
+        if (VALUE_TYPE(targetFunc) != BUILTIN_CALLABLE) compilationError(currNode->line, currNode->index, currNode->sourceIndex, "Object is not callable");
+        if (VALUE_CALLABLE_VALUE(targetFunc)->in != -1 && VALUE_CALLABLE_VALUE(targetFunc)->in != GET_BYTE(command, 1)) compilationError(currNode->line, currNode->index, currNode->sourceIndex, "Incorrect number of arguments");
         // Check if already written in function array
         uint16_t functionIndex = GET_WORD(command, 2);
         if (functionArray[functionIndex] == NULL) functionArray[functionIndex] = VALUE_CALLABLE_VALUE(targetFunc);
@@ -1447,10 +1668,130 @@ Value* compactGlobalRefTable() {
     return newGRArray;
 }
 
+static void compileModule(moduleUnit* unit) {
+    tokenizeModule(unit);
+    startTokenStream(unit->tokens);
+    currentModule = unit;
+    while (1) {
+        INC_TOKEN();
+        if (currentToken == NULL) break;
+        switch (TOKEN_TYPE(currentToken)) {
+            case KEYWORD_CLASS: {
+                defClass();
+                break;
+            }
+            case KEYWORD_FUNCTION: {
+                defFunction(false);
+                break;
+            }
+            case KEYWORD_VOID: {
+                incCheckType(KEYWORD_FUNCTION, "Expected 'function' after 'void'");
+                defFunction(true);
+                break;
+            }
+            case KEYWORD_INCLUDE: {
+                // Included sources are compiled as their own modules
+                incCheckNull();
+                if (TOKEN_TYPE(currentToken) != IDENTIFIER && TOKEN_TYPE(currentToken) != STRING) compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Expected file name after 'include'");
+                break;
+            }
+            default:
+                compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Unexpected token");
+        }
+    }
+    currentModule = NULL;
+}
+
+// Maps every module relative name of a table to its program index
+static uint16_t* linkNames(refTable* table, refTable* programTable) {
+    uint16_t* map = malloc(sizeof(uint16_t) * (table->numEntries + 1));
+    if (map == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    char** names = refTableKeys(table);
+    for (uint32_t i = 0; i < table->numEntries; i++) map[i] = getRefIndex(programTable, names[i]);
+    free(names);
+    return map;
+}
+
+static void relocateChunk(Chunk* chunk, uint16_t* globalMap, uint16_t* classMap, uint16_t* functionMap) {
+    for (uint32_t i = 0; i < chunk->count; i++) {
+        uint64_t line = chunk->code[i];
+        switch (OPCODE(line)) {
+            case OP_GET_GLOBAL_REF_ATTR:
+            case OP_SET_GLOBAL_REF_ATTR:
+                chunk->code[i] = SET_WORD(line, 1, globalMap[GET_WORD(line, 1)]);
+                break;
+            case OP_GET_COMBINED_REF_ATTR:
+            case OP_SET_COMBINED_REF_ATTR:
+                chunk->code[i] = SET_WORD(line, 3, globalMap[GET_WORD(line, 3)]);
+                break;
+            case OP_INIT:
+                // Builtin classes are not module relative
+                if (GET_WORD(line, 1) < MODULE_CLASS_BASE) break;
+                chunk->code[i] = SET_WORD(line, 1, classMap[GET_WORD(line, 1) - MODULE_CLASS_BASE]);
+                break;
+            case OP_EXEC_FUNCTION_ENFORCE_RETURN:
+            case OP_EXEC_FUNCTION_IGNORE_RETURN:
+                chunk->code[i] = SET_WORD(line, 2, functionMap[GET_WORD(line, 2)]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Adds a module's definitions to the program and rewrites its code to program indices
+static void linkModule(moduleUnit* unit) {
+    // Globals, functions defined here are filled in
+    uint16_t* globalMap = malloc(sizeof(uint16_t) * (unit->globalTable->numEntries + 1));
+    if (globalMap == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    char** names = refTableKeys(unit->globalTable);
+    for (uint32_t i = 0; i < unit->globalTable->numEntries; i++) {
+        Value value = unit->globalList->list[i];
+        globalMap[i] = getLinkedRefIndex(names[i]);
+        if (IS_INTERNAL_NULL(value)) continue;
+        if (!IS_INTERNAL_NULL(globalRefList->list[globalMap[i]])) compilationError(0, 0, 0, "global reference already exists");
+        globalRefList->list[globalMap[i]] = value;
+    }
+    free(names);
+    uint16_t* classMap = linkNames(unit->classTable, globalClassRefTable);
+    uint16_t* functionMap = linkNames(unit->functionTable, prelinkedFuncTable);
+
+    for (uint32_t i = 0; i < unit->functions->size; i++) {
+        Value function = unit->functions->list[i];
+        relocateChunk(VALUE_CALLABLE_VALUE(function)->func, globalMap, classMap, functionMap);
+        listAddElement(chunkArray, function);
+    }
+    // Calls are checked once every module is linked
+    while (unit->calls != NULL) {
+        preLinkedCallNode* node = unit->calls;
+        unit->calls = node->next;
+        node->command = SET_WORD(node->command, 2, functionMap[GET_WORD(node->command, 2)]);
+        node->next = preLinkedCallHead;
+        preLinkedCallHead = node;
+    }
+    // Classes, parents come from this module or one linked before it
+    names = refTableKeys(unit->classTable);
+    for (uint32_t i = 0; i < unit->classCount; i++) {
+        moduleClass* c = &unit->classes[i];
+        uint16_t classID = classMap[c->classID - MODULE_CLASS_BASE];
+        objClass* parent = NULL;
+        if (c->parentID != MODULE_NO_PARENT) parent = classArray[c->parentID < MODULE_CLASS_BASE ? c->parentID : classMap[c->parentID - MODULE_CLASS_BASE]];
+        objClass* currClass = createClass(names[c->classID - MODULE_CLASS_BASE], classID, c->initFunc, parent, CHUNK_FUNC_INIT_TYPE);
+        for (uint32_t j = 0; j < c->methodCount; j++) attrTableInsert(currClass->predefinedAttrs, c->methodSymbols[j], c->methods[j]);
+    }
+    free(names);
+    free(globalMap);
+    free(classMap);
+    free(functionMap);
+}
+
 // Returns the index of main function
-Value compile(refTable* GRTable, refTable* globalClassTable, runtimeList* GRList, callable*** functionArray, Value** globalArray, uint32_t* globalArraySize) {
-    // Tokenize source and build global reference table
-    globalDeclTable = tokenize();
+Value compile(char* source, char* sourcePath, refTable* GRTable, refTable* globalClassTable, runtimeList* GRList, callable*** functionArray, uint32_t* functionArraySize, Value** globalArray, uint32_t* globalArraySize) {
+    initTokenizer();
+    // Load every module and collect the names declared global anywhere
+    uint32_t moduleCount = 0;
+    moduleUnit** modules = openModules(source, sourcePath, &moduleCount);
+    globalDeclTable = declaredGlobalTable(modules, moduleCount);
 
     // Create global reference
     globalRefTable = GRTable;
@@ -1485,37 +1826,33 @@ Value compile(refTable* GRTable, refTable* globalClassTable, runtimeList* GRList
     // Initialize chunk array
     chunkArray = createRuntimeList(RUNTIME_LIST_INIT_SIZE);
 
-    while (1) {
-        INC_TOKEN();
-        if (currentToken == NULL) break;
-        switch (TOKEN_TYPE(currentToken)) {
-            case KEYWORD_CLASS: {
-                defClass();
-                break;
-            }
-            case KEYWORD_FUNCTION: {
-                defFunction(false);
-                break;
-            }
-            case KEYWORD_VOID: {
-                incCheckType(KEYWORD_FUNCTION, "Expected 'function' after 'void'");
-                defFunction(true);
-                break;
-            }
-            case KEYWORD_INCLUDE: {
-                incCheckNull(IDENTIFIER, "Expected identifier after 'include'");
-                break;
-            }
-            default:
-                compilationError(currentToken->line, currentToken->index, currentToken->sourceIndex, "Unexpected token");
+    // Only modules whose source or global declarations changed are compiled again
+    for (uint32_t i = 0; i < moduleCount; i++) {
+        bool cached = false;
+#ifdef BYTECODE_CACHE
+        cached = loadModuleCache(modules[i], globalDeclTable);
+#endif
+        if (!cached) {
+            compileModule(modules[i]);
+#ifdef BYTECODE_CACHE
+            writeModuleCache(modules[i]);
+#endif
         }
+#ifdef PRINT_MODULE_LOADS
+        printf("Module %s %s\n", modules[i]->path, cached ? "loaded from cache" : "compiled");
+#endif
+        linkModule(modules[i]);
     }
 
     bool mainFound = refTableContains(globalRefTable, "main");
     Value mainFunc = INTERNAL_NULL_VAL;
-    if (mainFound) mainFunc = globalRefList->list[getGlobalRefIndex("main")];
+    if (mainFound) mainFunc = globalRefList->list[getLinkedRefIndex("main")];
 
     *functionArray = checkPrelinkedCall();
+    *functionArraySize = prelinkedFuncTable->numEntries;
+#ifdef INLINE_FUNCTIONS
+    inlineCalls(chunkArray, *functionArray);
+#endif
 
 #ifdef DEBUG_PRINT_PRELINKED_FUNC_LIST
     printf("Prelinked function table: \n");
@@ -1530,6 +1867,24 @@ Value compile(refTable* GRTable, refTable* globalClassTable, runtimeList* GRList
 
     // Set total amount of class
     setTotalClassCount(globalClassTable->numEntries);
+    // Resolve inheritance into each class table
+    flattenClassAttrs();
+#ifdef RESOLVE_SCOPES
+    // Every global is declared by now
+    resolveScopes(chunkArray, globalRefList);
+#endif
+#ifdef ELIMINATE_REDUNDANCY
+    // Operator lookups depend on the final class tables
+    eliminateRedundancy(chunkArray, globalClassTable->numEntries);
+#endif
+
+#ifdef FUSE_BINARY_OPERANDS
+    // Every other pass expects binary operands on the stack
+    for (uint32_t i=0; i<chunkArray->size; i++) {
+        callable* function = chunkArray->list[i].obj->primValue.call;
+        fuseBinaryOperands(function->func, function->in + (function->type == method ? 1 : 0));
+    }
+#endif
 
     // Compact global reference
     GAsize = globalArraySize;
@@ -31,7 +31,8 @@ typedef enum {
 typedef enum captureType {
     CAPTURE_NONE,
     CAPTURE_PAYLOAD,
-    CAPTURE_VARIABLE
+    CAPTURE_VARIABLE,
+    CAPTURE_CONSTANT // Constant pool index in an address slot
 } captureType;
 
 void parsePrecedence(Precedence precedence, bool enforceReturn);
@@ -41,7 +42,10 @@ typedef struct preLinkedCallNode preLinkedCallNode;
 struct preLinkedCallNode {
     preLinkedCallNode* next;
     uint64_t command;
-    token* callToken;
+    char* name;
+    uint32_t line;
+    uint32_t index;
+    uint32_t sourceIndex;
 };
 
 typedef struct {
@@ -79,6 +83,6 @@ void defClass();
 Value defMethod(bool isVoidReturn, bool isInit);
 void defFunction(bool isVoidReturn);
 
-Value compile(refTable* GRTable, refTable* globalClassTable, runtimeList* GRList, callable*** functionArray, Value** globalArray, uint32_t* globalArraySize);
+Value compile(char* source, char* sourcePath, refTable* GRTable, refTable* globalClassTable, runtimeList* GRList, callable*** functionArray, uint32_t* functionArraySize, Value** globalArray, uint32_t* globalArraySize);
 
 #endif //CJ_2_COMPILER_H
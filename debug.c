@@ -34,6 +34,12 @@ void printConstOpWithPayload(char* name, Chunk* c, uint64_t line) {
             localAddrSlot += 2;
             break;
         }
+        case CAPTURE_CONSTANT: {
+            printf("const -> ");
+            DSPrintValue(c->constants->data[GET_WORD(line, localAddrSlot)]);
+            localAddrSlot += 2;
+            break;
+        }
         default:
             parsingError(0, 0, 0, "Disassembler: Unknown right constant payload opcode\n");
     }
@@ -49,9 +55,17 @@ void printConstOpWithPayload(char* name, Chunk* c, uint64_t line) {
             printf(" var -> %u", GET_WORD(line, localAddrSlot));
             break;
         }
+        case CAPTURE_CONSTANT: {
+            printf(" const -> ");
+            DSPrintValue(c->constants->data[GET_WORD(line, localAddrSlot)]);
+            break;
+        }
         default:
             parsingError(0, 0, 0, "Disassembler: Unknown left constant payload opcode\n");
     }
+    if (leftType != CAPTURE_PAYLOAD && rightType != CAPTURE_PAYLOAD && GET_WORD(line, BINARY_DEST_WORD) != 0) {
+        printf("\n    Dest: var -> %u", GET_WORD(line, BINARY_DEST_WORD) - 1);
+    }
 }
 
 void printSingleOp(char* name, Chunk* c, uint64_t line) {
@@ -129,13 +143,20 @@ void printConstOpSpecialAssign(char* name, Chunk* c, uint64_t line) {
     printSpecialAssign(GET_BYTE(line, 1));
 }
 
-void printSingleOpSpecialAssign(char* name, Chunk* c, uint64_t line) {
+void printAttrOp(char* name, Chunk* c, uint64_t line) {
     printf("%s\n", name);
-    printf("    Var1 -> ");
-    DSPrintValue(c->constants->data[GET_BYTE(line, 1)]);
-    printf(" (constant #%u)", GET_BYTE(line, 1));
+    printf("    Attr -> \"%s\" (symbol #%u)", symbolName(GET_WORD(line, 1)), GET_WORD(line, 1));
+}
+
+void printClassAttrOp(char* name, Chunk* c, uint64_t line) {
+    printAttrOp(name, c, line);
+    printf("\n    Class -> %s", classArray[GET_WORD(line, 3)]->className);
+}
+
+void printAttrOpSpecialAssign(char* name, Chunk* c, uint64_t line) {
+    printAttrOp(name, c, line);
     printf("\n    Var2 -> ");
-    printSpecialAssign(GET_BYTE(line, 2));
+    printSpecialAssign(GET_BYTE(line, 3));
 }
 
 void printSingleRefArraySpecialAssign(char* name, Chunk* c, uint64_t line) {
@@ -162,6 +183,38 @@ void printJumpOp(char* name, Chunk* c, uint64_t line) {
     printf("    Line Inc[%d]", jumpInc);
 }
 
+void printIterInitOp(char* name, Chunk* c, uint64_t line) {
+    printf("%s\n", name);
+    printf("    StateIndex -> %u", GET_WORD(line, 1));
+}
+
+void printIterNextOp(char* name, Chunk* c, uint64_t line) {
+    printJumpOp(name, c, line);
+    printf("\n    StateIndex -> %u", GET_WORD(line, 3));
+    printf("\n    LocalRefArrayIndex -> %u", GET_WORD(line, 5));
+}
+
+void printForStepOp(char* name, Chunk* c, uint64_t line) {
+    printJumpOp(name, c, line);
+    uint8_t flags = GET_BYTE(line, 7);
+    printf("\n    LocalRefArrayIndex -> %u", GET_BYTE(line, 3));
+    printf("\n    Step -> %s", (flags & ~FOR_STEP_CONST_BOUND) == ASSIGNMENT_SUB ? "-" : "+");
+    DSPrintValue(c->constants->data[GET_BYTE(line, 4)]);
+    if (flags & FOR_STEP_CONST_BOUND) {
+        printf("\n    Bound -> ");
+        DSPrintValue(c->constants->data[GET_BYTE(line, 5)]);
+    } else {
+        printf("\n    Bound -> var %u", GET_BYTE(line, 5));
+    }
+    printf("\n    Compare -> ");
+    switch (GET_BYTE(line, 6)) {
+        case OP_LESS: printf("<"); break;
+        case OP_MORE: printf(">"); break;
+        case OP_LESS_EQUAL: printf("<="); break;
+        default: printf(">="); break;
+    }
+}
+
 void printInstr(uint64_t line, Chunk* c) {
     OpCode op = (uint8_t)(line & 0xFF);
     switch(op) {
@@ -187,13 +240,13 @@ void printInstr(uint64_t line, Chunk* c) {
         case OP_GET_GLOBAL_REF_ATTR: printSingleRefArrayOp("OP_GET_GLOBAL_REF_ATTR", c, line); break;
         case OP_GET_LOCAL_REF_ATTR: printSingleRefArrayOp("OP_GET_LOCAL_REF_ATTR", c, line); break;
         case OP_GET_COMBINED_REF_ATTR: printDoubleRefArrayOp("OP_GET_COMBINED_REF_ATTR", c, line); break;
-        case OP_GET_ATTR: printSingleOp("OP_GET_ATTR", c, line); break;
-        case OP_GET_ATTR_CALL: printSingleOp("OP_GET_ATTR_CALL", c, line); break;
+        case OP_GET_ATTR: printAttrOp("OP_GET_ATTR", c, line); break;
+        case OP_GET_ATTR_CALL: printAttrOp("OP_GET_ATTR_CALL", c, line); break;
         case OP_SET_INDEX_REF: printConstOpSpecialAssign("OP_SET_INDEX_REF", c, line); break;
         case OP_SET_GLOBAL_REF_ATTR: printSingleRefArraySpecialAssign("OP_SET_GLOBAL_REF_ATTR", c, line); break;
         case OP_SET_LOCAL_REF_ATTR: printSingleRefArraySpecialAssign("OP_SET_LOCAL_REF_ATTR", c, line); break;
         case OP_SET_COMBINED_REF_ATTR: printDoubleRefArraySpecialAssign("OP_SET_COMBINED_REF_ATTR", c, line); break;
-        case OP_SET_ATTR: printSingleOpSpecialAssign("OP_SET_ATTR", c, line); break;
+        case OP_SET_ATTR: printAttrOpSpecialAssign("OP_SET_ATTR", c, line); break;
         case OP_EXEC_FUNCTION_ENFORCE_RETURN: printPrelinkedExecOp("OP_EXEC_FUNCTION_ENFORCE_RETURN", c, line); break;
         case OP_EXEC_FUNCTION_IGNORE_RETURN: printPrelinkedExecOp("OP_EXEC_FUNCTION_IGNORE_RETURN", c, line); break;
         case OP_EXEC_METHOD_ENFORCE_RETURN: printExecOp("OP_EXEC_METHOD_ENFORCE_RETURN", c, line); break;
@@ -204,6 +257,21 @@ void printInstr(uint64_t line, Chunk* c) {
         case OP_RETURN_NONE: printConstOp("OP_RETURN_NONE", c, line); break;
         case OP_JUMP: printJumpOp("OP_JUMP", c, line); break;
         case OP_JUMP_IF_FALSE: printJumpOp("OP_JUMP_IF_FALSE", c, line); break;
+        case OP_ITER_INIT: printIterInitOp("OP_ITER_INIT", c, line); break;
+        case OP_ITER_NEXT: printIterNextOp("OP_ITER_NEXT", c, line); break;
+        case OP_FOR_STEP: printForStepOp("OP_FOR_STEP", c, line); break;
+        case OP_ADD_NUM: printConstOpWithPayload("OP_ADD_NUM", c, line); break;
+        case OP_SUB_NUM: printConstOpWithPayload("OP_SUB_NUM", c, line); break;
+        case OP_MUL_NUM: printConstOpWithPayload("OP_MUL_NUM", c, line); break;
+        case OP_DIV_NUM: printConstOpWithPayload("OP_DIV_NUM", c, line); break;
+        case OP_MOD_NUM: printConstOpWithPayload("OP_MOD_NUM", c, line); break;
+        case OP_POW_NUM: printConstOpWithPayload("OP_POW_NUM", c, line); break;
+        case OP_LESS_NUM: printConstOpWithPayload("OP_LESS_NUM", c, line); break;
+        case OP_MORE_NUM: printConstOpWithPayload("OP_MORE_NUM", c, line); break;
+        case OP_LESS_EQUAL_NUM: printConstOpWithPayload("OP_LESS_EQUAL_NUM", c, line); break;
+        case OP_MORE_EQUAL_NUM: printConstOpWithPayload("OP_MORE_EQUAL_NUM", c, line); break;
+        case OP_EQUAL_NUM: printConstOpWithPayload("OP_EQUAL_NUM", c, line); break;
+        case OP_GET_CLASS_ATTR_CALL: printClassAttrOp("OP_GET_CLASS_ATTR_CALL", c, line); break;
         default:
             runtimeError("Disassembler: Unknown opcode\n");
     }
@@ -295,6 +363,7 @@ void printToken(token* t) {
         case KEYWORD_ELSE: printf("KEYWORD_ELSE"); break;
         case KEYWORD_WHILE: printf("KEYWORD_WHILE"); break;
         case KEYWORD_FOR: printf("KEYWORD_FOR"); break;
+        case KEYWORD_IN: printf("KEYWORD_IN"); break;
         case KEYWORD_BREAK: printf("KEYWORD_BREAK"); break;
         case KEYWORD_CONTINUE: printf("KEYWORD_CONTINUE"); break;
         case KEYWORD_RETURN: printf("KEYWORD_RETURN"); break;
@@ -16,10 +16,10 @@ uint32_t sourceCount = 0;
 Chunk** cArray = NULL;
 uint32_t chunkArraySize = 0;
 
-void attachSource(char* s, char* sourceName) {
+uint32_t attachSource(char* s, char* sourceName) {
     sourceArray[sourceCount] = s;
     fileNameArray[sourceCount] = addReference(sourceName);
-    sourceCount++;
+    return sourceCount++;
 }
 
 void attachChunkArray(Chunk** ca, uint32_t size) {
@@ -54,6 +54,34 @@ void printSourceLocation(uint32_t line, uint32_t index, uint32_t sourceIndex) {
     fprintf(stderr, "In \"%s\": [line: %d, index %d]\n", fileNameArray[sourceIndex], line+1, index+1);
 }
 
+static Chunk* findChunk(uint64_t* ip) {
+    for (uint32_t i=0; i<chunkArraySize; i++) {
+        if (ip >= cArray[i]->code && ip < cArray[i]->code + cArray[i]->count) return cArray[i];
+    }
+    return NULL;
+}
+
+// Frames of inlined calls that enclose the instruction before ip
+static uint32_t inlinedFrameCount(uint64_t* ip) {
+    Chunk* c = findChunk(ip - 1);
+    if (c == NULL || c->siteIndices == NULL) return 0;
+    uint32_t count = 0;
+    for (uint16_t site = c->siteIndices[ip - 1 - c->code]; site != 0; site = c->inlineSites[site - 1].parent) count++;
+    return count;
+}
+
+// Inlined calls run in their caller's frame, each call site is shown as the frame it replaced
+static uint32_t printInlinedFrames(uint64_t* ip, uint32_t frame) {
+    Chunk* c = findChunk(ip - 1);
+    if (c == NULL || c->siteIndices == NULL) return frame;
+    for (uint16_t site = c->siteIndices[ip - 1 - c->code]; site != 0; site = c->inlineSites[site - 1].parent) {
+        inlineSite* s = &c->inlineSites[site - 1];
+        fprintf(stderr, "\nCall Frame [%u]:\n", frame--);
+        printSourceLocation(s->line, s->index, s->sourceIndex);
+    }
+    return frame;
+}
+
 void printFrame(uint64_t* ip) {
     ip--;
     for (uint32_t i=0; i<chunkArraySize; i++) {
@@ -79,9 +107,11 @@ void printRuntimeTraceback() {
     fprintf(stderr, "Runtime traceback:\n");
     uint64_t*** currIpStackPtr = ipStackTop-1;
     uint32_t offset = currIpStackPtr - ipStack;
+    for (uint64_t*** ptr = ipStack; ptr <= currIpStackPtr; ptr++) offset += inlinedFrameCount(**ptr);
     while (1) {
         fprintf(stderr, "\nCall Frame [%u]:\n", offset--);
         printFrame(**currIpStackPtr);
+        offset = printInlinedFrames(**currIpStackPtr, offset);
         if (currIpStackPtr == ipStack) break;
         currIpStackPtr--;
     }
@@ -135,6 +165,12 @@ void setError(char *message) {
     exit(EXIT_FAILURE);
 }
 
+void numArrayError(char *message) {
+    fprintf(stderr, "\nnumArrayError: %s\n", message);
+    if (isRuntime) printRuntimeTraceback();
+    exit(EXIT_FAILURE);
+}
+
 void GCError(char *message) {
     fprintf(stderr, "\nGCError: %s\n", message);
     if (isRuntime) printRuntimeTraceback();
@@ -12,7 +12,11 @@ extern uint64_t** ipStack[VM_LOCAL_REF_TABLE_STACK_INIT_SIZE];
 extern uint64_t*** ipStackTop;
 extern bool isRuntime;
 
-void attachSource(char* s, char* sourceName);
+extern char* sourceArray[MAX_SOURCE_SIZE];
+extern char* fileNameArray[MAX_SOURCE_SIZE];
+extern uint32_t sourceCount;
+
+uint32_t attachSource(char* s, char* sourceName); // Returns the source index used by tokens and chunks
 void attachChunkArray(Chunk** ca, uint32_t size);
 
 void varError(char *message);
@@ -31,6 +35,8 @@ void dictError(char *message);
 
 void setError(char *message);
 
+void numArrayError(char *message);
+
 void runtimeError(char *message);
 
 void GCError(char *message);
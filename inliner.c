@@ -0,0 +1,310 @@
+#include "inliner.h"
+#include "optimizer.h"
+#include "object.h"
+#include "runtimeDS.h"
+#include "compiler.h"
+#include "errors.h"
+#include "ir.h"
+
+#include <string.h>
+
+#define GET_NIBBLE(data, shift) ((uint8_t)(((data) >> ((shift) * 4)) & 0xF))
+#define GET_BYTE(data, shift)  ((uint8_t) (((data) >> ((shift) * 8)) & 0xFF))
+#define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
+
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
+#define IS_BRANCH_OP(op) ((op) == OP_JUMP || (op) == OP_JUMP_IF_FALSE || (op) == OP_ITER_NEXT || (op) == OP_FOR_STEP)
+#define IS_CALL_OP(op) ((op) == OP_EXEC_FUNCTION_ENFORCE_RETURN || (op) == OP_EXEC_FUNCTION_IGNORE_RETURN)
+#define IS_BINARY_OP(op) (((op) >= OP_ADD && (op) <= OP_MORE_EQUAL) || (op) == OP_EQUAL || (op) == OP_POW || ((op) >= OP_ADD_NUM && (op) <= OP_EQUAL_NUM))
+#define JUMP_TARGET(line) GET_WORD(line, 1)
+#define SET_BYTE(line, shift, value) (((line) & ~(0xFFULL << ((shift) * 8))) | ((uint64_t)(uint8_t)(value) << ((shift) * 8)))
+#define SET_WORD(line, shift, value) (((line) & ~(0xFFFFULL << ((shift) * 8))) | ((uint64_t)(uint16_t)(value) << ((shift) * 8)))
+#define LOCAL_STORE_LINE(index) ((uint64_t) OP_SET_LOCAL_REF_ATTR | ((uint64_t)(index) << 8) | ((uint64_t) ASSIGNMENT_NONE << 24))
+
+static void* inlinerAlloc(size_t size) {
+    void* ptr = malloc(size);
+    if (ptr == NULL) compilationError(0, 0, 0, "Inliner allocation failed");
+    return ptr;
+}
+
+static void toAbsoluteJumps(uint64_t* code, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (IS_BRANCH_OP(OPCODE(code[i]))) code[i] = SET_WORD(code[i], 1, (uint16_t)(i + (int16_t) JUMP_TARGET(code[i])));
+    }
+}
+
+static void toRelativeJumps(uint64_t* code, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (IS_BRANCH_OP(OPCODE(code[i]))) code[i] = SET_WORD(code[i], 1, (uint16_t)(int16_t)(JUMP_TARGET(code[i]) - i));
+    }
+}
+
+// True when instruction i reads a local the callee may not have assigned yet
+static bool readsUnsetLocal(irFunction* f, uint32_t i) {
+    uint64_t line = f->chunk->code[i];
+    OpCode op = OPCODE(line);
+    irInstr* instr = &f->instrs[i];
+    switch (op) {
+        case OP_GET_LOCAL_REF_ATTR:
+        case OP_GET_COMBINED_REF_ATTR:
+            return instr->leftType == IR_TYPE_UNSET;
+        case OP_SET_LOCAL_REF_ATTR:
+            return GET_BYTE(line, 3) != ASSIGNMENT_NONE && instr->leftType == IR_TYPE_UNSET;
+        case OP_SET_COMBINED_REF_ATTR:
+            return GET_BYTE(line, 5) != ASSIGNMENT_NONE && instr->leftType == IR_TYPE_UNSET;
+        case OP_FOR_STEP:
+            return instr->leftType == IR_TYPE_UNSET || instr->rightType == IR_TYPE_UNSET;
+        default:
+            if (!IS_BINARY_OP(op)) return false;
+            return (GET_NIBBLE(line, 2) == CAPTURE_VARIABLE && instr->leftType == IR_TYPE_UNSET) ||
+                   (GET_NIBBLE(line, 3) == CAPTURE_VARIABLE && instr->rightType == IR_TYPE_UNSET);
+    }
+}
+
+// Small leaf functions whose locals are all assigned before use can share the caller's frame
+static bool canInline(callable* target, OpCode callOp) {
+    if (target == NULL || target->func == NULL) return false;
+    Chunk* body = target->func;
+    if (body->count == 0 || body->count > INLINE_MAX_INSTRUCTIONS) return false;
+    if (callOp == OP_EXEC_FUNCTION_ENFORCE_RETURN ? target->out != 1 : target->out != 0) return false;
+    for (uint32_t i = 0; i < body->count; i++) {
+        OpCode op = OPCODE(body->code[i]);
+        // Leaf functions cannot recurse
+        if (IS_CALL_OP(op) || op == OP_GET_SELF || op == OP_GET_PARENT_INIT) return false;
+        if (op == OP_RETURN_NONE && i != body->count - 1) return false;
+    }
+    // Stale values from an earlier pass through the shared slots must never be read
+    Chunk absolute = *body;
+    absolute.code = inlinerAlloc(sizeof(uint64_t) * body->count);
+    memcpy(absolute.code, body->code, sizeof(uint64_t) * body->count);
+    toAbsoluteJumps(absolute.code, absolute.count);
+    irFunction* f = buildIR(&absolute);
+    f->paramCount = target->in;
+    inferTypes(f);
+    bool safe = true;
+    for (uint32_t i = 0; i < absolute.count && safe; i++) {
+        if (IR_IS_REACHED(f, i) && readsUnsetLocal(f, i)) safe = false;
+    }
+    freeIR(f);
+    free(absolute.code);
+    return safe;
+}
+
+// Constant pool index in the caller, or -1 when the 8-bit pool is full
+static int32_t callerConstant(Chunk* caller, Value v) {
+    for (int i = 0; i < caller->constants->count; i++) if (areValuesEqual(caller->constants->data[i], v)) return i;
+    if (caller->constants->count > UINT8_MAX) return -1;
+    return addValToList(caller->constants, v);
+}
+
+// Adds every constant the callee body uses to the caller pool up front, so relocation cannot fail
+static bool reserveConstants(Chunk* caller, Chunk* body) {
+    for (uint32_t i = 0; i < body->count; i++) {
+        uint64_t line = body->code[i];
+        OpCode op = OPCODE(line);
+        if (op == OP_CONSTANT && callerConstant(caller, body->constants->data[GET_BYTE(line, 1)]) < 0) return false;
+        if (op == OP_RETURN_NONE && callerConstant(caller, NONE_VAL) < 0) return false;
+        if (op == OP_FOR_STEP) {
+            if (callerConstant(caller, body->constants->data[GET_BYTE(line, 4)]) < 0) return false;
+            if ((GET_BYTE(line, 7) & FOR_STEP_CONST_BOUND) && callerConstant(caller, body->constants->data[GET_BYTE(line, 5)]) < 0) return false;
+        }
+    }
+    return true;
+}
+
+// Moves an instruction of the callee into the caller's frame and constant pool
+static uint64_t relocate(Chunk* caller, Chunk* body, uint64_t line, uint16_t base) {
+    OpCode op = OPCODE(line);
+    switch (op) {
+        case OP_CONSTANT:
+            return SET_BYTE(line, 1, callerConstant(caller, body->constants->data[GET_BYTE(line, 1)]));
+        case OP_RETURN_NONE:
+            // The trailing return of a non-void callee pushes none and falls through
+            return SET_BYTE((uint64_t) OP_CONSTANT, 1, callerConstant(caller, NONE_VAL));
+        case OP_GET_LOCAL_REF_ATTR:
+        case OP_GET_COMBINED_REF_ATTR:
+        case OP_SET_LOCAL_REF_ATTR:
+        case OP_SET_COMBINED_REF_ATTR:
+        case OP_ITER_INIT:
+            return SET_WORD(line, 1, GET_WORD(line, 1) + base);
+        case OP_ITER_NEXT:
+            line = SET_WORD(line, 3, GET_WORD(line, 3) + base);
+            return SET_WORD(line, 5, GET_WORD(line, 5) + base);
+        case OP_FOR_STEP:
+            line = SET_BYTE(line, 3, GET_BYTE(line, 3) + base);
+            line = SET_BYTE(line, 4, callerConstant(caller, body->constants->data[GET_BYTE(line, 4)]));
+            if (GET_BYTE(line, 7) & FOR_STEP_CONST_BOUND) {
+                return SET_BYTE(line, 5, callerConstant(caller, body->constants->data[GET_BYTE(line, 5)]));
+            }
+            return SET_BYTE(line, 5, GET_BYTE(line, 5) + base);
+        default: {
+            if (!IS_BINARY_OP(op)) return line;
+            // Right capture takes the first address slot
+            uint8_t localAddrSlot = 2;
+            for (int nibble = 3; nibble >= 2; nibble--) {
+                if (GET_NIBBLE(line, nibble) != CAPTURE_VARIABLE) continue;
+                line = SET_WORD(line, localAddrSlot, GET_WORD(line, localAddrSlot) + base);
+                localAddrSlot += 2;
+            }
+            return line;
+        }
+    }
+}
+
+// Instructions a call site expands to, the trailing return of the callee falls through
+static uint32_t expandedSize(callable* target) {
+    Chunk* body = target->func;
+    return target->in + body->count - (OPCODE(body->code[body->count - 1]) == OP_RETURN ? 1 : 0);
+}
+
+typedef struct inlineBuffer {
+    uint64_t* code;
+    uint16_t* lines;
+    uint8_t* indices;
+    uint8_t* sourceIndices;
+    uint16_t* siteIndices;
+    uint32_t count;
+    inlineSite* sites;
+    uint16_t siteCount;
+} inlineBuffer;
+
+#define SITE_OF(c, i) ((c)->siteIndices == NULL ? 0 : (c)->siteIndices[i])
+
+static void emit(inlineBuffer* out, uint64_t line, uint16_t lineNum, uint8_t index, uint8_t sourceIndex, uint16_t site) {
+    out->code[out->count] = line;
+    out->lines[out->count] = lineNum;
+    out->indices[out->count] = index;
+    out->sourceIndices[out->count] = sourceIndex;
+    out->siteIndices[out->count] = site;
+    out->count++;
+}
+
+// Stores the arguments into the shared slots, then copies the callee body with returns turned into jumps past it.
+// Body instructions keep the callee's line information and point at the call site, so tracebacks keep the caller.
+static void expandCall(Chunk* caller, uint32_t callIndex, callable* target, uint16_t base, inlineBuffer* out) {
+    Chunk* body = target->func;
+    uint32_t end = out->count + expandedSize(target);
+    uint16_t callerSite = SITE_OF(caller, callIndex);
+    for (int32_t arg = target->in - 1; arg >= 0; arg--) {
+        emit(out, LOCAL_STORE_LINE(base + arg), caller->lines[callIndex], caller->indices[callIndex], caller->sourceIndices[callIndex], callerSite);
+    }
+    out->sites[out->siteCount++] = (inlineSite) {caller->lines[callIndex], caller->indices[callIndex], caller->sourceIndices[callIndex], callerSite};
+    uint16_t site = out->siteCount;
+    // Sites of calls already inlined into the callee move after this one
+    uint16_t siteOffset = out->siteCount;
+    for (uint16_t s = 0; s < body->inlineSiteCount; s++) {
+        inlineSite nested = body->inlineSites[s];
+        nested.parent = nested.parent == 0 ? site : nested.parent + siteOffset;
+        out->sites[out->siteCount++] = nested;
+    }
+    uint32_t bodyStart = out->count;
+    for (uint32_t i = 0; i < body->count; i++) {
+        uint64_t line = body->code[i];
+        OpCode op = OPCODE(line);
+        if (op == OP_RETURN) {
+            if (i == body->count - 1) continue;
+            line = SET_WORD((uint64_t) OP_JUMP, 1, end);
+        } else {
+            // Dropping the trailing return never shifts earlier instructions
+            if (IS_BRANCH_OP(op)) line = SET_WORD(line, 1, bodyStart + (uint16_t)(i + (int16_t) JUMP_TARGET(line)));
+            line = relocate(caller, body, line, base);
+        }
+        uint16_t bodySite = SITE_OF(body, i);
+        emit(out, line, body->lines[i], body->indices[i], body->sourceIndices[i], bodySite == 0 ? site : bodySite + siteOffset);
+    }
+}
+
+// Inlines every eligible call in one chunk, jumps are relative before and after
+static uint32_t inlineChunk(Chunk* caller, callable** functionArray) {
+    uint16_t base = caller->localRefArraySize;
+    uint16_t sharedSize = 0;
+    uint32_t newCount = caller->count;
+    bool* inlineAt = calloc(caller->count + 1, sizeof(bool));
+    if (inlineAt == NULL) compilationError(0, 0, 0, "Inliner allocation failed");
+    uint32_t sites = 0;
+    uint32_t siteCount = caller->inlineSiteCount;
+    for (uint32_t i = 0; i < caller->count; i++) {
+        OpCode op = OPCODE(caller->code[i]);
+        if (!IS_CALL_OP(op)) continue;
+        callable* target = functionArray[GET_WORD(caller->code[i], 2)];
+        if (target == NULL || target->func == caller || !canInline(target, op)) continue;
+        // Loop counters address locals with a single byte
+        if ((uint32_t) base + target->func->localRefArraySize > UINT8_MAX) continue;
+        if (newCount + expandedSize(target) - 1 > INT16_MAX) continue;
+        if (siteCount + 1 + target->func->inlineSiteCount >= UINT16_MAX) continue;
+        if (!reserveConstants(caller, target->func)) continue;
+        newCount += expandedSize(target) - 1;
+        siteCount += 1 + target->func->inlineSiteCount;
+        // Inlined bodies contain no calls, so every site can share one block of slots
+        if (target->func->localRefArraySize > sharedSize) sharedSize = target->func->localRefArraySize;
+        inlineAt[i] = true;
+        sites++;
+    }
+    if (sites == 0) {
+        free(inlineAt);
+        return 0;
+    }
+    inlineBuffer out;
+    out.code = inlinerAlloc(sizeof(uint64_t) * (newCount + 1));
+    out.lines = inlinerAlloc(sizeof(uint16_t) * (newCount + 1));
+    out.indices = inlinerAlloc(sizeof(uint8_t) * (newCount + 1));
+    out.sourceIndices = inlinerAlloc(sizeof(uint8_t) * (newCount + 1));
+    out.siteIndices = inlinerAlloc(sizeof(uint16_t) * (newCount + 1));
+    out.count = 0;
+    out.sites = inlinerAlloc(sizeof(inlineSite) * siteCount);
+    out.siteCount = caller->inlineSiteCount;
+    if (caller->inlineSiteCount > 0) memcpy(out.sites, caller->inlineSites, sizeof(inlineSite) * caller->inlineSiteCount);
+    // Caller jumps are remapped through the new position of their target
+    uint32_t* newIndex = inlinerAlloc(sizeof(uint32_t) * (caller->count + 1));
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < caller->count; i++) {
+        newIndex[i] = position;
+        position += inlineAt[i] ? expandedSize(functionArray[GET_WORD(caller->code[i], 2)]) : 1;
+    }
+    newIndex[caller->count] = position;
+    toAbsoluteJumps(caller->code, caller->count);
+    for (uint32_t i = 0; i < caller->count; i++) {
+        uint64_t line = caller->code[i];
+        if (inlineAt[i]) {
+            expandCall(caller, i, functionArray[GET_WORD(line, 2)], base, &out);
+            continue;
+        }
+        if (IS_BRANCH_OP(OPCODE(line))) line = SET_WORD(line, 1, newIndex[JUMP_TARGET(line)]);
+        emit(&out, line, caller->lines[i], caller->indices[i], caller->sourceIndices[i], SITE_OF(caller, i));
+    }
+    free(newIndex);
+    free(inlineAt);
+    free(caller->code);
+    free(caller->lines);
+    free(caller->indices);
+    free(caller->sourceIndices);
+    free(caller->siteIndices);
+    free(caller->inlineSites);
+    caller->code = out.code;
+    caller->lines = out.lines;
+    caller->indices = out.indices;
+    caller->sourceIndices = out.sourceIndices;
+    caller->siteIndices = out.siteIndices;
+    caller->inlineSites = out.sites;
+    caller->inlineSiteCount = out.siteCount;
+    caller->count = out.count;
+    caller->capacity = newCount + 1;
+    caller->localRefArraySize = base + sharedSize;
+#ifdef OPTIMIZE_CHUNK
+    // Argument types are now visible to the inlined bodies
+    optimizeChunk(caller);
+#endif
+    toRelativeJumps(caller->code, caller->count);
+    return sites;
+}
+
+void inlineCalls(runtimeList* chunkArray, callable** functionArray) {
+    uint32_t inlined = 0;
+    for (uint32_t i = 0; i < chunkArray->size; i++) {
+        inlined += inlineChunk(VALUE_CALLABLE_VALUE(chunkArray->list[i])->func, functionArray);
+    }
+#ifdef DEBUG_PRINT_OPTIMIZER_STATS
+    printf("Inliner: %u call sites inlined\n", inlined);
+#endif
+    (void) inlined;
+}
@@ -0,0 +1,10 @@
+#ifndef CJ_2_INLINER_H
+#define CJ_2_INLINER_H
+
+#include "primitiveVars.h"
+
+// Splices small leaf chunk functions into their prelinked call sites.
+// Runs after checkPrelinkedCall, when chunks hold relative jumps.
+void inlineCalls(runtimeList* chunkArray, callable** functionArray);
+
+#endif //CJ_2_INLINER_H
@@ -0,0 +1,390 @@
+#include "ir.h"
+#include "object.h"
+#include "compiler.h"
+#include "errors.h"
+
+#include <string.h>
+
+#define GET_NIBBLE(data, shift) ((uint8_t)(((data) >> ((shift) * 4)) & 0xF))
+#define GET_BYTE(data, shift)  ((uint8_t) (((data) >> ((shift) * 8)) & 0xFF))
+#define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
+
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
+#define IS_BRANCH_OP(op) ((op) == OP_JUMP || (op) == OP_JUMP_IF_FALSE || (op) == OP_ITER_NEXT || (op) == OP_FOR_STEP)
+#define JUMP_TARGET(line) GET_WORD(line, 1)
+#define IS_ARITH_OP(op) (((op) >= OP_ADD && (op) <= OP_MOD) || (op) == OP_POW || ((op) >= OP_ADD_NUM && (op) <= OP_POW_NUM))
+#define IS_COMPARE_OP(op) (((op) >= OP_LESS && (op) <= OP_MORE_EQUAL) || (op) == OP_EQUAL || ((op) >= OP_LESS_NUM && (op) <= OP_EQUAL_NUM))
+
+static void* irAlloc(size_t size) {
+    void* ptr = calloc(1, size);
+    if (ptr == NULL) compilationError(0, 0, 0, "IR allocation failed");
+    return ptr;
+}
+
+static uint16_t localCount(irFunction* f) {
+    return f->chunk->localRefArraySize > 0 ? f->chunk->localRefArraySize : 1;
+}
+
+static void initState(irFunction* f, irState* s) {
+    s->locals = irAlloc(sizeof(uint16_t) * localCount(f));
+    s->stack = irAlloc(sizeof(irStackEntry) * IR_MAX_STACK_DEPTH);
+    s->stackCount = 0;
+}
+
+static void freeState(irState* s) {
+    free(s->locals);
+    free(s->stack);
+}
+
+static void copyState(irFunction* f, irState* dst, const irState* src) {
+    memcpy(dst->locals, src->locals, sizeof(uint16_t) * localCount(f));
+    memcpy(dst->stack, src->stack, sizeof(irStackEntry) * src->stackCount);
+    dst->stackCount = src->stackCount;
+}
+
+static uint16_t meetTypes(uint16_t a, uint16_t b) {
+    if (a == b) return a;
+    if (a == IR_TYPE_UNSET || b == IR_TYPE_UNSET) return IR_TYPE_UNSET;
+    return IR_TYPE_ANY;
+}
+
+// Joins src into dst, stacks are aligned at the top and only their common depth stays tracked
+static bool mergeState(irFunction* f, irState* dst, const irState* src) {
+    bool changed = false;
+    for (uint16_t i = 0; i < localCount(f); i++) {
+        uint16_t met = meetTypes(dst->locals[i], src->locals[i]);
+        if (met != dst->locals[i]) {
+            dst->locals[i] = met;
+            changed = true;
+        }
+    }
+    uint32_t depth = dst->stackCount < src->stackCount ? dst->stackCount : src->stackCount;
+    if (depth != dst->stackCount) {
+        memmove(dst->stack, dst->stack + (dst->stackCount - depth), sizeof(irStackEntry) * depth);
+        dst->stackCount = depth;
+        changed = true;
+    }
+    for (uint32_t i = 0; i < depth; i++) {
+        const irStackEntry* other = &src->stack[src->stackCount - depth + i];
+        uint16_t met = meetTypes(dst->stack[i].type, other->type);
+        bool receiver = dst->stack[i].receiver && other->receiver;
+        if (met != dst->stack[i].type || receiver != dst->stack[i].receiver) {
+            dst->stack[i].type = met;
+            dst->stack[i].receiver = receiver;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static void push(irState* s, uint16_t type, bool receiver) {
+    if (s->stackCount == IR_MAX_STACK_DEPTH) {
+        // Forget the deepest entry
+        memmove(s->stack, s->stack + 1, sizeof(irStackEntry) * (IR_MAX_STACK_DEPTH - 1));
+        s->stackCount--;
+    }
+    s->stack[s->stackCount++] = (irStackEntry) {type, receiver};
+}
+
+static irStackEntry pop(irState* s) {
+    if (s->stackCount == 0) return (irStackEntry) {IR_TYPE_ANY, false};
+    return s->stack[--s->stackCount];
+}
+
+static uint16_t getLocal(irFunction* f, irState* s, uint16_t index) {
+    return index < localCount(f) ? s->locals[index] : IR_TYPE_UNSET;
+}
+
+static void setLocal(irFunction* f, irState* s, uint16_t index, uint16_t type) {
+    if (index < localCount(f)) s->locals[index] = type;
+}
+
+// Type of a local after a special assignment, numbers stay numbers
+static uint16_t modifiedType(uint16_t current, uint16_t value) {
+    if (current == IR_TYPE_UNSET) return IR_TYPE_UNSET;
+    if (current == VAL_NUMBER && value == VAL_NUMBER) return VAL_NUMBER;
+    return IR_TYPE_ANY;
+}
+
+static uint16_t binaryOperandType(irFunction* f, irState* s, captureType capture, uint64_t line, uint8_t* localAddrSlot) {
+    switch (capture) {
+        case CAPTURE_NONE: return pop(s).type;
+        case CAPTURE_PAYLOAD: return VAL_NUMBER;
+        case CAPTURE_CONSTANT: {
+            uint16_t type = VALUE_TYPE(f->chunk->constants->data[GET_WORD(line, *localAddrSlot)]);
+            *localAddrSlot += 2;
+            return type;
+        }
+        default: {
+            uint16_t type = getLocal(f, s, GET_WORD(line, *localAddrSlot));
+            *localAddrSlot += 2;
+            return type;
+        }
+    }
+}
+
+// Applies instruction i to the abstract frame and records the types it saw
+static void transfer(irFunction* f, irState* s, uint32_t i) {
+    uint64_t line = f->chunk->code[i];
+    OpCode op = OPCODE(line);
+    irInstr* instr = &f->instrs[i];
+    instr->leftType = IR_TYPE_ANY;
+    instr->rightType = IR_TYPE_ANY;
+    instr->resultType = IR_TYPE_ANY;
+    if (IS_ARITH_OP(op) || IS_COMPARE_OP(op)) {
+        // Right operand is popped first and takes the first address slot
+        uint8_t localAddrSlot = 2;
+        instr->rightType = binaryOperandType(f, s, GET_NIBBLE(line, 3), line, &localAddrSlot);
+        instr->leftType = binaryOperandType(f, s, GET_NIBBLE(line, 2), line, &localAddrSlot);
+        if (instr->leftType == VAL_NUMBER && instr->rightType == VAL_NUMBER) {
+            instr->resultType = IS_ARITH_OP(op) ? VAL_NUMBER : VAL_BOOL;
+        }
+        bool payload = GET_NIBBLE(line, 2) == CAPTURE_PAYLOAD || GET_NIBBLE(line, 3) == CAPTURE_PAYLOAD;
+        if (!payload && GET_WORD(line, BINARY_DEST_WORD) != 0) setLocal(f, s, GET_WORD(line, BINARY_DEST_WORD) - 1, instr->resultType);
+        else push(s, instr->resultType, false);
+        return;
+    }
+    switch (op) {
+        case OP_CONSTANT:
+            instr->resultType = VALUE_TYPE(f->chunk->constants->data[GET_BYTE(line, 1)]);
+            push(s, instr->resultType, false);
+            break;
+        case OP_NEGATE:
+            pop(s);
+            push(s, IR_TYPE_ANY, false);
+            break;
+        case OP_NOT:
+            pop(s);
+            instr->resultType = VAL_BOOL;
+            push(s, VAL_BOOL, false);
+            break;
+        case OP_AND:
+        case OP_OR:
+        case OP_IS:
+            pop(s);
+            pop(s);
+            instr->resultType = VAL_BOOL;
+            push(s, VAL_BOOL, false);
+            break;
+        case OP_GET_SELF:
+        case OP_GET_GLOBAL_REF_ATTR:
+            push(s, IR_TYPE_ANY, false);
+            break;
+        case OP_GET_INDEX_REF: {
+            pop(s);
+            instr->leftType = pop(s).type;
+            // NumArray elements are always numbers
+            if (instr->leftType == BUILTIN_NUM_ARRAY) instr->resultType = VAL_NUMBER;
+            push(s, instr->resultType, false);
+            break;
+        }
+        case OP_GET_LOCAL_REF_ATTR:
+        case OP_GET_COMBINED_REF_ATTR: {
+            instr->leftType = getLocal(f, s, GET_WORD(line, 1));
+            if (instr->leftType != IR_TYPE_UNSET) instr->resultType = instr->leftType;
+            push(s, instr->resultType, false);
+            break;
+        }
+        case OP_GET_ATTR:
+            instr->rightType = pop(s).type;
+            push(s, IR_TYPE_ANY, false);
+            break;
+        case OP_GET_ATTR_CALL:
+        case OP_GET_CLASS_ATTR_CALL: {
+            instr->rightType = pop(s).type;
+            push(s, IR_TYPE_ANY, false);
+            push(s, instr->rightType, true);
+            break;
+        }
+        case OP_SET_GLOBAL_REF_ATTR:
+            pop(s);
+            break;
+        case OP_SET_LOCAL_REF_ATTR:
+        case OP_SET_COMBINED_REF_ATTR: {
+            uint16_t localIndex = GET_WORD(line, 1);
+            specialAssignment sa = GET_BYTE(line, op == OP_SET_LOCAL_REF_ATTR ? 3 : 5);
+            instr->rightType = pop(s).type;
+            instr->leftType = getLocal(f, s, localIndex);
+            setLocal(f, s, localIndex, sa == ASSIGNMENT_NONE ? instr->rightType : modifiedType(instr->leftType, instr->rightType));
+            break;
+        }
+        case OP_SET_INDEX_REF:
+            instr->rightType = pop(s).type;
+            pop(s);
+            instr->leftType = pop(s).type;
+            break;
+        case OP_SET_ATTR:
+            pop(s);
+            pop(s);
+            break;
+        case OP_EXEC_FUNCTION_ENFORCE_RETURN:
+            for (uint8_t arg = 0; arg < GET_BYTE(line, 1); arg++) pop(s);
+            push(s, IR_TYPE_ANY, false);
+            break;
+        case OP_EXEC_FUNCTION_IGNORE_RETURN:
+            // Void C callables and chunk callables leave the stack differently
+            s->stackCount = 0;
+            break;
+        case OP_EXEC_METHOD_ENFORCE_RETURN:
+        case OP_EXEC_METHOD_IGNORE_RETURN: {
+            uint8_t inputCount = GET_BYTE(line, 1);
+            // The callable sits below a receiver only when the receiver is known not to be callable
+            if (s->stackCount > inputCount) {
+                irStackEntry* receiver = &s->stack[s->stackCount - inputCount - 1];
+                if (receiver->receiver && IR_IS_KNOWN_TYPE(receiver->type) && receiver->type != BUILTIN_CALLABLE) {
+                    s->stackCount -= s->stackCount >= inputCount + 2 ? inputCount + 2 : s->stackCount;
+                } else {
+                    s->stackCount = 0;
+                }
+            } else {
+                s->stackCount = 0;
+            }
+            if (op == OP_EXEC_METHOD_ENFORCE_RETURN) push(s, IR_TYPE_ANY, false);
+            break;
+        }
+        case OP_INIT: {
+            uint16_t classID = GET_WORD(line, 1);
+            push(s, classID, false);
+            push(s, IR_TYPE_ANY, false);
+            push(s, classID, true);
+            break;
+        }
+        case OP_GET_PARENT_INIT:
+            push(s, IR_TYPE_ANY, false);
+            push(s, IR_TYPE_ANY, true);
+            break;
+        case OP_JUMP_IF_FALSE:
+            instr->rightType = pop(s).type;
+            break;
+        case OP_ITER_INIT: {
+            uint16_t stateIndex = GET_WORD(line, 1);
+            setLocal(f, s, stateIndex, pop(s).type);
+            setLocal(f, s, stateIndex + 1, VAL_NUMBER);
+            setLocal(f, s, stateIndex + 2, VAL_NUMBER);
+            break;
+        }
+        case OP_ITER_NEXT: {
+            // Only the fall through edge sees these writes
+            uint16_t stateIndex = GET_WORD(line, 3);
+            setLocal(f, s, stateIndex + 1, VAL_NUMBER);
+            setLocal(f, s, GET_WORD(line, 5), getLocal(f, s, stateIndex) == BUILTIN_NUM_ARRAY ? VAL_NUMBER : IR_TYPE_ANY);
+            break;
+        }
+        case OP_FOR_STEP: {
+            uint8_t counterIndex = GET_BYTE(line, 3);
+            instr->leftType = getLocal(f, s, counterIndex);
+            instr->rightType = (GET_BYTE(line, 7) & FOR_STEP_CONST_BOUND) ? VALUE_TYPE(f->chunk->constants->data[GET_BYTE(line, 5)]) : getLocal(f, s, GET_BYTE(line, 5));
+            setLocal(f, s, counterIndex, instr->leftType == VAL_NUMBER ? VAL_NUMBER : IR_TYPE_ANY);
+            break;
+        }
+        case OP_RETURN:
+        case OP_RETURN_NONE:
+        case OP_JUMP:
+            break;
+        default:
+            // Unknown stack effect
+            s->stackCount = 0;
+    }
+}
+
+irFunction* buildIR(Chunk* c) {
+    irFunction* f = irAlloc(sizeof(irFunction));
+    f->chunk = c;
+    f->blockOf = irAlloc(sizeof(uint32_t) * (c->count + 1));
+    f->instrs = irAlloc(sizeof(irInstr) * (c->count + 1));
+    // Mark block leaders
+    bool* leader = irAlloc(sizeof(bool) * (c->count + 1));
+    leader[0] = true;
+    for (uint32_t i = 0; i < c->count; i++) {
+        OpCode op = OPCODE(c->code[i]);
+        if (IS_BRANCH_OP(op)) {
+            if (JUMP_TARGET(c->code[i]) < c->count) leader[JUMP_TARGET(c->code[i])] = true;
+            leader[i + 1] = true;
+        } else if (op == OP_RETURN || op == OP_RETURN_NONE) {
+            leader[i + 1] = true;
+        }
+    }
+    for (uint32_t i = 0; i < c->count; i++) if (leader[i]) f->blockCount++;
+    f->blocks = irAlloc(sizeof(irBlock) * (f->blockCount + 1));
+    f->reached = irAlloc(sizeof(bool) * (f->blockCount + 1));
+    uint32_t block = 0;
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (leader[i] && i > 0) f->blocks[block++].end = i;
+        if (leader[i]) f->blocks[block].start = i;
+        f->blockOf[i] = block;
+    }
+    if (f->blockCount > 0) f->blocks[block].end = c->count;
+    // Link successors
+    for (uint32_t b = 0; b < f->blockCount; b++) {
+        irBlock* current = &f->blocks[b];
+        uint64_t last = c->code[current->end - 1];
+        OpCode op = OPCODE(last);
+        if (op != OP_RETURN && op != OP_RETURN_NONE && op != OP_JUMP && current->end < c->count) {
+            current->successors[current->successorCount++] = f->blockOf[current->end];
+        }
+        if (IS_BRANCH_OP(op) && JUMP_TARGET(last) < c->count) {
+            current->successors[current->successorCount++] = f->blockOf[JUMP_TARGET(last)];
+        }
+        initState(f, &current->in);
+    }
+    free(leader);
+    return f;
+}
+
+void inferTypes(irFunction* f) {
+    if (f->blockCount == 0) return;
+    bool* reached = f->reached;
+    irState work, taken;
+    initState(f, &work);
+    initState(f, &taken);
+    // Only parameters are assigned on entry
+    for (uint16_t i = 0; i < localCount(f); i++) f->blocks[0].in.locals[i] = i < f->paramCount ? IR_TYPE_ANY : IR_TYPE_UNSET;
+    reached[0] = true;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t b = 0; b < f->blockCount; b++) {
+            if (!reached[b]) continue;
+            irBlock* current = &f->blocks[b];
+            copyState(f, &work, &current->in);
+            for (uint32_t i = current->start; i < current->end; i++) {
+                // An exhausted for-in jumps out before writing its loop variable
+                if (i == current->end - 1 && OPCODE(f->chunk->code[i]) == OP_ITER_NEXT) copyState(f, &taken, &work);
+                transfer(f, &work, i);
+            }
+            bool iterNext = OPCODE(f->chunk->code[current->end - 1]) == OP_ITER_NEXT;
+            for (uint8_t s = 0; s < current->successorCount; s++) {
+                // The jump edge of a block is always its last successor
+                const irState* out = (iterNext && s == current->successorCount - 1) ? &taken : &work;
+                irBlock* successor = &f->blocks[current->successors[s]];
+                if (!reached[current->successors[s]]) {
+                    reached[current->successors[s]] = true;
+                    copyState(f, &successor->in, out);
+                    changed = true;
+                } else if (mergeState(f, &successor->in, out)) {
+                    changed = true;
+                }
+            }
+        }
+    }
+    // Annotate instructions with the fixed point, unreached ones prove nothing
+    for (uint32_t i = 0; i < f->chunk->count; i++) {
+        f->instrs[i] = (irInstr) {IR_TYPE_UNSET, IR_TYPE_UNSET, IR_TYPE_UNSET};
+    }
+    for (uint32_t b = 0; b < f->blockCount; b++) {
+        if (!reached[b]) continue;
+        copyState(f, &work, &f->blocks[b].in);
+        for (uint32_t i = f->blocks[b].start; i < f->blocks[b].end; i++) transfer(f, &work, i);
+    }
+    freeState(&work);
+    freeState(&taken);
+}
+
+void freeIR(irFunction* f) {
+    for (uint32_t b = 0; b < f->blockCount; b++) freeState(&f->blocks[b].in);
+    free(f->blocks);
+    free(f->reached);
+    free(f->blockOf);
+    free(f->instrs);
+    free(f);
+}
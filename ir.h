@@ -0,0 +1,58 @@
+#ifndef CJ_2_IR_H
+#define CJ_2_IR_H
+
+#include "chunk.h"
+
+// Inferred types are runtime type IDs, or one of these lattice markers
+#define IR_TYPE_UNVISITED UINT16_MAX
+#define IR_TYPE_ANY (UINT16_MAX - 1) // Assigned, type unknown
+#define IR_TYPE_UNSET (UINT16_MAX - 2) // May still be internal null
+
+#define IR_IS_KNOWN_TYPE(t) ((t) < IR_TYPE_UNSET)
+
+typedef struct irStackEntry {
+    uint16_t type;
+    bool receiver; // Pushed as the receiver of a method call
+} irStackEntry;
+
+// Abstract frame, only the top stackCount entries of the real stack are tracked
+typedef struct irState {
+    uint16_t* locals;
+    irStackEntry* stack;
+    uint32_t stackCount;
+} irState;
+
+typedef struct irBlock {
+    uint32_t start;
+    uint32_t end; // One past the last instruction
+    uint32_t successors[2];
+    uint8_t successorCount;
+    irState in;
+} irBlock;
+
+// Operand and result types seen by one instruction
+typedef struct irInstr {
+    uint16_t leftType;
+    uint16_t rightType;
+    uint16_t resultType;
+} irInstr;
+
+typedef struct irFunction {
+    Chunk* chunk;
+    uint16_t paramCount; // Leading locals assigned on entry
+    irBlock* blocks;
+    uint32_t blockCount;
+    uint32_t* blockOf; // Instruction index to block index
+    bool* reached; // Per block, filled by inferTypes
+    irInstr* instrs;
+} irFunction;
+
+#define IR_IS_REACHED(f, i) ((f)->reached[(f)->blockOf[i]])
+
+// Splits a chunk with absolute jump targets into basic blocks
+irFunction* buildIR(Chunk* c);
+// Propagates local and stack types to a fixed point, then annotates every reachable instruction
+void inferTypes(irFunction* f);
+void freeIR(irFunction* f);
+
+#endif //CJ_2_IR_H
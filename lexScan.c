@@ -0,0 +1,139 @@
+#include "lexScan.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEX_SCAN_X86
+#endif
+
+lexScanners activeLexScanners;
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define IS_ALPHA(c) (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z')
+#define IS_IDENTIFIER(c) (IS_ALPHA(c) || IS_DIGIT(c) || (c) == '_')
+
+// Scalar scanners
+
+static char* skipBlankScalar(char* p) {
+    while (IS_BLANK(*p)) p++;
+    return p;
+}
+
+static char* skipLineScalar(char* p) {
+    while (*p != '\n' && *p != '\0') p++;
+    return p;
+}
+
+static char* skipIdentifierScalar(char* p) {
+    while (IS_IDENTIFIER(*p)) p++;
+    return p;
+}
+
+static char* skipDigitsScalar(char* p) {
+    while (IS_DIGIT(*p)) p++;
+    return p;
+}
+
+static char* skipStringBodyScalar(char* p) {
+    while (*p != '"' && *p != '\\' && *p != '\n' && *p != '\0') p++;
+    return p;
+}
+
+#ifdef LEX_SCAN_X86
+
+// Vector scanners build a mask of bytes still inside the run, and stop at the first clear bit.
+// '\0' is never inside a run, so a scan stops within the block holding the terminator.
+// Signed byte compares keep non-ASCII bytes out of every range.
+#define DEFINE_VECTOR_SCANNERS(SUFFIX, TARGET, VEC, WIDTH, LOAD, SET1, EQ, GT, LT, AND, OR, MOVEMASK, FULL) \
+\
+TARGET static inline VEC inRange##SUFFIX(VEC c, char low, char high) { \
+    return AND(GT(c, SET1(low - 1)), LT(c, SET1(high + 1))); \
+} \
+\
+TARGET static char* skipBlank##SUFFIX(char* p) { \
+    while (1) { \
+        VEC c = LOAD(p); \
+        uint32_t run = (uint32_t) MOVEMASK(OR(EQ(c, SET1(' ')), EQ(c, SET1('\t')))); \
+        if (run != FULL) return p + __builtin_ctz(~run); \
+        p += WIDTH; \
+    } \
+} \
+\
+TARGET static char* skipLine##SUFFIX(char* p) { \
+    while (1) { \
+        VEC c = LOAD(p); \
+        uint32_t stop = (uint32_t) MOVEMASK(OR(EQ(c, SET1('\n')), EQ(c, SET1('\0')))); \
+        if (stop != 0) return p + __builtin_ctz(stop); \
+        p += WIDTH; \
+    } \
+} \
+\
+TARGET static char* skipIdentifier##SUFFIX(char* p) { \
+    while (1) { \
+        VEC c = LOAD(p); \
+        VEC alpha = inRange##SUFFIX(OR(c, SET1(0x20)), 'a', 'z'); \
+        VEC digit = inRange##SUFFIX(c, '0', '9'); \
+        uint32_t run = (uint32_t) MOVEMASK(OR(OR(alpha, digit), EQ(c, SET1('_')))); \
+        if (run != FULL) return p + __builtin_ctz(~run); \
+        p += WIDTH; \
+    } \
+} \
+\
+TARGET static char* skipDigits##SUFFIX(char* p) { \
+    while (1) { \
+        uint32_t run = (uint32_t) MOVEMASK(inRange##SUFFIX(LOAD(p), '0', '9')); \
+        if (run != FULL) return p + __builtin_ctz(~run); \
+        p += WIDTH; \
+    } \
+} \
+\
+TARGET static char* skipStringBody##SUFFIX(char* p) { \
+    while (1) { \
+        VEC c = LOAD(p); \
+        VEC quote = OR(EQ(c, SET1('"')), EQ(c, SET1('\\'))); \
+        VEC end = OR(EQ(c, SET1('\n')), EQ(c, SET1('\0'))); \
+        uint32_t stop = (uint32_t) MOVEMASK(OR(quote, end)); \
+        if (stop != 0) return p + __builtin_ctz(stop); \
+        p += WIDTH; \
+    } \
+}
+
+#define LOAD_SSE2(p) _mm_loadu_si128((const __m128i*) (p))
+#define LOAD_AVX2(p) _mm256_loadu_si256((const __m256i*) (p))
+
+#ifdef __SSE2__
+#define SSE2_TARGET
+DEFINE_VECTOR_SCANNERS(SSE2, SSE2_TARGET, __m128i, 16, LOAD_SSE2, _mm_set1_epi8, _mm_cmpeq_epi8, _mm_cmpgt_epi8,
+                       _mm_cmplt_epi8, _mm_and_si128, _mm_or_si128, _mm_movemask_epi8, 0xFFFFu)
+#endif
+
+// AVX2 has no byte less-than, swap the operands of greater-than
+#define AVX2_CMPLT(a, b) _mm256_cmpgt_epi8(b, a)
+#define AVX2_TARGET __attribute__((target("avx2")))
+DEFINE_VECTOR_SCANNERS(AVX2, AVX2_TARGET, __m256i, 32, LOAD_AVX2, _mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_cmpgt_epi8,
+                       AVX2_CMPLT, _mm256_and_si256, _mm256_or_si256, _mm256_movemask_epi8, 0xFFFFFFFFu)
+
+#endif
+
+#define SCANNER_SET(SUFFIX) (lexScanners) { \
+    .skipBlank = skipBlank##SUFFIX, .skipLine = skipLine##SUFFIX, .skipIdentifier = skipIdentifier##SUFFIX, \
+    .skipDigits = skipDigits##SUFFIX, .skipStringBody = skipStringBody##SUFFIX }
+
+void initLexScanners() {
+    activeLexScanners = SCANNER_SET(Scalar);
+#ifdef LEX_SCAN_X86
+    // Runtime override, "scalar", "sse2" or "avx2"
+    char* override = getenv("CJ_LEX_SCAN");
+    if (override != NULL && strcmp(override, "scalar") == 0) return;
+#ifdef __SSE2__
+    activeLexScanners = SCANNER_SET(SSE2);
+    if (override != NULL && strcmp(override, "sse2") == 0) return;
+#endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) activeLexScanners = SCANNER_SET(AVX2);
+#endif
+}
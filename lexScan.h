@@ -0,0 +1,22 @@
+#ifndef CJ_2_LEXSCAN_H
+#define CJ_2_LEXSCAN_H
+
+// Character run scanners for the tokenizer, resolved to SSE2 or AVX2 versions by initLexScanners
+
+// Loaded sources carry this many zero bytes past the terminator, so vector loads never leave the buffer
+#define LEX_SCAN_PADDING 32
+
+typedef struct lexScanners {
+    // Each returns the first character outside the run, never past the terminator
+    char* (*skipBlank)(char* p); // ' ' and '\t'
+    char* (*skipLine)(char* p); // Up to '\n'
+    char* (*skipIdentifier)(char* p); // Letters, digits and '_'
+    char* (*skipDigits)(char* p);
+    char* (*skipStringBody)(char* p); // Up to '"', '\\' or '\n'
+} lexScanners;
+
+extern lexScanners activeLexScanners;
+
+void initLexScanners();
+
+#endif //CJ_2_LEXSCAN_H
@@ -13,6 +13,9 @@
 #include "refManager.h"
 #include "objectManager.h"
 #include "runtimeMemoryManager.h"
+#include "slabAllocator.h"
+#include "bytecodeCache.h"
+#include "module.h"
 
 // VM definitions
 
@@ -24,8 +27,13 @@ void initAllTables() {
 void deleteAllTables() {
     freeVM();
     freeObjectManager();
+    freeModules();
     deleteStringHash();
     freeErrorTracer();
+    freeSlabAllocator();
+#ifdef BYTECODE_CACHE
+    closeBytecodeCache();
+#endif
 }
 
 
@@ -75,13 +83,31 @@ int main(int argc, const char* argv[]) {
     // End
 
     callable** prelinkedFunctionArray = NULL;
+    uint32_t prelinkedFunctionCount = 0;
     Value* globalArray = NULL;
     uint32_t globalArraySize = 0;
+    Value mainFunc = INTERNAL_NULL_VAL;
+
+#ifdef BYTECODE_CACHE
+    // Skip compilation when the source is unchanged since the last run
+    char* cachePath = bytecodeCachePath(sourcePath);
+    beginBytecodeCache(globalRefTable, globalRefList);
+    mainFunc = loadBytecodeCache(cachePath, sourceFile, globalRefList, &prelinkedFunctionArray, &globalArray, &globalArraySize);
+    if (!IS_INTERNAL_NULL(mainFunc)) {
+        freeRefTable(globalRefTable);
+        freeRefTable(globalClassRefTable);
+    }
+#endif
 
-    // Init tokenizer
-    initTokenizer(sourceFile, sourcePath);
-
-    Value mainFunc = compile(globalRefTable, globalClassRefTable, globalRefList, &prelinkedFunctionArray, &globalArray, &globalArraySize);
+    if (IS_INTERNAL_NULL(mainFunc)) {
+        mainFunc = compile(sourceFile, sourcePath, globalRefTable, globalClassRefTable, globalRefList, &prelinkedFunctionArray, &prelinkedFunctionCount, &globalArray, &globalArraySize);
+#ifdef BYTECODE_CACHE
+        writeBytecodeCache(cachePath, sourceFile, globalRefList, mainFunc, prelinkedFunctionArray, prelinkedFunctionCount, globalArray, globalArraySize);
+#endif
+    }
+#ifdef BYTECODE_CACHE
+    free(cachePath);
+#endif
 
     Value inArgs;
     if (VALUE_CALLABLE_VALUE(mainFunc)->in != 0) {
@@ -0,0 +1,215 @@
+#include "module.h"
+#include "errors.h"
+#include "common.h"
+#ifdef BYTECODE_CACHE
+#include "bytecodeCache.h"
+#endif
+
+#include <string.h>
+#include <sys/stat.h>
+
+// Modules in link order, and by error tracer index
+static moduleUnit* modules[MAX_SOURCE_SIZE];
+static moduleUnit* sourceModules[MAX_SOURCE_SIZE];
+static uint32_t moduleCount = 0;
+// Resolved paths already seen, keys are interned
+static refTable* modulePaths = NULL;
+
+static moduleUnit* createModule(char* path, char* source, uint32_t sourceIndex) {
+    moduleUnit* unit = malloc(sizeof(moduleUnit));
+    if (unit == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    unit->path = path;
+    unit->source = source;
+    unit->sourceIndex = sourceIndex;
+    unit->sourceHash = hashString(source);
+    unit->tokens = NULL;
+    unit->includes = NULL;
+    unit->includeCount = 0;
+    unit->includeCapacity = 0;
+    unit->declaredGlobals = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    unit->declaredUses = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    unit->undeclaredUses = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    unit->globalTable = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    unit->globalList = createRuntimeList(RUNTIME_LIST_INIT_SIZE);
+    unit->classTable = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    unit->functionTable = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    unit->calls = NULL;
+    unit->functions = createRuntimeList(RUNTIME_LIST_INIT_SIZE);
+    unit->classes = NULL;
+    unit->classCount = 0;
+    unit->classCapacity = 0;
+    unit->cacheData = NULL;
+    unit->cacheSize = 0;
+    unit->cacheBodyPos = 0;
+    sourceModules[sourceIndex] = unit;
+    return unit;
+}
+
+void tokenizeModule(moduleUnit* unit) {
+    if (unit->tokens == NULL) unit->tokens = tokenize(unit->source, unit->sourceIndex);
+}
+
+void addModuleInclude(moduleUnit* unit, char* name, uint32_t line, uint32_t index) {
+    if (unit->includeCount == unit->includeCapacity) {
+        unit->includeCapacity = unit->includeCapacity == 0 ? 4 : unit->includeCapacity * 2;
+        moduleInclude* newIncludes = realloc(unit->includes, sizeof(moduleInclude) * unit->includeCapacity);
+        if (newIncludes == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+        unit->includes = newIncludes;
+    }
+    unit->includes[unit->includeCount++] = (moduleInclude) {name, line, index};
+}
+
+moduleClass* addModuleClass(moduleUnit* unit, uint16_t classID, uint16_t parentID, Value initFunc) {
+    if (unit->classCount == unit->classCapacity) {
+        unit->classCapacity = unit->classCapacity == 0 ? 4 : unit->classCapacity * 2;
+        moduleClass* newClasses = realloc(unit->classes, sizeof(moduleClass) * unit->classCapacity);
+        if (newClasses == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+        unit->classes = newClasses;
+    }
+    moduleClass* c = &unit->classes[unit->classCount++];
+    c->classID = classID;
+    c->parentID = parentID;
+    c->initFunc = initFunc;
+    c->methodSymbols = NULL;
+    c->methods = NULL;
+    c->methodCount = 0;
+    c->methodCapacity = 0;
+    return c;
+}
+
+void addModuleMethod(moduleClass* c, uint16_t symbol, Value method) {
+    if (c->methodCount == c->methodCapacity) {
+        c->methodCapacity = c->methodCapacity == 0 ? 4 : c->methodCapacity * 2;
+        uint16_t* newSymbols = realloc(c->methodSymbols, sizeof(uint16_t) * c->methodCapacity);
+        if (newSymbols == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+        c->methodSymbols = newSymbols;
+        Value* newMethods = realloc(c->methods, sizeof(Value) * c->methodCapacity);
+        if (newMethods == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+        c->methods = newMethods;
+    }
+    c->methodSymbols[c->methodCount] = symbol;
+    c->methods[c->methodCount++] = method;
+}
+
+// Include paths are relative to the including file, and the source extension may be left out
+static char* resolveIncludePath(char* includerName, char* name) {
+    char* slash = strrchr(includerName, '/');
+    size_t dirLength = (slash == NULL || name[0] == '/') ? 0 : (size_t) (slash - includerName + 1);
+    size_t nameLength = strlen(name);
+    char* path = malloc(dirLength + nameLength + sizeof(SOURCE_EXTENSION));
+    if (path == NULL) compilationError(0, 0, 0, "Memory allocation failed.");
+    memcpy(path, includerName, dirLength);
+    memcpy(path + dirLength, name, nameLength + 1);
+    struct stat pathStat;
+    if (stat(path, &pathStat) != 0 || !S_ISREG(pathStat.st_mode)) strcat(path, SOURCE_EXTENSION);
+    return path;
+}
+
+// Collects the includes and global declarations, from the module cache when the source is unchanged
+static void scanModule(moduleUnit* unit) {
+#ifdef BYTECODE_CACHE
+    if (openModuleCache(unit)) return;
+#endif
+    tokenizeModule(unit);
+    for (token* t = unit->tokens; t != NULL; t = t->nextToken) {
+        token* next = t->nextToken;
+        if (TOKEN_TYPE(t) == KEYWORD_GLOBAL) {
+            if (next == NULL || TOKEN_TYPE(next) != IDENTIFIER) parsingError(t->line, t->index, t->sourceIndex, "Invalid global statement");
+            getRefIndex(unit->declaredGlobals, TOKEN_VALUE(next));
+        } else if (TOKEN_TYPE(t) == KEYWORD_INCLUDE) {
+            // Bare names or quoted paths
+            if (next == NULL || (TOKEN_TYPE(next) != IDENTIFIER && TOKEN_TYPE(next) != STRING)) parsingError(t->line, t->index, t->sourceIndex, "Expected file name after include");
+            addModuleInclude(unit, TOKEN_VALUE(next), t->line, t->index);
+        }
+    }
+}
+
+static void openModule(moduleUnit* unit, uint32_t depth) {
+    scanModule(unit);
+    for (uint32_t i = 0; i < unit->includeCount; i++) {
+        moduleInclude* include = &unit->includes[i];
+        char* path = resolveIncludePath(unit->path, include->name);
+        if (refTableContains(modulePaths, path)) {
+            free(path);
+            continue;
+        }
+        // Table keys are not copied
+        char* key = addReference(path);
+        free(path);
+        getRefIndex(modulePaths, key);
+        char* source = loadFile(key);
+        if (source == NULL) parsingError(include->line, include->index, unit->sourceIndex, "Could not load file");
+        uint32_t hash = hashString(source);
+        bool loaded = false;
+        for (uint32_t j = 0; j < sourceCount && !loaded; j++) {
+            loaded = sourceModules[j]->sourceHash == hash && strcmp(sourceModules[j]->source, source) == 0;
+        }
+        if (loaded) {
+            free(source);
+            continue;
+        }
+        if (depth + 1 == INCLUDE_STACK_SIZE) parsingError(include->line, include->index, unit->sourceIndex, "Includes nested too deep");
+        if (sourceCount == MAX_SOURCE_SIZE) parsingError(include->line, include->index, unit->sourceIndex, "Too many source files");
+        // Attach to error handler
+        openModule(createModule(key, source, attachSource(source, key)), depth + 1);
+    }
+    // Included modules are linked before their includer
+    modules[moduleCount++] = unit;
+}
+
+moduleUnit** openModules(char* source, char* sourcePath, uint32_t* count) {
+    modulePaths = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    char* path = addReference(sourcePath);
+    getRefIndex(modulePaths, path);
+    // The main source is attached first
+    openModule(createModule(path, source, 0), 0);
+    *count = moduleCount;
+    return modules;
+}
+
+refTable* declaredGlobalTable(moduleUnit** units, uint32_t count) {
+    refTable* declTable = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
+    for (uint32_t i = 0; i < count; i++) {
+        char** names = refTableKeys(units[i]->declaredGlobals);
+        for (uint32_t j = 0; j < units[i]->declaredGlobals->numEntries; j++) getRefIndex(declTable, names[j]);
+        free(names);
+    }
+    return declTable;
+}
+
+void freeModules() {
+    if (modulePaths == NULL) return;
+    for (uint32_t i = 0; i < moduleCount; i++) {
+        moduleUnit* unit = modules[i];
+#ifdef BYTECODE_CACHE
+        closeModuleCache(unit);
+#endif
+        free(unit->includes);
+        freeRefTable(unit->declaredGlobals);
+        freeRefTable(unit->declaredUses);
+        freeRefTable(unit->undeclaredUses);
+        freeRefTable(unit->globalTable);
+        freeRuntimeList(unit->globalList);
+        freeRefTable(unit->classTable);
+        freeRefTable(unit->functionTable);
+        while (unit->calls != NULL) {
+            preLinkedCallNode* next = unit->calls->next;
+            free(unit->calls);
+            unit->calls = next;
+        }
+        freeRuntimeList(unit->functions);
+        for (uint32_t j = 0; j < unit->classCount; j++) {
+            free(unit->classes[j].methodSymbols);
+            free(unit->classes[j].methods);
+        }
+        free(unit->classes);
+        free(unit);
+    }
+    moduleCount = 0;
+    // Every path seen was interned, including the ones skipped as duplicates
+    for (uint32_t i = 0; i < modulePaths->tableSize; i++) {
+        for (refTableEntry* entry = modulePaths->entries[i]; entry != NULL; entry = entry->next) removeReference(entry->key);
+    }
+    freeRefTable(modulePaths);
+    modulePaths = NULL;
+}
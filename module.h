@@ -0,0 +1,73 @@
+#ifndef CJ_2_MODULE_H
+#define CJ_2_MODULE_H
+
+#include "object.h"
+#include "refManager.h"
+#include "tokenizer.h"
+#include "compiler.h"
+
+// Every source file is compiled on its own. Globals, user classes and prelinked functions are numbered
+// per module in first use order, and relocated by name when the module is linked into the program.
+
+// Module relative user class IDs start past the builtin classes, so the optimizer never takes them for one
+#define MODULE_CLASS_BASE 10
+#define MODULE_NO_PARENT UINT16_MAX
+
+typedef struct moduleInclude {
+    char* name; // As written, resolved against the including module
+    uint32_t line;
+    uint32_t index;
+} moduleInclude;
+
+typedef struct moduleClass {
+    uint16_t classID;
+    uint16_t parentID;
+    Value initFunc;
+    uint16_t* methodSymbols;
+    Value* methods;
+    uint32_t methodCount;
+    uint32_t methodCapacity;
+} moduleClass;
+
+typedef struct moduleUnit moduleUnit;
+
+struct moduleUnit {
+    char* path; // Interned
+    char* source;
+    uint32_t sourceIndex;
+    uint32_t sourceHash; // The same file reached under another path is loaded once
+    token* tokens; // NULL while a cached module has not needed its source
+    moduleInclude* includes;
+    uint32_t includeCount;
+    uint32_t includeCapacity;
+    // Names after 'global' in this module, and the names whose operand capture depended on them
+    refTable* declaredGlobals;
+    refTable* declaredUses;
+    refTable* undeclaredUses;
+    // What the module uses and defines
+    refTable* globalTable;
+    runtimeList* globalList; // Functions defined here, internal null for globals defined elsewhere
+    refTable* classTable; // User classes, numbered from MODULE_CLASS_BASE
+    refTable* functionTable; // Prelinked function calls
+    preLinkedCallNode* calls;
+    runtimeList* functions; // Every chunk callable, functions and methods
+    moduleClass* classes;
+    uint32_t classCount;
+    uint32_t classCapacity;
+    // Module cache file, mapped until the modules are freed
+    void* cacheData;
+    size_t cacheSize;
+    size_t cacheBodyPos;
+};
+
+// Loads the main source and everything it includes, returns the modules with includes before their includer
+moduleUnit** openModules(char* source, char* sourcePath, uint32_t* moduleCount);
+// Every name declared global by any module
+refTable* declaredGlobalTable(moduleUnit** modules, uint32_t moduleCount);
+void tokenizeModule(moduleUnit* unit);
+void addModuleInclude(moduleUnit* unit, char* name, uint32_t line, uint32_t index);
+moduleClass* addModuleClass(moduleUnit* unit, uint16_t classID, uint16_t parentID, Value initFunc);
+void addModuleMethod(moduleClass* c, uint16_t symbol, Value method);
+void freeModules();
+
+#endif //CJ_2_MODULE_H
@@ -0,0 +1,192 @@
+#include "numKernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NUM_KERNELS_X86
+#endif
+
+numKernels activeNumKernels;
+
+// Scalar kernels, also finish the tails of the vector kernels
+
+static inline double applyOp(double a, double b, numKernelOp op) {
+    switch (op) {
+        case NUM_KERNEL_ADD: return a + b;
+        case NUM_KERNEL_SUB: return a - b;
+        case NUM_KERNEL_MUL: return a * b;
+        default: return a / b;
+    }
+}
+
+static double sumScalar(const double* a, uint32_t n) {
+    double result = 0;
+    for (uint32_t i = 0; i < n; i++) result += a[i];
+    return result;
+}
+
+static double minScalar(const double* a, uint32_t n) {
+    double result = a[0];
+    for (uint32_t i = 1; i < n; i++) if (a[i] < result) result = a[i];
+    return result;
+}
+
+static double maxScalar(const double* a, uint32_t n) {
+    double result = a[0];
+    for (uint32_t i = 1; i < n; i++) if (a[i] > result) result = a[i];
+    return result;
+}
+
+static double dotScalar(const double* a, const double* b, uint32_t n) {
+    double result = 0;
+    for (uint32_t i = 0; i < n; i++) result += a[i] * b[i];
+    return result;
+}
+
+static void fillScalar(double* out, double value, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) out[i] = value;
+}
+
+static void addScaledScalar(double* out, const double* a, double scale, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) out[i] += scale * a[i];
+}
+
+static void arrayOpScalar(double* out, const double* a, const double* b, uint32_t n, numKernelOp op) {
+    for (uint32_t i = 0; i < n; i++) out[i] = applyOp(a[i], b[i], op);
+}
+
+static void scalarOpScalar(double* out, const double* a, double scalar, uint32_t n, numKernelOp op) {
+    for (uint32_t i = 0; i < n; i++) out[i] = applyOp(a[i], scalar, op);
+}
+
+#ifdef NUM_KERNELS_X86
+
+// Vector kernels share one body, instantiated per instruction set. Each main loop
+// covers two vectors per step with separate accumulators, the tail is scalar
+#define DEFINE_VECTOR_KERNELS(SUFFIX, TARGET, VEC, WIDTH, LOAD, STORE, SET1, ADD, SUB, MUL, DIV, MIN, MAX) \
+\
+TARGET static double horizontalSum##SUFFIX(VEC v) { \
+    double lanes[WIDTH]; \
+    STORE(lanes, v); \
+    double result = 0; \
+    for (int i = 0; i < WIDTH; i++) result += lanes[i]; \
+    return result; \
+} \
+\
+TARGET static double sum##SUFFIX(const double* a, uint32_t n) { \
+    VEC acc0 = SET1(0.0), acc1 = SET1(0.0); \
+    uint32_t i = 0; \
+    for (; i + 2 * WIDTH <= n; i += 2 * WIDTH) { \
+        acc0 = ADD(acc0, LOAD(a + i)); \
+        acc1 = ADD(acc1, LOAD(a + i + WIDTH)); \
+    } \
+    double result = horizontalSum##SUFFIX(ADD(acc0, acc1)); \
+    for (; i < n; i++) result += a[i]; \
+    return result; \
+} \
+\
+TARGET static double min##SUFFIX(const double* a, uint32_t n) { \
+    if (n < WIDTH) return minScalar(a, n); \
+    VEC acc = LOAD(a); \
+    uint32_t i = WIDTH; \
+    for (; i + WIDTH <= n; i += WIDTH) acc = MIN(acc, LOAD(a + i)); \
+    double lanes[WIDTH]; \
+    STORE(lanes, acc); \
+    double result = minScalar(lanes, WIDTH); \
+    for (; i < n; i++) if (a[i] < result) result = a[i]; \
+    return result; \
+} \
+\
+TARGET static double max##SUFFIX(const double* a, uint32_t n) { \
+    if (n < WIDTH) return maxScalar(a, n); \
+    VEC acc = LOAD(a); \
+    uint32_t i = WIDTH; \
+    for (; i + WIDTH <= n; i += WIDTH) acc = MAX(acc, LOAD(a + i)); \
+    double lanes[WIDTH]; \
+    STORE(lanes, acc); \
+    double result = maxScalar(lanes, WIDTH); \
+    for (; i < n; i++) if (a[i] > result) result = a[i]; \
+    return result; \
+} \
+\
+TARGET static double dot##SUFFIX(const double* a, const double* b, uint32_t n) { \
+    VEC acc0 = SET1(0.0), acc1 = SET1(0.0); \
+    uint32_t i = 0; \
+    for (; i + 2 * WIDTH <= n; i += 2 * WIDTH) { \
+        acc0 = ADD(acc0, MUL(LOAD(a + i), LOAD(b + i))); \
+        acc1 = ADD(acc1, MUL(LOAD(a + i + WIDTH), LOAD(b + i + WIDTH))); \
+    } \
+    double result = horizontalSum##SUFFIX(ADD(acc0, acc1)); \
+    for (; i < n; i++) result += a[i] * b[i]; \
+    return result; \
+} \
+\
+TARGET static void fill##SUFFIX(double* out, double value, uint32_t n) { \
+    VEC v = SET1(value); \
+    uint32_t i = 0; \
+    for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, v); \
+    for (; i < n; i++) out[i] = value; \
+} \
+\
+TARGET static void addScaled##SUFFIX(double* out, const double* a, double scale, uint32_t n) { \
+    VEC s = SET1(scale); \
+    uint32_t i = 0; \
+    for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, ADD(LOAD(out + i), MUL(s, LOAD(a + i)))); \
+    for (; i < n; i++) out[i] += scale * a[i]; \
+} \
+\
+TARGET static void arrayOp##SUFFIX(double* out, const double* a, const double* b, uint32_t n, numKernelOp op) { \
+    uint32_t i = 0; \
+    switch (op) { \
+        case NUM_KERNEL_ADD: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, ADD(LOAD(a + i), LOAD(b + i))); break; \
+        case NUM_KERNEL_SUB: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, SUB(LOAD(a + i), LOAD(b + i))); break; \
+        case NUM_KERNEL_MUL: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, MUL(LOAD(a + i), LOAD(b + i))); break; \
+        case NUM_KERNEL_DIV: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, DIV(LOAD(a + i), LOAD(b + i))); break; \
+    } \
+    for (; i < n; i++) out[i] = applyOp(a[i], b[i], op); \
+} \
+\
+TARGET static void scalarOp##SUFFIX(double* out, const double* a, double scalar, uint32_t n, numKernelOp op) { \
+    VEC s = SET1(scalar); \
+    uint32_t i = 0; \
+    switch (op) { \
+        case NUM_KERNEL_ADD: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, ADD(LOAD(a + i), s)); break; \
+        case NUM_KERNEL_SUB: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, SUB(LOAD(a + i), s)); break; \
+        case NUM_KERNEL_MUL: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, MUL(LOAD(a + i), s)); break; \
+        case NUM_KERNEL_DIV: for (; i + WIDTH <= n; i += WIDTH) STORE(out + i, DIV(LOAD(a + i), s)); break; \
+    } \
+    for (; i < n; i++) out[i] = applyOp(a[i], scalar, op); \
+}
+
+#ifdef __SSE2__
+#define SSE2_TARGET
+DEFINE_VECTOR_KERNELS(SSE2, SSE2_TARGET, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd,
+                      _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd, _mm_min_pd, _mm_max_pd)
+#endif
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+DEFINE_VECTOR_KERNELS(AVX2, AVX2_TARGET, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd,
+                      _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd, _mm256_min_pd, _mm256_max_pd)
+
+#endif
+
+#define KERNEL_SET(SUFFIX) (numKernels) { \
+    .sum = sum##SUFFIX, .min = min##SUFFIX, .max = max##SUFFIX, .dot = dot##SUFFIX, .fill = fill##SUFFIX, \
+    .addScaled = addScaled##SUFFIX, .arrayOp = arrayOp##SUFFIX, .scalarOp = scalarOp##SUFFIX }
+
+void initNumKernels() {
+    activeNumKernels = KERNEL_SET(Scalar);
+#ifdef NUM_KERNELS_X86
+    // Runtime override, "scalar", "sse2" or "avx2"
+    char* override = getenv("CJ_NUM_KERNELS");
+    if (override != NULL && strcmp(override, "scalar") == 0) return;
+#ifdef __SSE2__
+    activeNumKernels = KERNEL_SET(SSE2);
+    if (override != NULL && strcmp(override, "sse2") == 0) return;
+#endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) activeNumKernels = KERNEL_SET(AVX2);
+#endif
+}
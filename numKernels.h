@@ -0,0 +1,33 @@
+#ifndef CJ_2_NUMKERNELS_H
+#define CJ_2_NUMKERNELS_H
+
+#include <stdint.h>
+
+// Bulk double kernels for numArray, resolved to SSE2 or AVX2 versions by initNumKernels
+
+typedef enum numKernelOp {
+    NUM_KERNEL_ADD,
+    NUM_KERNEL_SUB,
+    NUM_KERNEL_MUL,
+    NUM_KERNEL_DIV,
+} numKernelOp;
+
+typedef struct numKernels {
+    double (*sum)(const double* a, uint32_t n);
+    double (*min)(const double* a, uint32_t n);
+    double (*max)(const double* a, uint32_t n);
+    double (*dot)(const double* a, const double* b, uint32_t n);
+    void (*fill)(double* out, double value, uint32_t n);
+    // out += scale * a
+    void (*addScaled)(double* out, const double* a, double scale, uint32_t n);
+    // out = a op b
+    void (*arrayOp)(double* out, const double* a, const double* b, uint32_t n, numKernelOp op);
+    // out = a op scalar
+    void (*scalarOp)(double* out, const double* a, double scalar, uint32_t n, numKernelOp op);
+} numKernels;
+
+extern numKernels activeNumKernels;
+
+void initNumKernels();
+
+#endif //CJ_2_NUMKERNELS_H
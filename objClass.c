@@ -21,7 +21,7 @@ objClass* createClass(char* name, uint32_t classID, Value initFunc, objClass* pC
     newClass->className = addReference(name);
     newClass->parentClass = pClass;
     newClass->initFunc = initFunc;
-    newClass->predefinedAttrs = createStrValHashTable(CLASS_ATTR_TABLE_INIT_SIZE);
+    newClass->predefinedAttrs = createAttrTable(CLASS_ATTR_TABLE_INIT_SIZE);
     newClass->initType = initType;
 
     return newClass;
@@ -41,9 +41,24 @@ void setTotalClassCount(uint32_t count) {
 #endif
 }
 
+void flattenClassAttrs() {
+    // Copy inherited attributes into each class, overridden ones are already present
+    for (uint32_t i = 0; i < classCount; i++) {
+        objClass* c = classArray[i];
+        for (objClass* p = c->parentClass; p != NULL; p = p->parentClass) {
+            attrTable* table = p->predefinedAttrs;
+            for (uint32_t j = 0; j < table->table_size; j++) {
+                attrEntry* entry = &table->entries[j];
+                if (!ATTR_ENTRY_USED(entry)) continue;
+                if (IS_INTERNAL_NULL(CLASS_FIND_ATTR(c, entry->symbol))) attrTableInsert(c->predefinedAttrs, entry->symbol, entry->value);
+            }
+        }
+    }
+}
+
 void deleteClass(objClass* c) {
     removeReference(c->className);
-    deleteStrValHashTable(c->predefinedAttrs);
+    deleteAttrTable(c->predefinedAttrs);
     free(c);
 }
 
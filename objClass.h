@@ -7,6 +7,8 @@
 
 #include "object.h"
 
+extern uint32_t classCount;
+
 void printObjClass(Object* c);
 
 // Class functions
@@ -15,6 +17,8 @@ objClass* createClass(char* name, uint32_t classID, Value initFunc, objClass* pC
 void deleteClass(objClass* c);
 void initClassArray();
 void setTotalClassCount(uint32_t count);
+// Class tables are immutable after compile, so inherited attributes are copied down once
+void flattenClassAttrs();
 void freeClassArray();
 
 
@@ -6,181 +6,148 @@
 #include "common.h"
 #include "errors.h"
 #include "stringHash.h"
+#include "slabAllocator.h"
 
 #include <string.h>
 #include <assert.h>
 #include <math.h>
 
-strValueHash* createStrValHashTable(uint32_t table_size) {
-    strValueHash* table = malloc(sizeof(strValueHash));
+attrTable* createAttrTable(uint32_t table_size) {
+    attrTable* table = slabAlloc(sizeof(attrTable));
     if (table == NULL) objHashError("Memory allocation failed.\n");
-    table->table_size = table_size;
+    // Probing masks the symbol, keep size a power of two
+    uint32_t size = 1;
+    while (size < table_size) size <<= 1;
+    table->table_size = size;
     table->num_entries = 0;
+    table->num_tombstones = 0;
     table->history_max_entries = 0;
-    table->entries = calloc(table->table_size, sizeof(strValueEntry*));
+    table->entries = slabCalloc(sizeof(attrEntry) * table->table_size);
     if (table->entries == NULL) objHashError("Memory allocation failed.\n");
 
     return table;
 }
 
-void deleteStrValHashTable(strValueHash* table) {
+void deleteAttrTable(attrTable* table) {
     assert(table != NULL);
+    // Symbols live as long as the string table, nothing to release per entry
+    slabFree(table->entries, sizeof(attrEntry) * table->table_size);
+    slabFree(table, sizeof(attrTable));
+}
 
-    for (uint32_t i = 0; i < table->table_size; i++) {
-        strValueEntry* entry = table->entries[i];
-        while (entry != NULL) {
-            strValueEntry* next = entry->next;
-            removeReference(entry->key);
-            free(entry);
-            entry = next;
-        }
+// Slot holding symbol, or the slot to insert it at
+static inline attrEntry* attrTableFindSlot(attrTable* table, uint16_t symbol) {
+    uint32_t mask = table->table_size - 1;
+    uint32_t pos = symbol & mask;
+    attrEntry* tombstone = NULL;
+    while (true) {
+        attrEntry* entry = &table->entries[pos];
+        if (entry->symbol == symbol) return entry;
+        if (entry->symbol == SYMBOL_NONE) return tombstone != NULL ? tombstone : entry;
+        if (entry->symbol == ATTR_TOMBSTONE && tombstone == NULL) tombstone = entry;
+        pos = (pos + 1) & mask;
     }
-
-    free(table->entries);
-    free(table);
 }
 
-void strValResizeInsert(strValueHash* table, char* key, Value value) {
+void attrTableInsert(attrTable* table, uint16_t symbol, Value value) {
     assert(table != NULL);
-    assert(key != NULL);
-
-    uint32_t pos = hashString(key) % table->table_size;
-    strValueEntry* entry = table->entries[pos];
+    assert(symbol != SYMBOL_NONE && symbol != ATTR_TOMBSTONE);
 
-    while (entry != NULL) {
-        if (strcmp(entry->key, key) == 0) {
-            // Marking remove reference, replace Value.
-            Value removedValue = entry->value;
-            entry->value = value;
+    attrEntry* entry = attrTableFindSlot(table, symbol);
 
-//            GCRemoveRef(removedValue);
-            return;
-        }
-        entry = entry->next;
+    if (entry->symbol == symbol) {
+        entry->value = value;
+        return;
     }
 
-    entry = malloc(sizeof(strValueEntry));
-    if (entry == NULL) objHashError("Memory allocation for strObjTable entry failed");
-    entry->key = addReference(key);
+    if (entry->symbol == ATTR_TOMBSTONE) table->num_tombstones--;
+    entry->symbol = symbol;
     entry->value = value;
-    entry->next = table->entries[pos];
-    table->entries[pos] = entry;
 
     table->num_entries++;
-
-    if ((float)table->num_entries / (float)table->table_size > LOAD_FACTOR_THRESHOLD) strValResize(table);
-}
-
-void strValInsert(strValueHash* table, char* key, Value value) {
-    strValResizeInsert(table, key, value);
     table->history_max_entries++;
-    if (table->history_max_entries >= UINT32_MAX-1) objHashError("StrObjTable history_max_entries overflow during insert");
+    if (table->history_max_entries >= UINT32_MAX-1) objHashError("AttrTable history_max_entries overflow during insert");
+
+    if ((float)(table->num_entries + table->num_tombstones) / (float)table->table_size > LOAD_FACTOR_THRESHOLD) attrTableResize(table);
 }
 
-Value strValFind(strValueHash* table, char* key) {
+Value attrTableFind(attrTable* table, uint16_t symbol) {
     assert(table != NULL);
-    assert(key != NULL);
 
-    uint32_t pos = hashString(key) % table->table_size;
-    strValueEntry* entry = table->entries[pos];
+    uint32_t mask = table->table_size - 1;
+    uint32_t pos = symbol & mask;
 
-    while (entry != NULL) {
-        if (strcmp(entry->key, key) == 0) {
-            return entry->value;
-        }
-        entry = entry->next;
+    while (true) {
+        attrEntry* entry = &table->entries[pos];
+        if (entry->symbol == symbol) return entry->value;
+        if (entry->symbol == SYMBOL_NONE) return INTERNAL_NULL_VAL;
+        pos = (pos + 1) & mask;
     }
-
-    return INTERNAL_NULL_VAL;
 }
 
-void strValTableDeleteEntry(strValueHash* table, char* key) {
+void attrTableDeleteEntry(attrTable* table, uint16_t symbol) {
     assert(table != NULL);
-    assert(key != NULL);
-
-    uint32_t pos = hashString(key) % table->table_size;
-    strValueEntry** p = &(table->entries[pos]);
-
-    while (*p != NULL) {
-        if (strcmp((*p)->key, key) == 0) {
-            strValueEntry* entry = *p;
-            *p = entry->next;
-            removeReference(entry->key);
-            // GC remove reference
-            Value removedValue = entry->value;
-            free(entry);
-            table->num_entries--;
-
-//            GCRemoveRef(removedValue);
-            return;
-        }
-        p = &((*p)->next);
-    }
-    objHashError("Key not found in delete");
+
+    attrEntry* entry = attrTableFindSlot(table, symbol);
+    if (entry->symbol != symbol) objHashError("Key not found in delete");
+
+    entry->symbol = ATTR_TOMBSTONE;
+    entry->value = INTERNAL_NULL_VAL;
+    table->num_entries--;
+    table->num_tombstones++;
 }
 
-void strValResize(strValueHash* table) {
+void attrTableResize(attrTable* table) {
     assert(table != NULL);
 
-    if (table->table_size >= UINT32_MAX/2) objHashError("StrObjTable exceeds max size during resize");
+    if (table->table_size >= UINT32_MAX/2) objHashError("AttrTable exceeds max size during resize");
 
     uint32_t old_table_size = table->table_size;
-    strValueEntry** old_entries = table->entries;
+    attrEntry* old_entries = table->entries;
 
-    table->table_size *= 2;
-    table->num_entries = 0;
-    table->entries = calloc(table->table_size, sizeof(strValueEntry*));
-    if (table->entries == NULL) objHashError("Memory allocation failed during StrObjTable resize");
+    // Grow only when live entries need it, otherwise just drop tombstones
+    if ((float)table->num_entries * 2 / (float)table->table_size > LOAD_FACTOR_THRESHOLD) table->table_size *= 2;
+    table->num_tombstones = 0;
+    table->entries = slabCalloc(sizeof(attrEntry) * table->table_size);
+    if (table->entries == NULL) objHashError("Memory allocation failed during AttrTable resize");
 
+    uint32_t mask = table->table_size - 1;
     for (uint32_t i = 0; i < old_table_size; i++) {
-        strValueEntry* entry = old_entries[i];
-        while (entry != NULL) {
-            strValResizeInsert(table, entry->key, entry->value);
-            strValueEntry* next = entry->next;
-            removeReference(entry->key);
-            free(entry);
-            entry = next;
-        }
+        attrEntry* entry = &old_entries[i];
+        if (!ATTR_ENTRY_USED(entry)) continue;
+        uint32_t pos = entry->symbol & mask;
+        while (table->entries[pos].symbol != SYMBOL_NONE) pos = (pos + 1) & mask;
+        table->entries[pos] = *entry;
     }
 
-    free(old_entries);
+    slabFree(old_entries, sizeof(attrEntry) * old_table_size);
 }
 
-void printStrValHash(strValueHash* table, void (*printFunc)(Value)) {
+void printAttrTable(attrTable* table, void (*printFunc)(Value)) {
     for (uint32_t i = 0; i < table->table_size; i++) {
-        strValueEntry* entry = table->entries[i];
-        while (entry != NULL) {
-            if (printFunc == NULL) {
-                printf("Key: \"%s\"", entry->key);
-            } else {
-                printf("Key: \"%s\", ", entry->key);
-                printFunc(entry->value);
-                printf("\n");
-            }
-
-            entry = entry->next;
+        attrEntry* entry = &table->entries[i];
+        if (!ATTR_ENTRY_USED(entry)) continue;
+        if (printFunc == NULL) {
+            printf("Key: \"%s\"", symbolName(entry->symbol));
+        } else {
+            printf("Key: \"%s\", ", symbolName(entry->symbol));
+            printFunc(entry->value);
+            printf("\n");
         }
     }
     printf("Number of Entries: %u, Table Size: %u, History max entries: %u\n\n", table->num_entries, table->table_size, table->history_max_entries);
 }
 
-void printStrValStructure(strValueHash* table) {
+void printAttrTableStructure(attrTable* table) {
     for (uint32_t i = 0; i < table->table_size; i++) {
-        strValueEntry* entry = table->entries[i];
-        if (entry != NULL) {
-            printf("[%u]: ", i);
+        attrEntry* entry = &table->entries[i];
+        if (entry->symbol == SYMBOL_NONE) {
+            printf("[%u]: EMPTY\n", i);
+        } else if (entry->symbol == ATTR_TOMBSTONE) {
+            printf("[%u]: DELETED\n", i);
         } else {
-            printf("[%u]: EMPTY", i);
-        }
-        while (entry != NULL) {
-            printf("\"%s\"", entry->key);
-
-            entry = entry->next;
-            if (entry != NULL) {
-                printf(" -> ");
-            }
+            printf("[%u]: \"%s\" #%u (home %u)\n", i, symbolName(entry->symbol), entry->symbol, entry->symbol & (table->table_size - 1));
         }
-        printf("\n");
     }
     printf("Number of Entries: %u, Table Size: %u\n\n", table->num_entries, table->table_size);
 }
@@ -215,39 +182,25 @@ void printObjClass(objClass* oc) {
     printf(", className: \"%s\"]\n", oc->className);
 
     // Print attributes
-    strValueHash* table = oc->predefinedAttrs;
+    attrTable* table = oc->predefinedAttrs;
     printf("Attributes:\n");
     for (uint32_t i = 0; i < table->table_size; i++) {
-        strValueEntry* entry = table->entries[i];
-        while (entry != NULL) {
-            printf("    Key: \"%s\" -> ", entry->key);
-            printValue(entry->value);
-            printf("\n");
-
-            entry = entry->next;
-        }
+        attrEntry* entry = &table->entries[i];
+        if (!ATTR_ENTRY_USED(entry)) continue;
+        printf("    Key: \"%s\" -> ", symbolName(entry->symbol));
+        printValue(entry->value);
+        printf("\n");
     }
     printf("    Number of Entries: %u, Table Size: %u\n\n", table->num_entries, table->table_size);
 }
 
-void deleteObject(Object* obj) {
+void deletePayload(Object* obj) {
     // Avoid freeing afterDefAttrs if is NULL (system defined class)
     if (!IS_SYSTEM_DEFINED_TYPE(obj->type)) {
-        strValueHash* table = obj->primValue.afterDefAttributes;
-
-        for (uint32_t i = 0; i < table->table_size; i++) {
-            strValueEntry* entry = table->entries[i];
-            while (entry != NULL) {
-                strValueEntry* next = entry->next;
-                removeReference(entry->key);
-                free(entry);
-                entry = next;
-            }
-        }
-
-        free(table->entries);
-        free(table);
+        deleteAttrTable(obj->primValue.afterDefAttributes);
     } else {
+        // Builtin object created by OP_INIT but never initialized
+        if (obj->primValue.list == NULL) return;
         switch (obj->type) {
             case BUILTIN_CALLABLE:
                 deleteCallable(obj->primValue.call);
@@ -264,52 +217,23 @@ void deleteObject(Object* obj) {
             case BUILTIN_SET:
                 freeRuntimeSet(obj->primValue.set);
                 break;
+            case BUILTIN_NUM_ARRAY:
+                freeRuntimeNumArray(obj->primValue.numArray);
+                break;
             default:
                 break;
         }
     }
+}
+
+void deleteObject(Object* obj) {
+    deletePayload(obj);
     free(obj);
 }
 
 void deleteConst(Object* obj) {
     assert(obj != NULL);
-    // Avoid freeing afterDefAttrs if is NULL (system defined class)
-    if (!IS_SYSTEM_DEFINED_TYPE(obj->type)) {
-        strValueHash* table = obj->primValue.afterDefAttributes;
-
-        for (uint32_t i = 0; i < table->table_size; i++) {
-            strValueEntry* entry = table->entries[i];
-            while (entry != NULL) {
-                strValueEntry* next = entry->next;
-                removeReference(entry->key);
-                free(entry);
-                entry = next;
-            }
-        }
-
-        free(table->entries);
-        free(table);
-    } else {
-        switch (obj->type) {
-            case BUILTIN_CALLABLE:
-                deleteCallable(obj->primValue.call);
-                break;
-            case BUILTIN_STR:
-                removeReference(obj->primValue.str);
-                break;
-            case BUILTIN_LIST:
-                freeRuntimeList(obj->primValue.list);
-                break;
-            case BUILTIN_DICT:
-                freeRuntimeDict(obj->primValue.dict);
-                break;
-            case BUILTIN_SET:
-                freeRuntimeSet(obj->primValue.set);
-                break;
-            default:
-                break;
-        }
-    }
+    deletePayload(obj);
 }
 
 void printPrimitiveValue(Value val) {
@@ -345,6 +269,9 @@ void printPrimitiveValue(Value val) {
         case BUILTIN_SET:
             printRuntimeSet(VALUE_SET_VALUE(val));
             break;
+        case BUILTIN_NUM_ARRAY:
+            printRuntimeNumArray(VALUE_NUM_ARRAY_VALUE(val));
+            break;
         default:
             varError("Invalid primitive type");
             break;
@@ -371,30 +298,24 @@ void deleteCallable(callable* c) {
     free(c);
 }
 
-Value getAttr(Value val, char* name) {
+Value getAttr(Value val, uint16_t symbol) {
     if (IS_INTERNAL_NULL(val)) objHashError("Null object called on get attr.");
     Value value = INTERNAL_NULL_VAL;
-    if (!IS_SYSTEM_DEFINED_TYPE(val.type)) value = strValFind(VALUE_ATTRS(val), name);
+    if (!IS_SYSTEM_DEFINED_TYPE(val.type)) value = attrTableFind(VALUE_ATTRS(val), symbol);
     if (!IS_INTERNAL_NULL(value)) return value;
-    objClass* p_class = VALUE_CLASS(val);
-    while (p_class != NULL && IS_INTERNAL_NULL(value)) {
-        value = CLASS_FIND_ATTR(p_class, name);
-        p_class = p_class->parentClass;
-    }
+    // Class tables hold inherited attributes after compile
+    value = CLASS_FIND_ATTR(VALUE_CLASS(val), symbol);
     if (IS_INTERNAL_NULL(value)) objHashError("Attribute not found.");
     return value;
 }
 
-Value ignoreNullGetAttr(Value val, char* name) {
+Value ignoreNullGetAttr(Value val, uint16_t symbol) {
     if (IS_INTERNAL_NULL(val)) objHashError("Null object called on get attr.");
     Value value = INTERNAL_NULL_VAL;
-    if (!IS_SYSTEM_DEFINED_TYPE(val.type)) value = strValFind(VALUE_ATTRS(val), name);
+    if (!IS_SYSTEM_DEFINED_TYPE(val.type)) value = attrTableFind(VALUE_ATTRS(val), symbol);
     if (!IS_INTERNAL_NULL(value)) return value;
-    objClass* p_class = VALUE_CLASS(val);
-    while (p_class != NULL && IS_INTERNAL_NULL(value)) {
-        value = CLASS_FIND_ATTR(p_class, name);
-        p_class = p_class->parentClass;
-    }
+    // Class tables hold inherited attributes after compile
+    value = CLASS_FIND_ATTR(VALUE_CLASS(val), symbol);
     return value;
 }
 
@@ -7,12 +7,13 @@
 
 #include "primitiveVars.h"
 #include "chunk.h"
+#include "stringHash.h"
 
 #include <stdint.h>
 
 #define LOAD_FACTOR_THRESHOLD 0.75
-#define CLASS_ADD_ATTR(c, attrName, attrValue) strValInsert((c)->predefinedAttrs, attrName, attrValue)
-#define CLASS_FIND_ATTR(c, attrName) strValFind((c)->predefinedAttrs, attrName)
+#define CLASS_ADD_ATTR(c, attrName, attrValue) attrTableInsert((c)->predefinedAttrs, internSymbol(attrName), attrValue)
+#define CLASS_FIND_ATTR(c, symbol) attrTableFind((c)->predefinedAttrs, symbol)
 #define VALUE_TYPE(val) val.type
 
 #define NONE_VAL (Value) { .obj = NULL, .type = VAL_NONE }
@@ -31,17 +32,19 @@
 #define VALUE_LIST_VALUE(val) val.obj->primValue.list
 #define VALUE_DICT_VALUE(val) val.obj->primValue.dict
 #define VALUE_SET_VALUE(val) val.obj->primValue.set
+#define VALUE_NUM_ARRAY_VALUE(val) val.obj->primValue.numArray
 #define VALUE_ATTRS(val) val.obj->primValue.afterDefAttributes
 #define VALUE_CLASS(val) classArray[VALUE_TYPE(val)]
 #define VALUE_OBJ_VAL(val) val.obj
 
-#define IS_SYSTEM_DEFINED_CLASS(c) ((c)->classID < 9)
-#define IS_SYSTEM_DEFINED_TYPE(t) ((t) < 9)
-#define IS_ITERABLE_VAL(val) ((val).type > 5)
+#define IS_SYSTEM_DEFINED_CLASS(c) ((c)->classID < 10)
+#define IS_SYSTEM_DEFINED_TYPE(t) ((t) < 10)
+// Num arrays hold no references
+#define IS_ITERABLE_VAL(val) ((val).type > 5 && (val).type != BUILTIN_NUM_ARRAY)
 #define IS_MARKABLE_VAL(val) ((val).type > 3)
 
 
-typedef struct strValueHash strValueHash;
+typedef struct attrTable attrTable;
 typedef struct objClass objClass;
 
 typedef enum {
@@ -57,7 +60,8 @@ typedef enum {
     // Iterable types
     BUILTIN_LIST = 6,
     BUILTIN_DICT = 7,
-    BUILTIN_SET = 8
+    BUILTIN_SET = 8,
+    BUILTIN_NUM_ARRAY = 9
 } ValueType;
 
 typedef enum {
@@ -77,12 +81,11 @@ struct Object {
         runtimeList* list;
         runtimeDict* dict;
         runtimeSet* set;
-        strValueHash *afterDefAttributes;
+        runtimeNumArray* numArray;
+        attrTable *afterDefAttributes;
     } primValue;
-    Object* next;
     uint16_t type;
-    uint16_t blockID;
-    bool marked;
+    uint32_t blockID;
     bool isConst;
 };
 
@@ -100,7 +103,7 @@ struct objClass {
     char* className;
     objClass* parentClass;
     Value initFunc;
-    strValueHash *predefinedAttrs;
+    attrTable *predefinedAttrs;
     initFuncType initType;
 };
 
@@ -113,33 +116,37 @@ extern objClass* stringClass;
 extern objClass* listClass;
 extern objClass* dictClass;
 extern objClass* setClass;
+extern objClass* numArrayClass;
 
-// strValueHash definition
+// attrTable definition
 
-typedef struct strValueEntry {
-    char* key;
+// Open addressing keyed by symbol ID, empty slots hold SYMBOL_NONE and deleted slots ATTR_TOMBSTONE
+#define ATTR_TOMBSTONE UINT16_MAX
+#define ATTR_ENTRY_USED(entry) ((entry)->symbol != SYMBOL_NONE && (entry)->symbol != ATTR_TOMBSTONE)
+
+typedef struct attrEntry {
+    uint16_t symbol;
     Value value;
-    struct strValueEntry* next;
-} strValueEntry;
+} attrEntry;
 
-struct strValueHash {
+struct attrTable {
     uint32_t table_size;
     uint32_t num_entries;
+    uint32_t num_tombstones;
     uint32_t history_max_entries;
-    strValueEntry** entries;
+    attrEntry* entries;
 };
 
-// strValueHash functions
+// attrTable functions, keys are symbols from internSymbol
 
-strValueHash* createStrValHashTable(uint32_t table_size);
-void deleteStrValHashTable(strValueHash* table);
-void strValInsert(strValueHash* table, char* key, Value value);
-void strValResizeInsert(strValueHash* table, char* key, Value value);
-Value strValFind(strValueHash* table, char* key);
-void strValTableDeleteEntry(strValueHash* table, char* key);
-void strValResize(strValueHash* table);
-void printStrValHash(strValueHash* table, void (*printFunc)(Value));
-void printStrValStructure(strValueHash* table);
+attrTable* createAttrTable(uint32_t table_size);
+void deleteAttrTable(attrTable* table);
+void attrTableInsert(attrTable* table, uint16_t symbol, Value value);
+Value attrTableFind(attrTable* table, uint16_t symbol);
+void attrTableDeleteEntry(attrTable* table, uint16_t symbol);
+void attrTableResize(attrTable* table);
+void printAttrTable(attrTable* table, void (*printFunc)(Value));
+void printAttrTableStructure(attrTable* table);
 
 // Callable functions
 callable* createCallable(int in, uint8_t out, void* cFunc, Chunk* func, callableType type);
@@ -148,8 +155,9 @@ void deleteCallable(callable* c);
 // Object functions
 void deleteObject(Object* obj); // Not to be used by user's runtime operations
 void deleteConst(Object* obj);
-Value getAttr(Value val, char* name);
-Value ignoreNullGetAttr(Value val, char* name);
+void deletePayload(Object* obj);
+Value getAttr(Value val, uint16_t symbol);
+Value ignoreNullGetAttr(Value val, uint16_t symbol);
 
 void printPrimitiveValue(Value val);
 void printValue(Value val);
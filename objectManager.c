@@ -26,9 +26,8 @@ Object* createConstObj(objClass* c) {
     if (IS_SYSTEM_DEFINED_CLASS(c)) {
         newObj->primValue.afterDefAttributes = NULL;
     } else {
-        newObj->primValue.afterDefAttributes = createStrValHashTable(OBJECT_ATTR_TABLE_INIT_SIZE);
+        newObj->primValue.afterDefAttributes = createAttrTable(OBJECT_ATTR_TABLE_INIT_SIZE);
     }
-    newObj->marked = false;
     newObj->isConst = true;
     return newObj;
 }
@@ -77,9 +76,8 @@ Object* createRuntimeObj(objClass* c) {
     if (IS_SYSTEM_DEFINED_CLASS(c)) {
         newObj->primValue.afterDefAttributes = NULL;
     } else {
-        newObj->primValue.afterDefAttributes = createStrValHashTable(OBJECT_ATTR_TABLE_INIT_SIZE);
+        newObj->primValue.afterDefAttributes = createAttrTable(OBJECT_ATTR_TABLE_INIT_SIZE);
     }
-    newObj->marked = false;
     newObj->isConst = false;
     return newObj;
 }
@@ -107,3 +105,9 @@ Object* createRuntimeSetObject() {
     newObj->primValue.set = createRuntimeSet(RUNTIME_SET_INIT_SIZE);
     return newObj;
 }
+
+Object* createRuntimeNumArrayObject(uint32_t size) {
+    Object* newObj = createRuntimeObj(numArrayClass);
+    newObj->primValue.numArray = createRuntimeNumArray(size);
+    return newObj;
+}
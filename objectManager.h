@@ -20,6 +20,7 @@ Object* createRuntimeStringObject(char* value);
 Object* createRuntimeListObject();
 Object* createRuntimeDictObject();
 Object* createRuntimeSetObject();
+Object* createRuntimeNumArrayObject(uint32_t size);
 
 
 #endif //CJ_2_OBJECTMANAGER_H
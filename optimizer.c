@@ -0,0 +1,449 @@
+#include "optimizer.h"
+#include "compiler.h"
+#include "errors.h"
+#include "ir.h"
+
+#include <math.h>
+#include <string.h>
+
+#define GET_NIBBLE(data, shift) ((uint8_t)(((data) >> ((shift) * 4)) & 0xF))
+#define GET_BYTE(data, shift)  ((uint8_t) (((data) >> ((shift) * 8)) & 0xFF))
+#define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
+#define GET_DWORD(data, shift) ((uint32_t)(((data) >> ((shift) * 8)) & 0xFFFFFFFF))
+
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
+#define SET_OPCODE(line, op) (((line) & ~0xFFULL) | (uint64_t)(op))
+#define IS_BRANCH_OP(op) ((op) == OP_JUMP || (op) == OP_JUMP_IF_FALSE || (op) == OP_ITER_NEXT || (op) == OP_FOR_STEP)
+#define JUMP_TARGET(line) GET_WORD(line, 1)
+#define SET_JUMP_TARGET(line, target) (((line) & ~(0xFFFFULL << 8)) | ((uint64_t)(target) << 8))
+#define CONSTANT_LINE(constIndex) ((uint64_t) OP_CONSTANT | ((uint64_t)(constIndex) << 8))
+#define IS_FOLDABLE_BINARY(op) (((op) >= OP_ADD && (op) <= OP_MORE_EQUAL) || (op) == OP_EQUAL || (op) == OP_POW)
+#define IS_BINARY_OP(op) (IS_FOLDABLE_BINARY(op) || ((op) >= OP_ADD_NUM && (op) <= OP_EQUAL_NUM))
+#define USES_ADDR_SLOT(capture) ((capture) == CAPTURE_VARIABLE || (capture) == CAPTURE_CONSTANT)
+#define SET_WORD(line, shift, value) (((line) & ~(0xFFFFULL << ((shift) * 8))) | ((uint64_t)(uint16_t)(value) << ((shift) * 8)))
+// Payload operands are signed 32-bit integers, read the same way as the VM
+#define PAYLOAD_VALUE(line) ((double)(int32_t) GET_DWORD(line, 4))
+
+static bool* findJumpTargets(Chunk* c) {
+    bool* isTarget = calloc(c->count + 1, sizeof(bool));
+    if (isTarget == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (IS_BRANCH_OP(OPCODE(c->code[i]))) isTarget[JUMP_TARGET(c->code[i])] = true;
+    }
+    return isTarget;
+}
+
+static bool anyTargetIn(const bool* isTarget, uint32_t after, uint32_t upTo) {
+    for (uint32_t i = after + 1; i <= upTo; i++) if (isTarget[i]) return true;
+    return false;
+}
+
+// Drops removed instructions and their debug entries, then remaps jump targets
+static void compactChunk(Chunk* c, const bool* removed) {
+    uint32_t* newIndex = malloc(sizeof(uint32_t) * (c->count + 1));
+    if (newIndex == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < c->count; i++) {
+        // Removed instructions fall through to the next kept one
+        newIndex[i] = kept;
+        if (removed[i]) continue;
+        c->code[kept] = c->code[i];
+        c->lines[kept] = c->lines[i];
+        c->indices[kept] = c->indices[i];
+        c->sourceIndices[kept] = c->sourceIndices[i];
+        if (c->siteIndices != NULL) c->siteIndices[kept] = c->siteIndices[i];
+        kept++;
+    }
+    newIndex[c->count] = kept;
+    c->count = kept;
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (IS_BRANCH_OP(OPCODE(c->code[i]))) c->code[i] = SET_JUMP_TARGET(c->code[i], newIndex[JUMP_TARGET(c->code[i])]);
+    }
+    free(newIndex);
+}
+
+// Points jumps that land on an unconditional jump at its final destination
+static bool threadJumps(Chunk* c) {
+    bool changed = false;
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (!IS_BRANCH_OP(OPCODE(c->code[i]))) continue;
+        uint16_t target = JUMP_TARGET(c->code[i]);
+        // Bounded so jump cycles terminate
+        for (uint32_t hops = 0; hops < c->count && target < c->count && OPCODE(c->code[target]) == OP_JUMP; hops++) {
+            uint16_t next = JUMP_TARGET(c->code[target]);
+            if (next == target) break;
+            target = next;
+        }
+        if (target != JUMP_TARGET(c->code[i])) {
+            c->code[i] = SET_JUMP_TARGET(c->code[i], target);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool constantNumber(Chunk* c, uint64_t line, double* result) {
+    if (OPCODE(line) != OP_CONSTANT) return false;
+    Value v = c->constants->data[GET_BYTE(line, 1)];
+    if (VALUE_TYPE(v) != VAL_NUMBER) return false;
+    *result = VALUE_NUMBER_VALUE(v);
+    return true;
+}
+
+static bool constantBool(Chunk* c, uint64_t line, bool* result) {
+    if (OPCODE(line) != OP_CONSTANT) return false;
+    Value v = c->constants->data[GET_BYTE(line, 1)];
+    if (VALUE_TYPE(v) != VAL_BOOL) return false;
+    *result = VALUE_BOOL_VALUE(v);
+    return true;
+}
+
+// Constant pool index of v, or -1 when the 8-bit pool is full
+static int32_t addFoldedConstant(Chunk* c, Value v) {
+    for (int i = 0; i < c->constants->count; i++) if (areValuesEqual(c->constants->data[i], v)) return i;
+    if (c->constants->count > UINT8_MAX) return -1;
+    return addValToList(c->constants, v);
+}
+
+static Value foldBinary(OpCode op, double left, double right) {
+    switch (op) {
+        case OP_ADD: return NUMBER_VAL(left + right);
+        case OP_SUB: return NUMBER_VAL(left - right);
+        case OP_MUL: return NUMBER_VAL(left * right);
+        case OP_DIV: return NUMBER_VAL(left / right);
+        case OP_MOD: return NUMBER_VAL(fmod(left, right));
+        case OP_POW: return NUMBER_VAL(pow(left, right));
+        case OP_LESS: return BOOL_VAL(left < right);
+        case OP_MORE: return BOOL_VAL(left > right);
+        case OP_LESS_EQUAL: return BOOL_VAL(left <= right);
+        case OP_MORE_EQUAL: return BOOL_VAL(left >= right);
+        default: return BOOL_VAL(left == right);
+    }
+}
+
+// Folds operators whose operands are all constants, and branches on constant conditions.
+// kept holds the instructions that survive so far, folds consume its top entries.
+static bool foldConstants(Chunk* c, bool* removed) {
+    bool changed = false;
+    bool* isTarget = findJumpTargets(c);
+    uint32_t* kept = malloc(sizeof(uint32_t) * (c->count + 1));
+    if (kept == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < c->count; i++) {
+        uint64_t line = c->code[i];
+        OpCode op = OPCODE(line);
+        kept[top++] = i;
+        if (IS_FOLDABLE_BINARY(op)) {
+            captureType leftType = GET_NIBBLE(line, 2);
+            captureType rightType = GET_NIBBLE(line, 3);
+            if (leftType == CAPTURE_VARIABLE || rightType == CAPTURE_VARIABLE) continue;
+            uint32_t stackOperands = (leftType == CAPTURE_NONE) + (rightType == CAPTURE_NONE);
+            if (top - 1 < stackOperands) continue;
+            uint32_t first = kept[top - 1 - stackOperands];
+            if (stackOperands > 0 && anyTargetIn(isTarget, first, i)) continue;
+            // Right operand is popped first
+            double left, right;
+            uint32_t operand = top - 2;
+            if (rightType == CAPTURE_PAYLOAD) right = PAYLOAD_VALUE(line);
+            else if (!constantNumber(c, c->code[kept[operand--]], &right)) continue;
+            if (leftType == CAPTURE_PAYLOAD) left = PAYLOAD_VALUE(line);
+            else if (!constantNumber(c, c->code[kept[operand]], &left)) continue;
+            int32_t constIndex = addFoldedConstant(c, foldBinary(op, left, right));
+            if (constIndex < 0) continue;
+            // Result takes the slot of the first operand, or the operator itself
+            top -= stackOperands + 1;
+            uint32_t slot = stackOperands > 0 ? first : i;
+            for (uint32_t j = top; j < top + stackOperands + 1; j++) if (kept[j] != slot) removed[kept[j]] = true;
+            c->code[slot] = CONSTANT_LINE(constIndex);
+            kept[top++] = slot;
+            changed = true;
+        } else if (op == OP_NOT || op == OP_AND || op == OP_OR) {
+            uint32_t stackOperands = op == OP_NOT ? 1 : 2;
+            if (top - 1 < stackOperands) continue;
+            uint32_t first = kept[top - 1 - stackOperands];
+            if (anyTargetIn(isTarget, first, i)) continue;
+            bool right, left = false;
+            if (!constantBool(c, c->code[kept[top - 2]], &right)) continue;
+            if (op != OP_NOT && !constantBool(c, c->code[kept[top - 3]], &left)) continue;
+            bool result = op == OP_NOT ? !right : (op == OP_AND ? left && right : left || right);
+            int32_t constIndex = addFoldedConstant(c, BOOL_VAL(result));
+            if (constIndex < 0) continue;
+            top -= stackOperands + 1;
+            for (uint32_t j = top + 1; j < top + stackOperands + 1; j++) removed[kept[j]] = true;
+            c->code[first] = CONSTANT_LINE(constIndex);
+            kept[top++] = first;
+            changed = true;
+        } else if (op == OP_JUMP_IF_FALSE) {
+            if (top < 2) continue;
+            uint32_t condition = kept[top - 2];
+            bool value;
+            if (anyTargetIn(isTarget, condition, i) || !constantBool(c, c->code[condition], &value)) continue;
+            top -= 2;
+            removed[i] = true;
+            if (value) {
+                // Never taken
+                removed[condition] = true;
+            } else {
+                // Always taken
+                c->code[condition] = SET_JUMP_TARGET((uint64_t) OP_JUMP, JUMP_TARGET(line));
+                kept[top++] = condition;
+            }
+            changed = true;
+        }
+    }
+    free(kept);
+    free(isTarget);
+    return changed;
+}
+
+// Removes instructions no path from the entry reaches, and jumps to the next live instruction
+static bool removeDeadCode(Chunk* c, bool* removed) {
+    bool changed = false;
+    bool* reached = calloc(c->count + 1, sizeof(bool));
+    uint32_t* worklist = malloc(sizeof(uint32_t) * (c->count + 1));
+    if (reached == NULL || worklist == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    uint32_t pending = 0;
+    worklist[pending++] = 0;
+    reached[0] = true;
+    while (pending > 0) {
+        uint32_t i = worklist[--pending];
+        if (i >= c->count) continue;
+        OpCode op = OPCODE(c->code[i]);
+        uint32_t successors[2];
+        uint32_t successorCount = 0;
+        if (op != OP_RETURN && op != OP_RETURN_NONE && op != OP_JUMP) successors[successorCount++] = i + 1;
+        if (IS_BRANCH_OP(op)) successors[successorCount++] = JUMP_TARGET(c->code[i]);
+        for (uint32_t s = 0; s < successorCount; s++) {
+            if (reached[successors[s]]) continue;
+            reached[successors[s]] = true;
+            worklist[pending++] = successors[s];
+        }
+    }
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (!reached[i]) {
+            removed[i] = true;
+            changed = true;
+        }
+    }
+    // Scan backwards so chains of jumps to the next instruction all go
+    for (int64_t i = (int64_t) c->count - 1; i >= 0; i--) {
+        if (removed[i] || OPCODE(c->code[i]) != OP_JUMP) continue;
+        uint32_t target = JUMP_TARGET(c->code[i]);
+        if (target <= i) continue;
+        uint32_t next = i + 1;
+        while (next < target && removed[next]) next++;
+        if (next == target) {
+            removed[i] = true;
+            changed = true;
+        }
+    }
+    free(worklist);
+    free(reached);
+    return changed;
+}
+
+#ifdef SPECIALIZE_TYPES
+static OpCode numericOpcode(OpCode op) {
+    switch (op) {
+        case OP_ADD: return OP_ADD_NUM;
+        case OP_SUB: return OP_SUB_NUM;
+        case OP_MUL: return OP_MUL_NUM;
+        case OP_DIV: return OP_DIV_NUM;
+        case OP_MOD: return OP_MOD_NUM;
+        case OP_POW: return OP_POW_NUM;
+        case OP_LESS: return OP_LESS_NUM;
+        case OP_MORE: return OP_MORE_NUM;
+        case OP_LESS_EQUAL: return OP_LESS_EQUAL_NUM;
+        case OP_MORE_EQUAL: return OP_MORE_EQUAL_NUM;
+        default: return OP_EQUAL_NUM;
+    }
+}
+
+// Rewrites instructions to their unchecked forms where the IR proves operand types
+static uint32_t specializeTypes(Chunk* c) {
+    uint32_t specialized = 0;
+    irFunction* f = buildIR(c);
+    inferTypes(f);
+    for (uint32_t i = 0; i < c->count; i++) {
+        OpCode op = OPCODE(c->code[i]);
+        irInstr* instr = &f->instrs[i];
+        if (IS_FOLDABLE_BINARY(op)) {
+            if (instr->leftType != VAL_NUMBER || instr->rightType != VAL_NUMBER) continue;
+            c->code[i] = SET_OPCODE(c->code[i], numericOpcode(op));
+        } else if (op == OP_GET_COMBINED_REF_ATTR) {
+            // Assigned locals never fall back to the global
+            if (instr->leftType == IR_TYPE_UNSET) continue;
+            c->code[i] = SET_OPCODE(c->code[i] & ~(0xFFFFULL << 24), OP_GET_LOCAL_REF_ATTR);
+        } else if (op == OP_GET_ATTR_CALL) {
+            // Builtin objects carry no attributes of their own, the class table decides
+            uint16_t receiverType = instr->rightType;
+            if (!IR_IS_KNOWN_TYPE(receiverType) || receiverType < BUILTIN_STR || !IS_SYSTEM_DEFINED_TYPE(receiverType)) continue;
+            if (IS_INTERNAL_NULL(CLASS_FIND_ATTR(classArray[receiverType], GET_WORD(c->code[i], 1)))) continue;
+            c->code[i] = SET_OPCODE(c->code[i] | ((uint64_t) receiverType << 24), OP_GET_CLASS_ATTR_CALL);
+        } else {
+            continue;
+        }
+        specialized++;
+    }
+    freeIR(f);
+    return specialized;
+}
+#endif
+
+void optimizeChunk(Chunk* c) {
+#ifdef DEBUG_PRINT_OPTIMIZER_STATS
+    uint32_t originalCount = c->count;
+#endif
+    bool* removed = malloc(sizeof(bool) * (c->count + 1));
+    if (removed == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    for (uint32_t pass = 0; pass < OPTIMIZER_MAX_PASSES; pass++) {
+        bool changed = threadJumps(c);
+        memset(removed, 0, sizeof(bool) * (c->count + 1));
+        if (foldConstants(c, removed)) {
+            compactChunk(c, removed);
+            changed = true;
+        }
+        memset(removed, 0, sizeof(bool) * (c->count + 1));
+        if (removeDeadCode(c, removed)) {
+            compactChunk(c, removed);
+            changed = true;
+        }
+        if (!changed) break;
+    }
+    free(removed);
+#ifdef DEBUG_PRINT_OPTIMIZER_STATS
+    printf("Optimizer: %u -> %u instructions\n", originalCount, c->count);
+#ifdef SPECIALIZE_TYPES
+    uint32_t specialized = specializeTypes(c);
+    printf("Optimizer: %u instructions specialized\n", specialized);
+#endif
+#elif defined(SPECIALIZE_TYPES)
+    specializeTypes(c);
+#endif
+}
+
+#ifdef FUSE_BINARY_OPERANDS
+// One side of a binary op, slot holds a local or constant index
+typedef struct binaryOperand {
+    captureType capture;
+    uint16_t slot;
+} binaryOperand;
+
+static void decodeBinary(uint64_t line, binaryOperand* left, binaryOperand* right) {
+    uint8_t localAddrSlot = 2;
+    // Right operand takes the first address slot
+    right->capture = GET_NIBBLE(line, 3);
+    right->slot = 0;
+    if (USES_ADDR_SLOT(right->capture)) {
+        right->slot = GET_WORD(line, localAddrSlot);
+        localAddrSlot += 2;
+    }
+    left->capture = GET_NIBBLE(line, 2);
+    left->slot = USES_ADDR_SLOT(left->capture) ? GET_WORD(line, localAddrSlot) : 0;
+}
+
+// Words the operands and destination need, a payload takes two
+static bool binaryFits(binaryOperand left, binaryOperand right, bool dest) {
+    uint8_t words = USES_ADDR_SLOT(left.capture) + USES_ADDR_SLOT(right.capture) + (dest ? 1 : 0);
+    if (left.capture == CAPTURE_PAYLOAD || right.capture == CAPTURE_PAYLOAD) words += 2;
+    return words <= 3;
+}
+
+static uint64_t encodeBinary(uint64_t line, binaryOperand left, binaryOperand right, uint16_t dest) {
+    uint64_t encoded = (uint64_t) OPCODE(line) | ((uint64_t) left.capture << 8) | ((uint64_t) right.capture << 12);
+    uint8_t localAddrSlot = 2;
+    if (USES_ADDR_SLOT(right.capture)) {
+        encoded = SET_WORD(encoded, localAddrSlot, right.slot);
+        localAddrSlot += 2;
+    }
+    if (USES_ADDR_SLOT(left.capture)) encoded = SET_WORD(encoded, localAddrSlot, left.slot);
+    // Payload bits are kept as they were
+    if (left.capture == CAPTURE_PAYLOAD || right.capture == CAPTURE_PAYLOAD) encoded |= line & 0xFFFFFFFF00000000ULL;
+    else if (dest != 0) encoded = SET_WORD(encoded, BINARY_DEST_WORD, dest);
+    return encoded;
+}
+
+// Captures a constant or an assigned local load as an operand
+static bool captureOperand(Chunk* c, irFunction* f, uint32_t i, binaryOperand* operand) {
+    uint64_t line = c->code[i];
+    if (OPCODE(line) == OP_CONSTANT) {
+        *operand = (binaryOperand) {CAPTURE_CONSTANT, GET_BYTE(line, 1)};
+        return true;
+    }
+    // Captured locals are read without the null check of the load
+    if (OPCODE(line) == OP_GET_LOCAL_REF_ATTR && f->instrs[i].leftType != IR_TYPE_UNSET) {
+        *operand = (binaryOperand) {CAPTURE_VARIABLE, GET_WORD(line, 1)};
+        return true;
+    }
+    return false;
+}
+
+static void toAbsoluteJumps(Chunk* c) {
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (IS_BRANCH_OP(OPCODE(c->code[i]))) c->code[i] = SET_JUMP_TARGET(c->code[i], (uint16_t)(i + (int16_t) JUMP_TARGET(c->code[i])));
+    }
+}
+
+static void toRelativeJumps(Chunk* c) {
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (IS_BRANCH_OP(OPCODE(c->code[i]))) c->code[i] = SET_JUMP_TARGET(c->code[i], (uint16_t)(int16_t)(JUMP_TARGET(c->code[i]) - i));
+    }
+}
+
+void fuseBinaryOperands(Chunk* c, uint16_t paramCount) {
+    if (c == NULL || c->count == 0) return;
+    toAbsoluteJumps(c);
+    irFunction* f = buildIR(c);
+    f->paramCount = paramCount;
+    inferTypes(f);
+    bool* isTarget = findJumpTargets(c);
+    bool* removed = calloc(c->count + 1, sizeof(bool));
+    if (removed == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    uint32_t captured = 0;
+    uint32_t stored = 0;
+    for (uint32_t i = 0; i < c->count; i++) {
+        uint64_t line = c->code[i];
+        if (!IS_BINARY_OP(OPCODE(line)) || !IR_IS_REACHED(f, i)) continue;
+        binaryOperand left, right, operand;
+        decodeBinary(line, &left, &right);
+        // Operand loads directly before the op, the right one is on top of the stack
+        uint32_t next = i;
+        if (right.capture == CAPTURE_NONE && next > 0 && !isTarget[next] && !removed[next - 1] &&
+            captureOperand(c, f, next - 1, &operand) && binaryFits(left, operand, false)) {
+            right = operand;
+            removed[--next] = true;
+            captured++;
+        }
+        if (right.capture != CAPTURE_NONE && left.capture == CAPTURE_NONE && next > 0 && !isTarget[next] && !removed[next - 1] &&
+            captureOperand(c, f, next - 1, &operand) && binaryFits(operand, right, false)) {
+            left = operand;
+            removed[--next] = true;
+            captured++;
+        }
+        // A plain store of the result becomes the destination
+        uint16_t dest = 0;
+        if (i + 1 < c->count && !isTarget[i + 1] && OPCODE(c->code[i + 1]) == OP_SET_LOCAL_REF_ATTR && GET_BYTE(c->code[i + 1], 3) == ASSIGNMENT_NONE) {
+            // The payload moves to the constant pool to free the destination word
+            binaryOperand* payload = left.capture == CAPTURE_PAYLOAD ? &left : (right.capture == CAPTURE_PAYLOAD ? &right : NULL);
+            int32_t constIndex = payload != NULL ? addFoldedConstant(c, NUMBER_VAL(PAYLOAD_VALUE(line))) : 0;
+            if (constIndex >= 0) {
+                if (payload != NULL) *payload = (binaryOperand) {CAPTURE_CONSTANT, (uint16_t) constIndex};
+                if (binaryFits(left, right, true)) {
+                    dest = GET_WORD(c->code[i + 1], 1) + 1;
+                    removed[i + 1] = true;
+                    stored++;
+                }
+            }
+        }
+        c->code[i] = encodeBinary(line, left, right, dest);
+    }
+    compactChunk(c, removed);
+    free(removed);
+    free(isTarget);
+    freeIR(f);
+    toRelativeJumps(c);
+#ifdef DEBUG_PRINT_OPTIMIZER_STATS
+    printf("Fusion: %u operands captured, %u results stored\n", captured, stored);
+#endif
+}
+#endif
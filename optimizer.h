@@ -0,0 +1,14 @@
+#ifndef CJ_2_OPTIMIZER_H
+#define CJ_2_OPTIMIZER_H
+
+#include "chunk.h"
+
+// Folds constants, threads jumps and removes dead code in a finished chunk, then specializes
+// operations whose operand types are inferred by the IR.
+// Jumps must still hold absolute addresses, debug tables are compacted alongside the code.
+void optimizeChunk(Chunk* c);
+// Captures constant and assigned local operands into binary ops, and stores their results straight
+// into a local. Runs last on chunks with relative jumps, earlier passes expect stack operands.
+void fuseBinaryOperands(Chunk* c, uint16_t paramCount);
+
+#endif //CJ_2_OPTIMIZER_H
@@ -0,0 +1,620 @@
+#include "redundancy.h"
+#include "object.h"
+#include "runtimeDS.h"
+#include "stringHash.h"
+#include "compiler.h"
+#include "errors.h"
+#include "ir.h"
+
+#include <string.h>
+
+#define GET_NIBBLE(data, shift) ((uint8_t)(((data) >> ((shift) * 4)) & 0xF))
+#define GET_BYTE(data, shift)  ((uint8_t) (((data) >> ((shift) * 8)) & 0xFF))
+#define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
+
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
+#define IS_BRANCH_OP(op) ((op) == OP_JUMP || (op) == OP_JUMP_IF_FALSE || (op) == OP_ITER_NEXT || (op) == OP_FOR_STEP)
+#define IS_CALL_OP(op) ((op) == OP_EXEC_FUNCTION_ENFORCE_RETURN || (op) == OP_EXEC_FUNCTION_IGNORE_RETURN || \
+                        (op) == OP_EXEC_METHOD_ENFORCE_RETURN || (op) == OP_EXEC_METHOD_IGNORE_RETURN || \
+                        (op) == OP_INIT || (op) == OP_GET_PARENT_INIT)
+#define IS_LOAD_OP(op) ((op) == OP_CONSTANT || (op) == OP_GET_SELF || (op) == OP_GET_GLOBAL_REF_ATTR || \
+                        (op) == OP_GET_LOCAL_REF_ATTR || (op) == OP_GET_COMBINED_REF_ATTR)
+#define IS_GENERIC_BINARY_OP(op) (((op) >= OP_ADD && (op) <= OP_MORE_EQUAL) || (op) == OP_EQUAL || (op) == OP_POW)
+#define IS_NUM_OP(op) ((op) >= OP_ADD_NUM && (op) <= OP_EQUAL_NUM)
+#define IS_BUILTIN_TYPE(type) (IR_IS_KNOWN_TYPE(type) && IS_SYSTEM_DEFINED_TYPE(type))
+#define JUMP_TARGET(line) GET_WORD(line, 1)
+#define SET_WORD(line, shift, value) (((line) & ~(0xFFFFULL << ((shift) * 8))) | ((uint64_t)(uint16_t)(value) << ((shift) * 8)))
+#define LOCAL_LOAD_LINE(index) ((uint64_t) OP_GET_LOCAL_REF_ATTR | ((uint64_t)(index) << 8))
+#define LOCAL_STORE_LINE(index) ((uint64_t) OP_SET_LOCAL_REF_ATTR | ((uint64_t)(index) << 8) | ((uint64_t) ASSIGNMENT_NONE << 24))
+#define NO_INDEX UINT32_MAX
+
+// Values a stretch of code may overwrite
+typedef struct effects {
+    bool* locals; // Indexed by local slot
+    uint16_t* globals;
+    uint32_t globalCount;
+    uint16_t* attrs;
+    uint32_t attrCount;
+    bool calls; // Script code may run and write any global or attribute
+} effects;
+
+typedef struct chunkAnalysis {
+    Chunk* c;
+    irFunction* f;
+    uint16_t localCount;
+    uint32_t* exprStart; // Start of the pure expression ending at each instruction, or NO_INDEX
+    effects written;
+    bool overloads; // Operators may run script code
+} chunkAnalysis;
+
+// A loop invariant expression and the local that holds its value
+typedef struct hoistedExpr {
+    uint32_t start;
+    uint32_t end;
+    uint16_t local;
+    bool first; // Evaluated in the preheader, identical copies only load the local
+} hoistedExpr;
+
+static void* redundancyAlloc(size_t size) {
+    void* ptr = calloc(1, size);
+    if (ptr == NULL) compilationError(0, 0, 0, "Optimizer allocation failed");
+    return ptr;
+}
+
+static void toAbsoluteJumps(uint64_t* code, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (IS_BRANCH_OP(OPCODE(code[i]))) code[i] = SET_WORD(code[i], 1, (uint16_t)(i + (int16_t) JUMP_TARGET(code[i])));
+    }
+}
+
+static void toRelativeJumps(uint64_t* code, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (IS_BRANCH_OP(OPCODE(code[i]))) code[i] = SET_WORD(code[i], 1, (uint16_t)(int16_t)(JUMP_TARGET(code[i]) - i));
+    }
+}
+
+// The VM looks these names up on operands without an explicit call, print is only reached through one
+static bool isOperatorSymbol(uint16_t symbol) {
+    for (uint32_t name = NAME_HASH_STRING; name < BUILTIN_NAME_COUNT; name++) {
+        if (symbol == BUILTIN_SYMBOL(name)) return true;
+    }
+    return false;
+}
+
+static bool scriptDefinesOperators(runtimeList* chunkArray, uint32_t classCount) {
+    for (uint32_t id = 0; id < classCount; id++) {
+        if (IS_SYSTEM_DEFINED_TYPE(id) || classArray[id] == NULL) continue;
+        for (uint32_t name = NAME_HASH_STRING; name < BUILTIN_NAME_COUNT; name++) {
+            if (!IS_INTERNAL_NULL(CLASS_FIND_ATTR(classArray[id], BUILTIN_SYMBOL(name)))) return true;
+        }
+    }
+    // Objects can also be given operators of their own
+    for (uint32_t i = 0; i < chunkArray->size; i++) {
+        Chunk* c = VALUE_CALLABLE_VALUE(chunkArray->list[i])->func;
+        for (uint32_t j = 0; j < c->count; j++) {
+            if (OPCODE(c->code[j]) == OP_SET_ATTR && isOperatorSymbol(GET_WORD(c->code[j], 1))) return true;
+        }
+    }
+    return false;
+}
+
+// Whether instruction i may run script code, through a call or an operator a script class defines
+static bool mayRunScript(chunkAnalysis* a, uint32_t i) {
+    uint64_t line = a->c->code[i];
+    OpCode op = OPCODE(line);
+    irInstr* instr = &a->f->instrs[i];
+    if (IS_CALL_OP(op)) return true;
+    if (!a->overloads) return false;
+    // Builtin classes implement their operators in C
+    switch (op) {
+        case OP_NEGATE:
+            return true;
+        case OP_GET_INDEX_REF:
+            return !IS_BUILTIN_TYPE(instr->leftType);
+        case OP_SET_INDEX_REF:
+            return GET_BYTE(line, 1) != ASSIGNMENT_NONE || !IS_BUILTIN_TYPE(instr->leftType);
+        case OP_SET_LOCAL_REF_ATTR:
+        case OP_SET_COMBINED_REF_ATTR:
+            if (GET_BYTE(line, op == OP_SET_LOCAL_REF_ATTR ? 3 : 5) == ASSIGNMENT_NONE) return false;
+            return instr->leftType != VAL_NUMBER || instr->rightType != VAL_NUMBER;
+        case OP_SET_GLOBAL_REF_ATTR:
+        case OP_SET_ATTR:
+            return GET_BYTE(line, 3) != ASSIGNMENT_NONE;
+        case OP_FOR_STEP:
+            return instr->leftType != VAL_NUMBER || instr->rightType != VAL_NUMBER;
+        default:
+            return IS_GENERIC_BINARY_OP(op) && !(IS_BUILTIN_TYPE(instr->leftType) && IS_BUILTIN_TYPE(instr->rightType));
+    }
+}
+
+static void writeLocal(chunkAnalysis* a, uint32_t index) {
+    if (index < a->localCount) a->written.locals[index] = true;
+}
+
+// Accumulates what instruction i may overwrite
+static void addEffects(chunkAnalysis* a, uint32_t i) {
+    effects* e = &a->written;
+    uint64_t line = a->c->code[i];
+    if (mayRunScript(a, i)) e->calls = true;
+    switch (OPCODE(line)) {
+        case OP_SET_LOCAL_REF_ATTR:
+            writeLocal(a, GET_WORD(line, 1));
+            break;
+        case OP_SET_COMBINED_REF_ATTR:
+            // Special assignments to an unassigned local modify the global instead
+            writeLocal(a, GET_WORD(line, 1));
+            e->globals[e->globalCount++] = GET_WORD(line, 3);
+            break;
+        case OP_SET_GLOBAL_REF_ATTR:
+            e->globals[e->globalCount++] = GET_WORD(line, 1);
+            break;
+        case OP_SET_ATTR:
+            e->attrs[e->attrCount++] = GET_WORD(line, 1);
+            break;
+        case OP_ITER_INIT:
+            for (uint32_t slot = 0; slot < 3; slot++) writeLocal(a, GET_WORD(line, 1) + slot);
+            break;
+        case OP_ITER_NEXT:
+            writeLocal(a, GET_WORD(line, 3) + 1);
+            writeLocal(a, GET_WORD(line, 5));
+            break;
+        case OP_FOR_STEP:
+            writeLocal(a, GET_BYTE(line, 3));
+            break;
+        default:
+            break;
+    }
+}
+
+static void clearEffects(chunkAnalysis* a) {
+    memset(a->written.locals, 0, sizeof(bool) * (a->localCount + 1));
+    a->written.globalCount = 0;
+    a->written.attrCount = 0;
+    a->written.calls = false;
+}
+
+static void collectEffects(chunkAnalysis* a, uint32_t from, uint32_t to) {
+    clearEffects(a);
+    for (uint32_t i = from; i < to; i++) addEffects(a, i);
+}
+
+static bool localWritten(chunkAnalysis* a, uint32_t index) {
+    return index < a->localCount ? a->written.locals[index] : true;
+}
+
+static bool globalWritten(chunkAnalysis* a, uint16_t index) {
+    if (a->written.calls) return true;
+    for (uint32_t i = 0; i < a->written.globalCount; i++) if (a->written.globals[i] == index) return true;
+    return false;
+}
+
+static bool attrWritten(chunkAnalysis* a, uint16_t symbol) {
+    if (a->written.calls) return true;
+    for (uint32_t i = 0; i < a->written.attrCount; i++) if (a->written.attrs[i] == symbol) return true;
+    return false;
+}
+
+// Whether a value read by one instruction of a pure expression may have been overwritten
+static bool readChanged(chunkAnalysis* a, uint64_t line) {
+    switch (OPCODE(line)) {
+        case OP_CONSTANT:
+            return false;
+        case OP_GET_SELF:
+            return localWritten(a, 0);
+        case OP_GET_LOCAL_REF_ATTR:
+            return localWritten(a, GET_WORD(line, 1));
+        case OP_GET_GLOBAL_REF_ATTR:
+            return globalWritten(a, GET_WORD(line, 1));
+        case OP_GET_COMBINED_REF_ATTR:
+            return localWritten(a, GET_WORD(line, 1)) || globalWritten(a, GET_WORD(line, 3));
+        case OP_GET_ATTR:
+            return attrWritten(a, GET_WORD(line, 1));
+        default: {
+            // Unchecked arithmetic reads its captured locals, the right capture takes the first slot
+            uint8_t localAddrSlot = 2;
+            for (int nibble = 3; nibble >= 2; nibble--) {
+                if (GET_NIBBLE(line, nibble) != CAPTURE_VARIABLE) continue;
+                if (localWritten(a, GET_WORD(line, localAddrSlot))) return true;
+                localAddrSlot += 2;
+            }
+            return false;
+        }
+    }
+}
+
+static bool exprChanged(chunkAnalysis* a, uint32_t start, uint32_t end) {
+    for (uint32_t i = start; i <= end; i++) if (readChanged(a, a->c->code[i])) return true;
+    return false;
+}
+
+// Loads raise a runtime error when their target is missing
+static bool exprMayFault(chunkAnalysis* a, uint32_t start, uint32_t end) {
+    for (uint32_t i = start; i <= end; i++) {
+        OpCode op = OPCODE(a->c->code[i]);
+        if (op == OP_GET_GLOBAL_REF_ATTR || op == OP_GET_ATTR) return true;
+        if ((op == OP_GET_LOCAL_REF_ATTR || op == OP_GET_COMBINED_REF_ATTR) && a->f->instrs[i].leftType == IR_TYPE_UNSET) return true;
+    }
+    return false;
+}
+
+// Pure expressions only load values and do unchecked arithmetic, so within a block each one
+// occupies a contiguous run of instructions ending at the instruction that produces its value
+static void findPureExprs(chunkAnalysis* a) {
+    uint32_t stack[IR_MAX_STACK_DEPTH];
+    for (uint32_t i = 0; i < a->c->count; i++) a->exprStart[i] = NO_INDEX;
+    for (uint32_t b = 0; b < a->f->blockCount; b++) {
+        if (!a->f->reached[b]) continue;
+        uint32_t top = 0;
+        for (uint32_t i = a->f->blocks[b].start; i < a->f->blocks[b].end; i++) {
+            uint64_t line = a->c->code[i];
+            OpCode op = OPCODE(line);
+            uint32_t operands;
+            if (IS_LOAD_OP(op)) {
+                operands = 0;
+            } else if (op == OP_GET_ATTR) {
+                operands = 1;
+            } else if (IS_NUM_OP(op)) {
+                operands = (GET_NIBBLE(line, 2) == CAPTURE_NONE) + (GET_NIBBLE(line, 3) == CAPTURE_NONE);
+            } else {
+                // Untracked stack effect
+                top = 0;
+                continue;
+            }
+            uint32_t start = i;
+            if (operands > top) {
+                top = 0;
+                start = NO_INDEX;
+            } else if (operands > 0) {
+                top -= operands;
+                start = stack[top];
+                for (uint32_t k = top; k < top + operands; k++) if (stack[k] == NO_INDEX) start = NO_INDEX;
+            }
+            if (top == IR_MAX_STACK_DEPTH) top = 0;
+            stack[top++] = start;
+            a->exprStart[i] = start;
+        }
+    }
+}
+
+static void analyzeChunk(chunkAnalysis* a, uint16_t paramCount) {
+    a->f = buildIR(a->c);
+    a->f->paramCount = paramCount;
+    inferTypes(a->f);
+    a->localCount = a->c->localRefArraySize;
+    a->exprStart = redundancyAlloc(sizeof(uint32_t) * (a->c->count + 1));
+    a->written.locals = redundancyAlloc(sizeof(bool) * (a->localCount + 1));
+    a->written.globals = redundancyAlloc(sizeof(uint16_t) * (a->c->count + 1));
+    a->written.attrs = redundancyAlloc(sizeof(uint16_t) * (a->c->count + 1));
+    findPureExprs(a);
+}
+
+static void releaseAnalysis(chunkAnalysis* a) {
+    freeIR(a->f);
+    free(a->exprStart);
+    free(a->written.locals);
+    free(a->written.globals);
+    free(a->written.attrs);
+}
+
+// Drops removed instructions and places the preheader before header, along with debug entries.
+// Branches from outside the loop enter through the preheader, back edges skip it.
+static void rewriteChunk(Chunk* c, const bool* removed, uint32_t header, uint32_t latch,
+                         const uint64_t* preCode, const uint32_t* preOrigin, uint32_t preCount) {
+    uint32_t* newIndex = redundancyAlloc(sizeof(uint32_t) * (c->count + 1));
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (i == header) position += preCount;
+        // Removed instructions fall through to the next kept one
+        newIndex[i] = position;
+        if (!removed[i]) position++;
+    }
+    newIndex[c->count] = position;
+    uint64_t* code = redundancyAlloc(sizeof(uint64_t) * (position + 1));
+    uint16_t* lines = redundancyAlloc(sizeof(uint16_t) * (position + 1));
+    uint8_t* indices = redundancyAlloc(sizeof(uint8_t) * (position + 1));
+    uint8_t* sourceIndices = redundancyAlloc(sizeof(uint8_t) * (position + 1));
+    uint16_t* siteIndices = c->siteIndices == NULL ? NULL : redundancyAlloc(sizeof(uint16_t) * (position + 1));
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (i == header) {
+            for (uint32_t p = 0; p < preCount; p++) {
+                code[count] = preCode[p];
+                lines[count] = c->lines[preOrigin[p]];
+                indices[count] = c->indices[preOrigin[p]];
+                sourceIndices[count] = c->sourceIndices[preOrigin[p]];
+                if (siteIndices != NULL) siteIndices[count] = c->siteIndices[preOrigin[p]];
+                count++;
+            }
+        }
+        if (removed[i]) continue;
+        uint64_t line = c->code[i];
+        if (IS_BRANCH_OP(OPCODE(line))) {
+            uint32_t target = JUMP_TARGET(line);
+            bool entry = target == header && (i < header || i > latch);
+            line = SET_WORD(line, 1, entry ? newIndex[header] - preCount : newIndex[target]);
+        }
+        code[count] = line;
+        lines[count] = c->lines[i];
+        indices[count] = c->indices[i];
+        sourceIndices[count] = c->sourceIndices[i];
+        if (siteIndices != NULL) siteIndices[count] = c->siteIndices[i];
+        count++;
+    }
+    free(newIndex);
+    free(c->code);
+    free(c->lines);
+    free(c->indices);
+    free(c->sourceIndices);
+    free(c->siteIndices);
+    c->code = code;
+    c->lines = lines;
+    c->indices = indices;
+    c->sourceIndices = sourceIndices;
+    c->siteIndices = siteIndices;
+    c->count = count;
+    c->capacity = position + 1;
+}
+
+// First branch or return at or after from, instructions before it run whenever from does
+static uint32_t straightLineEnd(Chunk* c, uint32_t from, uint32_t last) {
+    while (from <= last) {
+        OpCode op = OPCODE(c->code[from]);
+        if (IS_BRANCH_OP(op) || op == OP_RETURN || op == OP_RETURN_NONE) break;
+        from++;
+    }
+    return from;
+}
+
+// Whether the loop tests at its header and jumps back to it from its last instruction
+static bool canRotate(Chunk* c, uint32_t header, uint32_t test, uint32_t latch) {
+    if (test >= latch) return false;
+    OpCode op = OPCODE(c->code[test]);
+    if ((op != OP_JUMP_IF_FALSE && op != OP_ITER_NEXT) || JUMP_TARGET(c->code[test]) != latch + 1) return false;
+    if (OPCODE(c->code[latch]) != OP_JUMP || JUMP_TARGET(c->code[latch]) != header) return false;
+    if (c->count + (test - header + 1) > INT16_MAX) return false;
+    for (uint32_t i = test + 1; i <= latch; i++) {
+        if (IS_BRANCH_OP(OPCODE(c->code[i])) && JUMP_TARGET(c->code[i]) > header && JUMP_TARGET(c->code[i]) <= test) return false;
+    }
+    return true;
+}
+
+// Enters the loop through a copy of its test and moves the test to the bottom, so the body
+// becomes the loop header and runs on every entry. Each iteration still runs one test and one jump.
+static void rotateLoop(Chunk* c, uint32_t header, uint32_t test, uint32_t latch) {
+    uint32_t testLength = test - header + 1;
+    uint32_t count = c->count + testLength;
+    uint64_t* code = redundancyAlloc(sizeof(uint64_t) * (count + 1));
+    uint16_t* lines = redundancyAlloc(sizeof(uint16_t) * (count + 1));
+    uint8_t* indices = redundancyAlloc(sizeof(uint8_t) * (count + 1));
+    uint8_t* sourceIndices = redundancyAlloc(sizeof(uint8_t) * (count + 1));
+    uint16_t* siteIndices = c->siteIndices == NULL ? NULL : redundancyAlloc(sizeof(uint16_t) * (count + 1));
+    for (uint32_t i = 0; i < count; i++) {
+        // Entry test, body, bottom test, jump back, then everything after shifts by the test length
+        uint32_t origin = i;
+        if (i >= latch && i < latch + testLength) origin = header + (i - latch);
+        else if (i >= latch + testLength) origin = i - testLength;
+        uint64_t line = c->code[origin];
+        if (i == latch + testLength) {
+            line = SET_WORD(line, 1, test + 1);
+        } else if (IS_BRANCH_OP(OPCODE(line))) {
+            uint32_t target = JUMP_TARGET(line);
+            bool inside = i > test && i <= latch + testLength;
+            if (target == header) target = inside ? latch : header;
+            else if (target > latch) target += testLength;
+            line = SET_WORD(line, 1, target);
+        }
+        code[i] = line;
+        lines[i] = c->lines[origin];
+        indices[i] = c->indices[origin];
+        sourceIndices[i] = c->sourceIndices[origin];
+        if (siteIndices != NULL) siteIndices[i] = c->siteIndices[origin];
+    }
+    free(c->code);
+    free(c->lines);
+    free(c->indices);
+    free(c->sourceIndices);
+    free(c->siteIndices);
+    c->code = code;
+    c->lines = lines;
+    c->indices = indices;
+    c->sourceIndices = sourceIndices;
+    c->siteIndices = siteIndices;
+    c->count = count;
+    c->capacity = count + 1;
+}
+
+// Moves the invariant expressions of the loop [header, latch] into locals set by a preheader
+static bool hoistFromLoop(chunkAnalysis* a, uint32_t header, uint32_t latch, uint32_t* hoisted) {
+    Chunk* c = a->c;
+    if (!IR_IS_REACHED(a->f, header)) return false;
+    // Every other way in must come through the header
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (i >= header && i <= latch) continue;
+        if (IS_BRANCH_OP(OPCODE(c->code[i])) && JUMP_TARGET(c->code[i]) > header && JUMP_TARGET(c->code[i]) <= latch) return false;
+    }
+    collectEffects(a, header, latch + 1);
+    // Instructions before the first branch run on every entry, only their loads may fault early
+    uint32_t prefixEnd = straightLineEnd(c, header, latch);
+    uint32_t bodyEnd = prefixEnd < latch ? straightLineEnd(c, prefixEnd + 1, latch) : prefixEnd;
+    bool rotate = false;
+    hoistedExpr* exprs = redundancyAlloc(sizeof(hoistedExpr) * (latch - header + 1));
+    uint32_t exprCount = 0;
+    // Scan backwards so enclosing expressions are taken before their operands
+    for (int64_t i = latch; i >= (int64_t) header; i--) {
+        uint32_t start = a->exprStart[i];
+        if (start == NO_INDEX || start == i || start < header) continue;
+        if (exprChanged(a, start, i)) continue;
+        if (i >= prefixEnd && exprMayFault(a, start, i)) {
+            // Only reached once the header test passes
+            if (i > prefixEnd && i < bodyEnd) rotate = true;
+            continue;
+        }
+        exprs[exprCount++] = (hoistedExpr) {start, (uint32_t) i, 0, true};
+        i = start;
+    }
+    if (exprCount == 0 && rotate && canRotate(c, header, prefixEnd, latch)) {
+        free(exprs);
+        rotateLoop(c, header, prefixEnd, latch);
+        return true;
+    }
+    // Preheader keeps program order, so faulting loads still fail in the same order
+    for (uint32_t k = 0; k < exprCount / 2; k++) {
+        hoistedExpr swap = exprs[k];
+        exprs[k] = exprs[exprCount - 1 - k];
+        exprs[exprCount - 1 - k] = swap;
+    }
+    uint32_t chosen = 0;
+    uint32_t preCount = 0;
+    for (; chosen < exprCount; chosen++) {
+        hoistedExpr* expr = &exprs[chosen];
+        uint32_t length = expr->end - expr->start + 1;
+        for (uint32_t k = 0; k < chosen && expr->first; k++) {
+            if (exprs[k].end - exprs[k].start + 1 != length) continue;
+            if (memcmp(&c->code[exprs[k].start], &c->code[expr->start], sizeof(uint64_t) * length) != 0) continue;
+            expr->local = exprs[k].local;
+            expr->first = false;
+        }
+        if (!expr->first) continue;
+        // Loop counters address locals with a single byte
+        if (c->localRefArraySize >= UINT8_MAX || c->count + preCount + length + 1 > INT16_MAX) break;
+        expr->local = c->localRefArraySize++;
+        preCount += length + 1;
+    }
+    if (chosen == 0) {
+        free(exprs);
+        return false;
+    }
+    uint64_t* preCode = redundancyAlloc(sizeof(uint64_t) * preCount);
+    uint32_t* preOrigin = redundancyAlloc(sizeof(uint32_t) * preCount);
+    uint32_t p = 0;
+    for (uint32_t k = 0; k < chosen; k++) {
+        if (!exprs[k].first) continue;
+        for (uint32_t i = exprs[k].start; i <= exprs[k].end; i++) {
+            preCode[p] = c->code[i];
+            preOrigin[p++] = i;
+        }
+        preCode[p] = LOCAL_STORE_LINE(exprs[k].local);
+        preOrigin[p++] = exprs[k].end;
+    }
+    bool* removed = redundancyAlloc(sizeof(bool) * (c->count + 1));
+    for (uint32_t k = 0; k < chosen; k++) {
+        c->code[exprs[k].start] = LOCAL_LOAD_LINE(exprs[k].local);
+        for (uint32_t i = exprs[k].start + 1; i <= exprs[k].end; i++) removed[i] = true;
+    }
+    rewriteChunk(c, removed, header, latch, preCode, preOrigin, preCount);
+    free(removed);
+    free(preOrigin);
+    free(preCode);
+    free(exprs);
+    *hoisted += chosen;
+    return true;
+}
+
+// Hoists from or rotates the innermost loop that has invariant expressions
+static bool hoistLoop(chunkAnalysis* a, uint32_t* hoisted) {
+    Chunk* c = a->c;
+    uint32_t* latchOf = redundancyAlloc(sizeof(uint32_t) * (c->count + 1));
+    bool* tried = redundancyAlloc(sizeof(bool) * (c->count + 1));
+    for (uint32_t i = 0; i <= c->count; i++) latchOf[i] = NO_INDEX;
+    // A loop spans from the target of its back edges to the last of them
+    for (uint32_t i = 0; i < c->count; i++) {
+        if (!IS_BRANCH_OP(OPCODE(c->code[i])) || JUMP_TARGET(c->code[i]) > i) continue;
+        uint32_t header = JUMP_TARGET(c->code[i]);
+        if (latchOf[header] == NO_INDEX || latchOf[header] < i) latchOf[header] = i;
+    }
+    bool changed = false;
+    while (!changed) {
+        uint32_t header = NO_INDEX;
+        for (uint32_t i = 0; i < c->count; i++) {
+            if (latchOf[i] == NO_INDEX || tried[i]) continue;
+            if (header == NO_INDEX || latchOf[i] - i < latchOf[header] - header) header = i;
+        }
+        if (header == NO_INDEX) break;
+        tried[header] = true;
+        changed = hoistFromLoop(a, header, latchOf[header], hoisted);
+    }
+    free(tried);
+    free(latchOf);
+    return changed;
+}
+
+// Local an identical expression was stored to earlier in the block and still holds, or -1
+static int32_t findStoredCopy(chunkAnalysis* a, uint32_t blockStart, uint32_t start, uint32_t length) {
+    Chunk* c = a->c;
+    for (int64_t store = (int64_t) start - 1; store >= (int64_t)(blockStart + length); store--) {
+        uint64_t line = c->code[store];
+        OpCode op = OPCODE(line);
+        if (op != OP_SET_LOCAL_REF_ATTR && op != OP_SET_COMBINED_REF_ATTR) continue;
+        if (GET_BYTE(line, op == OP_SET_LOCAL_REF_ATTR ? 3 : 5) != ASSIGNMENT_NONE) continue;
+        uint32_t copy = store - length;
+        if (a->exprStart[store - 1] != copy) continue;
+        if (memcmp(&c->code[copy], &c->code[start], sizeof(uint64_t) * length) != 0) continue;
+        uint16_t holder = GET_WORD(line, 1);
+        // The store itself must not change what the expression reads
+        clearEffects(a);
+        writeLocal(a, holder);
+        if (exprChanged(a, start, start + length - 1)) continue;
+        collectEffects(a, store + 1, start);
+        if (localWritten(a, holder) || exprChanged(a, start, start + length - 1)) continue;
+        return holder;
+    }
+    return -1;
+}
+
+// Replaces expressions whose value an earlier store in the same block already holds
+static uint32_t reuseExprs(chunkAnalysis* a) {
+    Chunk* c = a->c;
+    bool* removed = redundancyAlloc(sizeof(bool) * (c->count + 1));
+    uint32_t reused = 0;
+    for (uint32_t b = 0; b < a->f->blockCount; b++) {
+        if (!a->f->reached[b]) continue;
+        uint32_t blockStart = a->f->blocks[b].start;
+        for (int64_t i = (int64_t) a->f->blocks[b].end - 1; i > blockStart; i--) {
+            uint32_t start = a->exprStart[i];
+            if (start == NO_INDEX || start == i) continue;
+            int32_t holder = findStoredCopy(a, blockStart, start, i - start + 1);
+            if (holder < 0) continue;
+            c->code[start] = LOCAL_LOAD_LINE(holder);
+            for (uint32_t j = start + 1; j <= i; j++) removed[j] = true;
+            reused++;
+            i = start;
+        }
+    }
+    if (reused > 0) rewriteChunk(c, removed, NO_INDEX, 0, NULL, NULL, 0);
+    free(removed);
+    return reused;
+}
+
+static void eliminateInChunk(callable* function, bool overloads, uint32_t* hoisted, uint32_t* reused) {
+    Chunk* c = function->func;
+    if (c == NULL || c->count == 0) return;
+    chunkAnalysis a;
+    a.c = c;
+    a.overloads = overloads;
+    // Methods receive self in the first slot
+    uint16_t paramCount = function->in + (function->type == method ? 1 : 0);
+    toAbsoluteJumps(c->code, c->count);
+    // Each round moves expressions one loop level out or rotates one loop
+    bool moved;
+    do {
+        analyzeChunk(&a, paramCount);
+        moved = hoistLoop(&a, hoisted);
+        if (!moved) *reused += reuseExprs(&a);
+        releaseAnalysis(&a);
+    } while (moved);
+    toRelativeJumps(c->code, c->count);
+}
+
+void eliminateRedundancy(runtimeList* chunkArray, uint32_t classCount) {
+    bool overloads = scriptDefinesOperators(chunkArray, classCount);
+    uint32_t hoisted = 0;
+    uint32_t reused = 0;
+    for (uint32_t i = 0; i < chunkArray->size; i++) {
+        eliminateInChunk(VALUE_CALLABLE_VALUE(chunkArray->list[i]), overloads, &hoisted, &reused);
+    }
+#ifdef DEBUG_PRINT_OPTIMIZER_STATS
+    printf("Redundancy: %u expressions hoisted, %u reused\n", hoisted, reused);
+#endif
+    (void) hoisted;
+    (void) reused;
+}
@@ -0,0 +1,10 @@
+#ifndef CJ_2_REDUNDANCY_H
+#define CJ_2_REDUNDANCY_H
+
+#include "primitiveVars.h"
+
+// Hoists loop invariant loads and arithmetic into a preheader, and reuses expressions already stored
+// to a local earlier in the same block. Runs once class tables are final, when chunks hold relative jumps.
+void eliminateRedundancy(runtimeList* chunkArray, uint32_t classCount);
+
+#endif //CJ_2_REDUNDANCY_H
@@ -110,6 +110,15 @@ uint16_t getRefIndex(refTable* refTable, char* identifier) {
     return objIndex;
 }
 
+char** refTableKeys(refTable* dict) {
+    char** keys = malloc(sizeof(char*) * (dict->numEntries + 1));
+    if (keys == NULL) dictError("Failed to allocate memory for reference table keys");
+    for (uint32_t i = 0; i < dict->tableSize; i++) {
+        for (refTableEntry* entry = dict->entries[i]; entry != NULL; entry = entry->next) keys[entry->value] = entry->key;
+    }
+    return keys;
+}
+
 void printRefTable(refTable* dict) {
     bool first = true;
     printf("refTable{");
@@ -25,6 +25,7 @@ refTable* createRefTable(uint32_t size);
 
 uint16_t getRefIndex(refTable* refTable, char* identifier);
 bool refTableContains(refTable* dict, char* key);
+char** refTableKeys(refTable* dict); // Keys by their index, freed by the caller
 void freeRefTable(refTable* dict);
 void printRefTable(refTable* dict);
 
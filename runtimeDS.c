@@ -6,14 +6,19 @@
 #include "errors.h"
 #include "vm.h"
 #include "stringHash.h"
+#include "slabAllocator.h"
 
 #include <math.h>
+#include <stddef.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 runtimeList* createRuntimeList(uint32_t size) {
-    runtimeList* newList = (runtimeList*) malloc(sizeof(runtimeList));
+    runtimeList* newList = (runtimeList*) slabAlloc(sizeof(runtimeList));
     if (newList == NULL) listError("Failed to allocate memory for list.");
-    newList->list = (Value*) malloc(sizeof(Value) * size);
+    newList->list = (Value*) slabAlloc(sizeof(Value) * size);
     if (newList->list == NULL) listError("Failed to allocate memory for list elements.");
     newList->size = 0;
     newList->capacity = size;
@@ -24,8 +29,9 @@ void listAddElement(runtimeList* list, Value value) {
     if (list->size == list->capacity) {
         if (list->size >= (UINT32_MAX/2)) listError("List size exceeds maximum size during reallocation.");
         // Double the capacity if the list is full
+        uint32_t oldCapacity = list->capacity;
         list->capacity *= 2;
-        Value* newList = (Value*) realloc(list->list, sizeof(Value) * list->capacity);
+        Value* newList = (Value*) slabRealloc(list->list, sizeof(Value) * oldCapacity, sizeof(Value) * list->capacity);
         if (newList == NULL) listError("Failed to reallocate memory for list elements.");
         list->list = newList;
     }
@@ -43,8 +49,9 @@ void listInsertElement(runtimeList* list, uint32_t index, Value value) {
     if (list->size == list->capacity) {
         if (list->size >= (UINT32_MAX/2)) listError("List size exceeds maximum size during reallocation.");
         // Double the capacity if the list is full
+        uint32_t oldCapacity = list->capacity;
         list->capacity *= 2;
-        Value* newList = (Value*) realloc(list->list, sizeof(Value) * list->capacity);
+        Value* newList = (Value*) slabRealloc(list->list, sizeof(Value) * oldCapacity, sizeof(Value) * list->capacity);
         if (newList == NULL) listError("Failed to reallocate memory for list elements.");
         list->list = newList;
     }
@@ -91,10 +98,186 @@ uint32_t listIndexOfElement(runtimeList* list, Value value) {
     return 0; // Unreachable
 }
 
+static inline void listReserve(runtimeList* list, uint32_t needed) {
+    if (needed <= list->capacity) return;
+    if (needed >= (UINT32_MAX/2)) listError("List size exceeds maximum size during reallocation.");
+    uint32_t oldCapacity = list->capacity;
+    while (list->capacity < needed) list->capacity *= 2;
+    Value* newList = (Value*) slabRealloc(list->list, sizeof(Value) * oldCapacity, sizeof(Value) * list->capacity);
+    if (newList == NULL) listError("Failed to reallocate memory for list elements.");
+    list->list = newList;
+}
+
+void listAppendRange(runtimeList* list, runtimeList* source, uint32_t start, uint32_t end) {
+    if (start > end || end > source->size) listError("List range out of range");
+    uint32_t count = end - start;
+    listReserve(list, list->size + count);
+    // Source is read after the reserve, it may be the same list
+    memcpy(&list->list[list->size], &source->list[start], sizeof(Value) * count);
+    list->size += count;
+}
+
+void listReverseElements(runtimeList* list) {
+    if (list->size < 2) return;
+    for (uint32_t i = 0, j = list->size - 1; i < j; i++, j--) {
+        Value temp = list->list[i];
+        list->list[i] = list->list[j];
+        list->list[j] = temp;
+    }
+}
+
+void listClearElements(runtimeList* list) {
+    // Release grown storage
+    if (list->capacity > RUNTIME_LIST_INIT_SIZE) {
+        list->list = (Value*) slabRealloc(list->list, sizeof(Value) * list->capacity, sizeof(Value) * RUNTIME_LIST_INIT_SIZE);
+        if (list->list == NULL) listError("Failed to reallocate memory for list elements.");
+        list->capacity = RUNTIME_LIST_INIT_SIZE;
+    }
+    list->size = 0;
+}
+
+// Sort
+
+#define LIST_SORT_INSERTION_THRESHOLD 16
+
+typedef struct listSortContext {
+    runtimeList* list;
+    Value* items;
+    uint32_t size;
+    Value comparator;
+} listSortContext;
+
+static inline bool sortLessNumber(Value v1, Value v2, listSortContext* ctx) {
+    (void) ctx;
+    return VALUE_NUMBER_VALUE(v1) < VALUE_NUMBER_VALUE(v2);
+}
+
+static inline bool sortLessString(Value v1, Value v2, listSortContext* ctx) {
+    (void) ctx;
+    return VALUE_STR_VALUE(v1) != VALUE_STR_VALUE(v2) && strcmp(VALUE_STR_VALUE(v1), VALUE_STR_VALUE(v2)) < 0;
+}
+
+static inline bool sortLessOperator(Value v1, Value v2, listSortContext* ctx) {
+    (void) ctx;
+    Value result = binaryOperation(v1, v2, OP_LESS);
+    if (VALUE_TYPE(result) != VAL_BOOL) runtimeError("Result of _less is not a boolean");
+    return VALUE_BOOL_VALUE(result);
+}
+
+static inline bool sortLessComparator(Value v1, Value v2, listSortContext* ctx) {
+    Value inputs[2] = {v1, v2};
+    Value result = execInput(ctx->comparator, NONE_VAL, inputs, 2);
+    if (VALUE_TYPE(result) != VAL_BOOL) runtimeError("Sort comparator did not return a boolean");
+    // The comparator runs script code, the items must stay put
+    if (ctx->list->list != ctx->items || ctx->list->size != ctx->size) listError("List modified during sort");
+    return VALUE_BOOL_VALUE(result);
+}
+
+#define SORT_SWAP(items, a, b) do { Value temp = (items)[a]; (items)[a] = (items)[b]; (items)[b] = temp; } while (0)
+
+// Introsort, instantiated per comparison. Elements only move by swapping so every
+// Value stays in the list while a comparator may trigger GC. Scans are bounds
+// checked, an inconsistent comparator gives an unspecified order but stays in range
+#define DEFINE_LIST_SORT(SUFFIX, LESS) \
+\
+static void insertionSort##SUFFIX(Value* items, uint32_t lo, uint32_t hi, listSortContext* ctx) { \
+    for (uint32_t i = lo + 1; i < hi; i++) { \
+        for (uint32_t j = i; j > lo && LESS(items[j], items[j - 1], ctx); j--) SORT_SWAP(items, j, j - 1); \
+    } \
+} \
+\
+static void siftDown##SUFFIX(Value* items, uint32_t base, uint32_t root, uint32_t n, listSortContext* ctx) { \
+    while (true) { \
+        uint32_t child = 2 * root + 1; \
+        if (child >= n) return; \
+        if (child + 1 < n && LESS(items[base + child], items[base + child + 1], ctx)) child++; \
+        if (!LESS(items[base + root], items[base + child], ctx)) return; \
+        SORT_SWAP(items, base + root, base + child); \
+        root = child; \
+    } \
+} \
+\
+static void heapSort##SUFFIX(Value* items, uint32_t lo, uint32_t hi, listSortContext* ctx) { \
+    uint32_t n = hi - lo; \
+    for (uint32_t i = n / 2; i-- > 0;) siftDown##SUFFIX(items, lo, i, n, ctx); \
+    for (uint32_t end = n - 1; end > 0; end--) { \
+        SORT_SWAP(items, lo, lo + end); \
+        siftDown##SUFFIX(items, lo, 0, end, ctx); \
+    } \
+} \
+\
+static void introSort##SUFFIX(Value* items, uint32_t lo, uint32_t hi, int depth, listSortContext* ctx) { \
+    while (hi - lo > LIST_SORT_INSERTION_THRESHOLD) { \
+        if (depth-- == 0) { \
+            heapSort##SUFFIX(items, lo, hi, ctx); \
+            return; \
+        } \
+        /* Median of three */ \
+        uint32_t mid = lo + (hi - lo) / 2; \
+        if (LESS(items[mid], items[lo], ctx)) SORT_SWAP(items, mid, lo); \
+        if (LESS(items[hi - 1], items[mid], ctx)) { \
+            SORT_SWAP(items, hi - 1, mid); \
+            if (LESS(items[mid], items[lo], ctx)) SORT_SWAP(items, mid, lo); \
+        } \
+        Value pivot = items[mid]; \
+        /* Hoare partition into [lo, j] and (j, hi) */ \
+        int64_t i = (int64_t) lo - 1; \
+        int64_t j = hi; \
+        while (true) { \
+            do i++; while (i < hi - 1 && LESS(items[i], pivot, ctx)); \
+            do j--; while (j > lo && LESS(pivot, items[j], ctx)); \
+            if (i >= j) break; \
+            SORT_SWAP(items, i, j); \
+        } \
+        uint32_t split = (uint32_t) j + 1; \
+        /* Recurse into the smaller side */ \
+        if (split - lo < hi - split) { \
+            introSort##SUFFIX(items, lo, split, depth, ctx); \
+            lo = split; \
+        } else { \
+            introSort##SUFFIX(items, split, hi, depth, ctx); \
+            hi = split; \
+        } \
+    } \
+    insertionSort##SUFFIX(items, lo, hi, ctx); \
+}
+
+DEFINE_LIST_SORT(Number, sortLessNumber)
+DEFINE_LIST_SORT(String, sortLessString)
+DEFINE_LIST_SORT(Operator, sortLessOperator)
+DEFINE_LIST_SORT(Comparator, sortLessComparator)
+
+void listSortElements(runtimeList* list, Value comparator) {
+    uint32_t size = list->size;
+    if (size < 2) return;
+    listSortContext ctx = {list, list->list, size, comparator};
+    int depth = 0;
+    for (uint32_t n = size; n > 1; n >>= 1) depth += 2;
+    if (!IS_INTERNAL_NULL(comparator)) {
+        if (VALUE_TYPE(comparator) != BUILTIN_CALLABLE) listError("Sort comparator is not callable");
+        introSortComparator(list->list, 0, size, depth, &ctx);
+        return;
+    }
+    // All number and all string lists compare inline
+    bool allNumbers = true;
+    bool allStrings = true;
+    for (uint32_t i = 0; i < size && (allNumbers || allStrings); i++) {
+        allNumbers &= VALUE_TYPE(list->list[i]) == VAL_NUMBER;
+        allStrings &= VALUE_TYPE(list->list[i]) == BUILTIN_STR;
+    }
+    if (allNumbers) {
+        introSortNumber(list->list, 0, size, depth, &ctx);
+    } else if (allStrings) {
+        introSortString(list->list, 0, size, depth, &ctx);
+    } else {
+        introSortOperator(list->list, 0, size, depth, &ctx);
+    }
+}
+
 void freeRuntimeList(runtimeList* list) {
     // Free the list and the structure
-    free(list->list);
-    free(list);
+    slabFree(list->list, sizeof(Value) * list->capacity);
+    slabFree(list, sizeof(runtimeList));
 }
 
 void printRuntimeList(runtimeList* list) {
@@ -108,208 +291,569 @@ void printRuntimeList(runtimeList* list) {
     printf("]");
 }
 
+runtimeNumArray* createRuntimeNumArray(uint32_t size) {
+    runtimeNumArray* array = (runtimeNumArray*) slabAlloc(sizeof(runtimeNumArray));
+    if (array == NULL) numArrayError("Failed to allocate memory for numArray.");
+    array->capacity = size < RUNTIME_NUM_ARRAY_INIT_SIZE ? RUNTIME_NUM_ARRAY_INIT_SIZE : size;
+    array->data = (double*) slabCalloc(sizeof(double) * array->capacity);
+    if (array->data == NULL) numArrayError("Failed to allocate memory for numArray elements.");
+    array->size = size;
+    return array;
+}
+
+void numArrayAddElement(runtimeNumArray* array, double value) {
+    if (array->size == array->capacity) {
+        if (array->size >= (UINT32_MAX/2)) numArrayError("numArray size exceeds maximum size during reallocation.");
+        uint32_t oldCapacity = array->capacity;
+        array->capacity *= 2;
+        double* newData = (double*) slabRealloc(array->data, sizeof(double) * oldCapacity, sizeof(double) * array->capacity);
+        if (newData == NULL) numArrayError("Failed to reallocate memory for numArray elements.");
+        array->data = newData;
+    }
+    array->data[array->size++] = value;
+}
+
+void numArraySetElement(runtimeNumArray* array, uint32_t index, double value) {
+    if (index >= array->size) numArrayError("numArray index out of range");
+    array->data[index] = value;
+}
+
+double numArrayGetElement(runtimeNumArray* array, uint32_t index) {
+    if (index >= array->size) numArrayError("numArray index out of range");
+    return array->data[index];
+}
+
+void freeRuntimeNumArray(runtimeNumArray* array) {
+    slabFree(array->data, sizeof(double) * array->capacity);
+    slabFree(array, sizeof(runtimeNumArray));
+}
+
+void printRuntimeNumArray(runtimeNumArray* array) {
+    printf("n[");
+    for (uint32_t i = 0; i < array->size; i++) {
+        printPrimitiveValue(NUMBER_VAL(array->data[i]));
+        if (i != array->size - 1) printf(", ");
+    }
+    printf("]");
+}
+
+// Mix the bit pattern. -0.0 and 0.0 compare equal, so they must share a hash
+static inline uint32_t hashNumber(double num) {
+    if (num == 0.0) num = 0.0;
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return (uint32_t) bits;
+}
+
 uint32_t hashObject(Value key) {
-    if (VALUE_TYPE(key) == VAL_NUMBER) { // Use number hashString
-        double num = VALUE_NUMBER_VALUE(key);
-        double r = fmod(num, (double) 1);
-        double epsilon = 1e-5; // Tolerance
-        while (fabs(r) >= epsilon) {
-            num *= 10;
-            r = fmod(num, (double) 1);
-        }
-        return (uint32_t) num;
-    } else if (VALUE_TYPE(key) == BUILTIN_STR) { // Use string hashString
-        return hashString(VALUE_STR_VALUE(key));
+    if (VALUE_TYPE(key) == VAL_NUMBER) {
+        return hashNumber(VALUE_NUMBER_VALUE(key));
+    } else if (VALUE_TYPE(key) == BUILTIN_STR) { // Use cached string hash
+        return STRING_HASH(VALUE_STR_VALUE(key));
     } else { // Search for hashString function
-        Value objHashFunc = ignoreNullGetAttr(key, "hashString");
+        Value objHashFunc = ignoreNullGetAttr(key, BUILTIN_SYMBOL(NAME_HASH_STRING));
         if (IS_INTERNAL_NULL(objHashFunc)) dictError("Hash function undefined.");
         Value valueObj = execInput(objHashFunc, key, NULL, 0);
         if (VALUE_TYPE(valueObj) != VAL_NUMBER) dictError("Non number type hashString function return.");
-        return (uint32_t) VALUE_NUMBER_VALUE(valueObj);
+        // Integral user hashes are used as is, anything else is mixed
+        double userHash = VALUE_NUMBER_VALUE(valueObj);
+        if (userHash > -9.2e18 && userHash < 9.2e18 && userHash == (double) (int64_t) userHash) return (uint32_t) (int64_t) userHash;
+        return hashNumber(userHash);
     }
 }
 
-#define MAX_LOAD_FACTOR 0.75
+// Dense entry arrays hold 7/8 of the slot count, so used and deleted slots stay below that load
+#define LOAD_FACTOR_NUMERATOR 7
+#define LOAD_FACTOR_DENOMINATOR 8
+#define TABLE_NOT_FOUND UINT32_MAX
+
+// Entries of either layout start with the key, followed by its cached hash
+#define TABLE_ENTRY(entries, entrySize, index) ((char*) (entries) + (size_t) (index) * (entrySize))
+#define TABLE_KEY(entries, entrySize, index) (*(Value*) TABLE_ENTRY(entries, entrySize, index))
+#define TABLE_HASH(entries, entrySize, index) (*(uint32_t*) (TABLE_ENTRY(entries, entrySize, index) + offsetof(runtimeDictEntry, hash)))
+
+_Static_assert(offsetof(runtimeDictEntry, hash) == offsetof(runtimeSetEntry, hash), "Dict and set entries must share the key and hash layout");
+
+// Group index uses the low hash bits, like the modulo of the chained table, so
+// sequential keys stay adjacent. The control byte takes the top 7 bits of a
+// multiplicative hash so it still filters well when the high bits are zero
+#define HASH_CTRL(hash) ((int8_t) (((uint32_t) (hash) * 0x9E3779B1U) >> 25))
+
+// Group matching, bit i of the result is set for slot i of the group
+static inline uint32_t groupMatch(const int8_t* group, int8_t ctrl) {
+#ifdef __SSE2__
+    __m128i ctrlBytes = _mm_loadu_si128((const __m128i*) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrlBytes, _mm_set1_epi8(ctrl)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < DICT_GROUP_SIZE; i++) if (group[i] == ctrl) mask |= 1U << i;
+    return mask;
+#endif
+}
 
-runtimeDict* createRuntimeDict(uint32_t size) {
-    runtimeDict* dict = (runtimeDict*) malloc(sizeof(runtimeDict));
-    if (dict == NULL) dictError("Failed to allocate memory for dict.");
-    dict->tableSize = size;
-    dict->numEntries = 0;
-    dict->entries = (runtimeDictEntry**) calloc(size, sizeof(runtimeDictEntry*));
-    if (dict->entries == NULL) dictError("Failed to allocate memory for dict entries.");
-    return dict;
+// Empty and deleted control bytes have the sign bit set
+static inline uint32_t groupMatchFree(const int8_t* group) {
+#ifdef __SSE2__
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < DICT_GROUP_SIZE; i++) if (group[i] < 0) mask |= 1U << i;
+    return mask;
+#endif
 }
 
-void resizeRuntimeDict(runtimeDict* dict, uint32_t newSize) {
-    runtimeDictEntry** newEntries = (runtimeDictEntry**) calloc(newSize, sizeof(runtimeDictEntry*));
-    if (newEntries == NULL) dictError("Failed to allocate memory for dict entries during resize");
-    // Rehash all entries
-    for (uint32_t i = 0; i < dict->tableSize; ++i) {
-        runtimeDictEntry* entry = dict->entries[i];
-        while (entry != NULL) {
-            uint32_t newHash = hashObject(entry->key) % newSize;
-            runtimeDictEntry* nextEntry = entry->next;
-            entry->next = newEntries[newHash];
-            newEntries[newHash] = entry;
-            entry = nextEntry;
+// Primitive keys compare inline, interned strings by pointer
+static inline bool dictKeysEqual(Value a, Value b) {
+    if (VALUE_TYPE(a) == VALUE_TYPE(b)) {
+        switch (VALUE_TYPE(a)) {
+            case BUILTIN_STR:
+                return VALUE_STR_VALUE(a) == VALUE_STR_VALUE(b);
+            case VAL_NUMBER:
+                // Exact, as hashNumber hashes the bits with -0.0 folded to 0.0
+                return VALUE_NUMBER_VALUE(a) == VALUE_NUMBER_VALUE(b);
+            case VAL_BOOL:
+                return VALUE_BOOL_VALUE(a) == VALUE_BOOL_VALUE(b);
+            case VAL_NONE:
+                return true;
+            default:
+                break;
         }
     }
+    return compareValue(a, b);
+}
 
-    free(dict->entries);
-    dict->entries = newEntries;
-    dict->tableSize = newSize;
+static inline uint32_t tableSizeFor(uint32_t size) {
+    uint32_t tableSize = DICT_GROUP_SIZE;
+    while (tableSize < size) {
+        if (tableSize >= (UINT32_MAX/2)) dictError("Hash table size exceeds maximum size");
+        tableSize <<= 1;
+    }
+    return tableSize;
 }
 
-void dictInsertElement(runtimeDict* dict, Value key, Value value) {
-    uint32_t hash = hashObject(key) % dict->tableSize;
-    runtimeDictEntry* entry = dict->entries[hash];
-    while (entry) {
-        if (compareValue(entry->key, key)) {
-            entry->value = value;  // Overwrite Value if key already exists
-            return;
+static inline uint32_t entryCapacityFor(uint32_t tableSize) {
+    return tableSize / LOAD_FACTOR_DENOMINATOR * LOAD_FACTOR_NUMERATOR;
+}
+
+// Smallest table size holding count entries
+static inline uint32_t tableSizeForEntries(uint32_t count) {
+    uint32_t tableSize = DICT_GROUP_SIZE;
+    while (entryCapacityFor(tableSize) < count) {
+        if (tableSize >= (UINT32_MAX/2)) dictError("Hash table size exceeds maximum size");
+        tableSize <<= 1;
+    }
+    return tableSize;
+}
+
+// Probe group by group, groups are visited in triangular order. Returns the slot
+static uint32_t tableFindSlot(runtimeTable* table, size_t entrySize, Value key, uint32_t hash) {
+    uint32_t groupMask = table->tableSize / DICT_GROUP_SIZE - 1;
+    uint32_t group = hash & groupMask;
+    int8_t hashCtrl = HASH_CTRL(hash);
+    for (uint32_t step = 1; ; step++) {
+        const int8_t* groupCtrl = table->ctrl + group * DICT_GROUP_SIZE;
+        uint32_t match = groupMatch(groupCtrl, hashCtrl);
+        while (match != 0) {
+            uint32_t slot = group * DICT_GROUP_SIZE + __builtin_ctz(match);
+            uint32_t index = table->slots[slot];
+            if (TABLE_HASH(table->entries, entrySize, index) == hash && dictKeysEqual(TABLE_KEY(table->entries, entrySize, index), key)) return slot;
+            match &= match - 1;
         }
-        entry = entry->next;
+        // An empty slot ends the probe sequence
+        if (groupMatch(groupCtrl, DICT_CTRL_EMPTY) != 0) return TABLE_NOT_FOUND;
+        group = (group + step) & groupMask;
     }
-    // Key does not exist in dict, create new entry
-    entry = (runtimeDictEntry*) malloc(sizeof(runtimeDictEntry));
-    if (entry == NULL) dictError("Failed to allocate memory for dict entry");
-    entry->key = key;
-    entry->value = value;
-    entry->next = dict->entries[hash];  // Insert at head of linked list
-    dict->entries[hash] = entry;
-    dict->numEntries++;
+}
 
-    // Check if resize is needed
-    if ((float)dict->numEntries / (float) dict->tableSize > MAX_LOAD_FACTOR) {
-        if (dict->tableSize >= (UINT32_MAX/2)) dictError("Dict size exceeds maximum size during reallocation");
-        resizeRuntimeDict(dict, dict->tableSize * 2);
+// First empty or deleted slot on the probe sequence of hash
+static uint32_t tableFindFree(const int8_t* ctrl, uint32_t tableSize, uint32_t hash) {
+    uint32_t groupMask = tableSize / DICT_GROUP_SIZE - 1;
+    uint32_t group = hash & groupMask;
+    for (uint32_t step = 1; ; step++) {
+        uint32_t match = groupMatchFree(ctrl + group * DICT_GROUP_SIZE);
+        if (match != 0) return group * DICT_GROUP_SIZE + __builtin_ctz(match);
+        group = (group + step) & groupMask;
     }
 }
 
-Value dictGetElement(runtimeDict* dict, Value key) {
-    uint32_t hash = hashObject(key) % dict->tableSize;
-    runtimeDictEntry* entry = dict->entries[hash];
-    while (entry) {
-        if (compareValue(entry->key, key)) return entry->value;
-        entry = entry->next;
+// Integral keys in [0, RUNTIME_INT_INDEX_MAX_KEY) can use the direct index
+static inline bool intIndexKey(Value key, uint32_t* intKey) {
+    if (VALUE_TYPE(key) != VAL_NUMBER) return false;
+    double num = VALUE_NUMBER_VALUE(key);
+    if (!(num >= 0 && num < RUNTIME_INT_INDEX_MAX_KEY)) return false;
+    uint32_t result = (uint32_t) num;
+    if ((double) result != num) return false;
+    *intKey = result;
+    return true;
+}
+
+static void tableInit(runtimeTable* table, uint32_t size, size_t entrySize) {
+    table->tableSize = tableSizeFor(size);
+    table->numEntries = 0;
+    table->entryCount = 0;
+    table->entryCapacity = entryCapacityFor(table->tableSize);
+    // Hash index is allocated once a key needs it
+    table->ctrl = NULL;
+    table->slots = NULL;
+    table->intKeyed = true;
+    table->version = 0;
+    table->intIndex = NULL;
+    table->intIndexSize = 0;
+    table->entries = slabAlloc(entrySize * table->entryCapacity);
+    if (table->entries == NULL) dictError("Failed to allocate memory for hash table entries.");
+}
+
+static void tableFree(runtimeTable* table, size_t entrySize) {
+    if (table->intKeyed) {
+        slabFree(table->intIndex, sizeof(uint32_t) * table->intIndexSize);
+    } else {
+        slabFree(table->ctrl, table->tableSize);
+        slabFree(table->slots, sizeof(uint32_t) * table->tableSize);
     }
-    dictError("Key not found in dictionary");
-    return INTERNAL_NULL_VAL;
+    slabFree(table->entries, entrySize * table->entryCapacity);
 }
 
-bool dictContainsElement(runtimeDict* dict, Value key) {
-    uint32_t hash = hashObject(key) % dict->tableSize;
-    runtimeDictEntry* entry = dict->entries[hash];
-    while (entry) {
-        if (compareValue(entry->key, key)) return true;
-        entry = entry->next;
+// Rebuild the active index from the dense entries, hashed keys use their cached hash
+static void tableBuildIndex(runtimeTable* table, size_t entrySize) {
+    if (table->intKeyed) {
+        // An empty integer keyed table has no index allocated yet
+        if (table->intIndex != NULL) memset(table->intIndex, 0, sizeof(uint32_t) * table->intIndexSize);
+        for (uint32_t i = 0; i < table->entryCount; i++) {
+            Value key = TABLE_KEY(table->entries, entrySize, i);
+            if (!IS_INTERNAL_NULL(key)) table->intIndex[(uint32_t) VALUE_NUMBER_VALUE(key)] = i + 1;
+        }
+        return;
+    }
+    memset(table->ctrl, DICT_CTRL_EMPTY, table->tableSize);
+    for (uint32_t i = 0; i < table->entryCount; i++) {
+        if (IS_INTERNAL_NULL(TABLE_KEY(table->entries, entrySize, i))) continue;
+        uint32_t hash = TABLE_HASH(table->entries, entrySize, i);
+        uint32_t slot = tableFindFree(table->ctrl, table->tableSize, hash);
+        table->ctrl[slot] = HASH_CTRL(hash);
+        table->slots[slot] = i;
     }
-    return false;
 }
 
-void dictRemoveElement(runtimeDict* dict, Value key) {
-    uint32_t hash = hashObject(key) % dict->tableSize;
-    runtimeDictEntry* entry = dict->entries[hash];
-    runtimeDictEntry* prevEntry = NULL;
-    while (entry) {
-        if (compareValue(entry->key, key)) {
-            if (prevEntry) {
-                prevEntry->next = entry->next;
-            } else {
-                dict->entries[hash] = entry->next;
-            }
-            free(entry);
-            dict->numEntries--;
+// Leave the direct integer index for good, hashing the keys it held
+static void tableConvertToHashed(runtimeTable* table, size_t entrySize) {
+    for (uint32_t i = 0; i < table->entryCount; i++) {
+        Value key = TABLE_KEY(table->entries, entrySize, i);
+        if (!IS_INTERNAL_NULL(key)) TABLE_HASH(table->entries, entrySize, i) = hashNumber(VALUE_NUMBER_VALUE(key));
+    }
+    slabFree(table->intIndex, sizeof(uint32_t) * table->intIndexSize);
+    table->intKeyed = false;
+    table->intIndex = NULL;
+    table->intIndexSize = 0;
+    table->ctrl = (int8_t*) slabAlloc(table->tableSize);
+    table->slots = (uint32_t*) slabAlloc(sizeof(uint32_t) * table->tableSize);
+    if (table->ctrl == NULL || table->slots == NULL) dictError("Failed to allocate memory for hash table index.");
+    tableBuildIndex(table, entrySize);
+}
 
-            return;
-        }
-        prevEntry = entry;
-        entry = entry->next;
+// Grow the direct index to cover intKey. Returns false if keys are too sparse for it
+static bool tableGrowIntIndex(runtimeTable* table, uint32_t intKey) {
+    uint32_t newSize = table->intIndexSize == 0 ? RUNTIME_INT_INDEX_MIN_SIZE : table->intIndexSize;
+    while (newSize <= intKey) newSize *= 2;
+    if (newSize > RUNTIME_INT_INDEX_MIN_SIZE && newSize / RUNTIME_INT_INDEX_MAX_SPARSITY > table->numEntries + 1) return false;
+    uint32_t* newIndex = (uint32_t*) slabRealloc(table->intIndex, sizeof(uint32_t) * table->intIndexSize, sizeof(uint32_t) * newSize);
+    if (newIndex == NULL) dictError("Failed to allocate memory for integer key index.");
+    memset(newIndex + table->intIndexSize, 0, sizeof(uint32_t) * (newSize - table->intIndexSize));
+    table->intIndex = newIndex;
+    table->intIndexSize = newSize;
+    return true;
+}
+
+// Resize entries and index storage, the caller rebuilds the index
+static void tableResize(runtimeTable* table, size_t entrySize, uint32_t newSize) {
+    uint32_t newCapacity = entryCapacityFor(newSize);
+    table->entries = slabRealloc(table->entries, entrySize * table->entryCapacity, entrySize * newCapacity);
+    if (table->entries == NULL) dictError("Failed to allocate memory during hash table resize.");
+    if (!table->intKeyed) {
+        slabFree(table->ctrl, table->tableSize);
+        slabFree(table->slots, sizeof(uint32_t) * table->tableSize);
+        table->ctrl = (int8_t*) slabAlloc(newSize);
+        table->slots = (uint32_t*) slabAlloc(sizeof(uint32_t) * newSize);
+        if (table->ctrl == NULL || table->slots == NULL) dictError("Failed to allocate memory during hash table resize.");
     }
-    dictError("Key not found in dictionary");
+    table->tableSize = newSize;
+    table->entryCapacity = newCapacity;
 }
 
-Value dictStrGet(runtimeDict* dict, char* key) {
-    uint32_t hash = hashString(key) % dict->tableSize;
-    runtimeDictEntry* entry = dict->entries[hash];
-    while (entry) {
-        if (strcmp(VALUE_STR_VALUE(entry->key), key) == 0) return entry->key;
-        entry = entry->next;
+// Squeeze out removed entries keeping insertion order, grow when live entries need it
+static void tableRehash(runtimeTable* table, size_t entrySize) {
+    uint32_t liveCount = 0;
+    for (uint32_t i = 0; i < table->entryCount; i++) {
+        if (IS_INTERNAL_NULL(TABLE_KEY(table->entries, entrySize, i))) continue;
+        if (liveCount != i) memcpy(TABLE_ENTRY(table->entries, entrySize, liveCount), TABLE_ENTRY(table->entries, entrySize, i), entrySize);
+        liveCount++;
+    }
+    table->entryCount = liveCount;
+    table->version++;
+
+    if ((uint64_t) table->numEntries * 2 >= table->entryCapacity) {
+        if (table->tableSize >= (UINT32_MAX/2)) dictError("Hash table size exceeds maximum size during reallocation");
+        tableResize(table, entrySize, table->tableSize * 2);
     }
-    return INTERNAL_NULL_VAL;
+    tableBuildIndex(table, entrySize);
 }
 
-Value dictNumGet(runtimeDict* dict, double key) {
-    double num = key;
-    double r = fmod(num, (double) 1);
-    double epsilon = 1e-5; // Tolerance
-    while (fabs(r) >= epsilon) {
-        num *= 10;
-        r = fmod(num, (double) 1);
+// Grow once so count more entries append without a rehash
+static void tableReserve(runtimeTable* table, size_t entrySize, uint32_t count) {
+    if ((uint64_t) table->entryCount + count <= table->entryCapacity) return;
+    if ((uint64_t) table->entryCount + count >= UINT32_MAX/2) dictError("Hash table size exceeds maximum size during reallocation");
+    tableResize(table, entrySize, tableSizeForEntries(table->entryCount + count));
+    tableBuildIndex(table, entrySize);
+}
+
+// Hash of a stored key. Integer keyed tables never hashed theirs
+static inline uint32_t tableEntryHash(runtimeTable* table, size_t entrySize, uint32_t index) {
+    if (table->intKeyed) return hashNumber(VALUE_NUMBER_VALUE(TABLE_KEY(table->entries, entrySize, index)));
+    return TABLE_HASH(table->entries, entrySize, index);
+}
+
+// Dense entry index of key, or TABLE_NOT_FOUND. Reports the slot for hashed tables.
+// hash is only read by hashed tables
+static uint32_t tableFindWithHash(runtimeTable* table, size_t entrySize, Value key, uint32_t hash, uint32_t* slotOut) {
+    if (table->intKeyed) {
+        // Only integer keys are stored while the direct index is active
+        uint32_t intKey;
+        if (!intIndexKey(key, &intKey) || intKey >= table->intIndexSize || table->intIndex[intKey] == 0) return TABLE_NOT_FOUND;
+        if (slotOut != NULL) *slotOut = intKey;
+        return table->intIndex[intKey] - 1;
+    }
+    uint32_t slot = tableFindSlot(table, entrySize, key, hash);
+    if (slot == TABLE_NOT_FOUND) return TABLE_NOT_FOUND;
+    if (slotOut != NULL) *slotOut = slot;
+    return table->slots[slot];
+}
+
+static inline uint32_t tableFind(runtimeTable* table, size_t entrySize, Value key, uint32_t* slotOut) {
+    return tableFindWithHash(table, entrySize, key, table->intKeyed ? 0 : hashObject(key), slotOut);
+}
+
+// Dense entry index of key, appending an entry if it is absent. Without
+// hashKnown the key is hashed once the table needs it
+static uint32_t tableInsertWithHash(runtimeTable* table, size_t entrySize, Value key, uint32_t hash, bool hashKnown, bool* inserted) {
+    uint32_t intKey = 0;
+    if (table->intKeyed) {
+        if (intIndexKey(key, &intKey) && (intKey < table->intIndexSize || tableGrowIntIndex(table, intKey))) {
+            if (table->intIndex[intKey] != 0) {
+                *inserted = false;
+                return table->intIndex[intKey] - 1;
+            }
+        } else {
+            tableConvertToHashed(table, entrySize);
+        }
+    }
+    if (!table->intKeyed) {
+        if (!hashKnown) hash = hashObject(key);
+        uint32_t slot = tableFindSlot(table, entrySize, key, hash);
+        if (slot != TABLE_NOT_FOUND) {
+            *inserted = false;
+            return table->slots[slot];
+        }
     }
-    uint32_t hash = (uint32_t) num % dict->tableSize;
-    runtimeDictEntry* entry = dict->entries[hash];
-    while (entry) {
-        if (VALUE_NUMBER_VALUE(entry->key) == key) return entry->key;
-        entry = entry->next;
+
+    if (table->entryCount == table->entryCapacity) tableRehash(table, entrySize);
+    uint32_t index = table->entryCount++;
+    if (table->intKeyed) {
+        table->intIndex[intKey] = index + 1;
+    } else {
+        uint32_t slot = tableFindFree(table->ctrl, table->tableSize, hash);
+        table->ctrl[slot] = HASH_CTRL(hash);
+        table->slots[slot] = index;
     }
-    return INTERNAL_NULL_VAL;
+    TABLE_KEY(table->entries, entrySize, index) = key;
+    TABLE_HASH(table->entries, entrySize, index) = table->intKeyed ? 0 : hash;
+    table->numEntries++;
+    table->version++;
+    *inserted = true;
+    return index;
 }
 
-void freeRuntimeDict(runtimeDict* dict) {
-    for (uint32_t i = 0; i < dict->tableSize; i++) {
-        runtimeDictEntry* entry = dict->entries[i];
-        while (entry != NULL) {
-            runtimeDictEntry* temp = entry;
-            entry = entry->next;
-            free(temp);
+static inline uint32_t tableInsert(runtimeTable* table, size_t entrySize, Value key, bool* inserted) {
+    return tableInsertWithHash(table, entrySize, key, 0, false, inserted);
+}
+
+// Removed entries leave a hole in the dense array until the next rehash
+static uint32_t tableRemove(runtimeTable* table, size_t entrySize, Value key) {
+    uint32_t slot;
+    uint32_t index = tableFind(table, entrySize, key, &slot);
+    if (index == TABLE_NOT_FOUND) return TABLE_NOT_FOUND;
+    if (table->intKeyed) {
+        table->intIndex[slot] = 0;
+    } else {
+        table->ctrl[slot] = DICT_CTRL_DELETED;
+    }
+    TABLE_KEY(table->entries, entrySize, index) = INTERNAL_NULL_VAL;
+    table->numEntries--;
+    table->version++;
+    return index;
+}
+
+runtimeDict* createRuntimeDict(uint32_t size) {
+    runtimeDict* dict = (runtimeDict*) slabAlloc(sizeof(runtimeDict));
+    if (dict == NULL) dictError("Failed to allocate memory for dict.");
+    tableInit(&dict->table, size, sizeof(runtimeDictEntry));
+    return dict;
+}
+
+void dictInsertElement(runtimeDict* dict, Value key, Value value) {
+    bool inserted;
+    uint32_t index = tableInsert(&dict->table, sizeof(runtimeDictEntry), key, &inserted);
+    // Overwrites Value if key already exists
+    DICT_ENTRIES(dict)[index].value = value;
+}
+
+Value dictGetElement(runtimeDict* dict, Value key) {
+    uint32_t index = tableFind(&dict->table, sizeof(runtimeDictEntry), key, NULL);
+    if (index == TABLE_NOT_FOUND) dictError("Key not found in dictionary");
+    return DICT_ENTRIES(dict)[index].value;
+}
+
+bool dictContainsElement(runtimeDict* dict, Value key) {
+    return tableFind(&dict->table, sizeof(runtimeDictEntry), key, NULL) != TABLE_NOT_FOUND;
+}
+
+void dictRemoveElement(runtimeDict* dict, Value key) {
+    uint32_t index = tableRemove(&dict->table, sizeof(runtimeDictEntry), key);
+    if (index == TABLE_NOT_FOUND) dictError("Key not found in dictionary");
+    // Release the value for GC, the hole keeps no references
+    DICT_ENTRIES(dict)[index].value = INTERNAL_NULL_VAL;
+}
+
+Value dictStrGet(runtimeDict* dict, char* key) {
+    runtimeTable* table = &dict->table;
+    // A string that is not interned cannot be a key, nor can any string of an integer keyed dict
+    char* internedKey = findInterned(key);
+    if (internedKey == NULL || table->intKeyed) return INTERNAL_NULL_VAL;
+    uint32_t hash = STRING_HASH(internedKey);
+    uint32_t groupMask = table->tableSize / DICT_GROUP_SIZE - 1;
+    uint32_t group = hash & groupMask;
+    int8_t hashCtrl = HASH_CTRL(hash);
+    for (uint32_t step = 1; ; step++) {
+        const int8_t* groupCtrl = table->ctrl + group * DICT_GROUP_SIZE;
+        uint32_t match = groupMatch(groupCtrl, hashCtrl);
+        while (match != 0) {
+            runtimeDictEntry* entry = &DICT_ENTRIES(dict)[table->slots[group * DICT_GROUP_SIZE + __builtin_ctz(match)]];
+            if (VALUE_TYPE(entry->key) == BUILTIN_STR && VALUE_STR_VALUE(entry->key) == internedKey) return entry->key;
+            match &= match - 1;
         }
+        if (groupMatch(groupCtrl, DICT_CTRL_EMPTY) != 0) return INTERNAL_NULL_VAL;
+        group = (group + step) & groupMask;
     }
-    free(dict->entries);
-    free(dict);
+}
+
+Value dictNumGet(runtimeDict* dict, double key) {
+    uint32_t index = tableFind(&dict->table, sizeof(runtimeDictEntry), NUMBER_VAL(key), NULL);
+    if (index == TABLE_NOT_FOUND) return INTERNAL_NULL_VAL;
+    return DICT_ENTRIES(dict)[index].key;
+}
+
+void freeRuntimeDict(runtimeDict* dict) {
+    tableFree(&dict->table, sizeof(runtimeDictEntry));
+    slabFree(dict, sizeof(runtimeDict));
 }
 
 runtimeSet* createRuntimeSet(uint32_t size) {
-    runtimeSet* set = (runtimeSet*) malloc(sizeof(runtimeSet));
+    runtimeSet* set = (runtimeSet*) slabAlloc(sizeof(runtimeSet));
     if (set == NULL) setError("Failed to allocate memory for set");
-    set->dict = createRuntimeDict(size);
+    tableInit(&set->table, size, sizeof(runtimeSetEntry));
     return set;
 }
 
 void setInsertElement(runtimeSet* set, Value key) {
-    dictInsertElement(set->dict, key, INTERNAL_NULL_VAL);
+    bool inserted;
+    tableInsert(&set->table, sizeof(runtimeSetEntry), key, &inserted);
 }
 
 bool setContainsElement(runtimeSet* set, Value key) {
-    return dictContainsElement(set->dict, key);
+    return tableFind(&set->table, sizeof(runtimeSetEntry), key, NULL) != TABLE_NOT_FOUND;
 }
 
 void setRemoveElement(runtimeSet* set, Value key) {
-    dictRemoveElement(set->dict, key);
+    if (tableRemove(&set->table, sizeof(runtimeSetEntry), key) == TABLE_NOT_FOUND) setError("Key not found in set");
+}
+
+// Set algebra. Results go to an empty set, sized once. Keys move between
+// tables with their cached hash, so only equal hashes reach _eq
+
+static inline void setInsertFrom(runtimeSet* result, runtimeTable* source, uint32_t index) {
+    bool inserted;
+    tableInsertWithHash(&result->table, sizeof(runtimeSetEntry), TABLE_KEY(source->entries, sizeof(runtimeSetEntry), index),
+                        tableEntryHash(source, sizeof(runtimeSetEntry), index), true, &inserted);
+}
+
+static inline bool setContainsFrom(runtimeSet* set, runtimeTable* source, uint32_t index) {
+    return tableFindWithHash(&set->table, sizeof(runtimeSetEntry), TABLE_KEY(source->entries, sizeof(runtimeSetEntry), index),
+                             tableEntryHash(source, sizeof(runtimeSetEntry), index), NULL) != TABLE_NOT_FOUND;
+}
+
+void setUnion(runtimeSet* result, runtimeSet* a, runtimeSet* b) {
+    tableReserve(&result->table, sizeof(runtimeSetEntry), a->table.numEntries + b->table.numEntries);
+    for (uint32_t i = 0; i < a->table.entryCount; i++) {
+        if (!IS_INTERNAL_NULL(SET_ENTRIES(a)[i].key)) setInsertFrom(result, &a->table, i);
+    }
+    for (uint32_t i = 0; i < b->table.entryCount; i++) {
+        if (!IS_INTERNAL_NULL(SET_ENTRIES(b)[i].key)) setInsertFrom(result, &b->table, i);
+    }
+}
+
+void setIntersect(runtimeSet* result, runtimeSet* a, runtimeSet* b) {
+    // Probe the larger set with keys of the smaller
+    runtimeSet* smaller = a->table.numEntries <= b->table.numEntries ? a : b;
+    runtimeSet* larger = smaller == a ? b : a;
+    tableReserve(&result->table, sizeof(runtimeSetEntry), smaller->table.numEntries);
+    for (uint32_t i = 0; i < smaller->table.entryCount; i++) {
+        if (IS_INTERNAL_NULL(SET_ENTRIES(smaller)[i].key)) continue;
+        if (setContainsFrom(larger, &smaller->table, i)) setInsertFrom(result, &smaller->table, i);
+    }
+}
+
+void setDifference(runtimeSet* result, runtimeSet* a, runtimeSet* b) {
+    tableReserve(&result->table, sizeof(runtimeSetEntry), a->table.numEntries);
+    for (uint32_t i = 0; i < a->table.entryCount; i++) {
+        if (IS_INTERNAL_NULL(SET_ENTRIES(a)[i].key)) continue;
+        if (!setContainsFrom(b, &a->table, i)) setInsertFrom(result, &a->table, i);
+    }
+}
+
+bool setIsSubset(runtimeSet* a, runtimeSet* b) {
+    if (a->table.numEntries > b->table.numEntries) return false;
+    for (uint32_t i = 0; i < a->table.entryCount; i++) {
+        if (IS_INTERNAL_NULL(SET_ENTRIES(a)[i].key)) continue;
+        if (!setContainsFrom(b, &a->table, i)) return false;
+    }
+    return true;
+}
+
+void setAddList(runtimeSet* set, runtimeList* list) {
+    tableReserve(&set->table, sizeof(runtimeSetEntry), list->size);
+    for (uint32_t i = 0; i < list->size; i++) setInsertElement(set, list->list[i]);
 }
 
 void freeRuntimeSet(runtimeSet* set) {
-    freeRuntimeDict(set->dict);
-    free(set);
+    tableFree(&set->table, sizeof(runtimeSetEntry));
+    slabFree(set, sizeof(runtimeSet));
 }
 
 void printRuntimeSet(runtimeSet* set) {
-    runtimeDict* dict = set->dict;
     bool first = true;
     printf("s{");
-    for (uint32_t i = 0; i < dict->tableSize; i++) {
-        runtimeDictEntry* entry = dict->entries[i];
-        while (entry) {
-            if (first) {
-                first = false;
-            } else {
-                printf(", ");
-            }
-            DSPrintValue(entry->key);
-
-            entry = entry->next;
+    for (uint32_t i = 0; i < set->table.entryCount; i++) {
+        runtimeSetEntry* entry = &SET_ENTRIES(set)[i];
+        if (IS_INTERNAL_NULL(entry->key)) continue;
+        if (first) {
+            first = false;
+        } else {
+            printf(", ");
         }
+        DSPrintValue(entry->key);
     }
     printf("}");
 }
@@ -317,20 +861,17 @@ void printRuntimeSet(runtimeSet* set) {
 void printRuntimeDict(runtimeDict* dict) {
     bool first = true;
     printf("d{");
-    for (uint32_t i = 0; i < dict->tableSize; i++) {
-        runtimeDictEntry* entry = dict->entries[i];
-        while (entry) {
-            if (first) {
-                first = false;
-            } else {
-                printf(", ");
-            }
-            DSPrintValue(entry->key);
-            printf(":");
-            DSPrintValue(entry->value);
-
-            entry = entry->next;
+    for (uint32_t i = 0; i < dict->table.entryCount; i++) {
+        runtimeDictEntry* entry = &DICT_ENTRIES(dict)[i];
+        if (IS_INTERNAL_NULL(entry->key)) continue;
+        if (first) {
+            first = false;
+        } else {
+            printf(", ");
         }
+        DSPrintValue(entry->key);
+        printf(":");
+        DSPrintValue(entry->value);
     }
     printf("}");
 }
@@ -340,7 +881,7 @@ void DSPrintValue(Value val) {
         printf("NULL");
         return;
     }
-    Value printFunc = ignoreNullGetAttr(val, "print");
+    Value printFunc = ignoreNullGetAttr(val, BUILTIN_SYMBOL(NAME_PRINT));
     if (!IS_INTERNAL_NULL(printFunc)) {
         execInput(printFunc, val, NULL, 0);
     } else if (VALUE_TYPE(val) == BUILTIN_CALLABLE) {
@@ -15,24 +15,64 @@ struct runtimeList {
     uint32_t capacity;
 };
 
+// Unboxed doubles, the GC marks the owning object only
+struct runtimeNumArray {
+    double* data;
+    uint32_t size;
+    uint32_t capacity;
+};
+
+// Dict and set keep entries in a dense insertion-ordered array, indexed by an
+// open addressing table with one control byte per slot that is probed
+// DICT_GROUP_SIZE slots at a time
+#define DICT_GROUP_SIZE 16
+#define DICT_CTRL_EMPTY ((int8_t) 0x80)
+#define DICT_CTRL_DELETED ((int8_t) 0xFE)
+// Full slots store 7 bits derived from the key hash
+#define DICT_CTRL_IS_FULL(ctrl) ((ctrl) >= 0)
+
 typedef struct runtimeDictEntry runtimeDictEntry;
+typedef struct runtimeSetEntry runtimeSetEntry;
 
+// Key and cached hash lead both entry layouts, removed entries have an INTERNAL_NULL key
 struct runtimeDictEntry {
     Value key;
+    uint32_t hash;
     Value value;
-    runtimeDictEntry* next;
 };
 
-struct runtimeDict {
+struct runtimeSetEntry {
+    Value key;
+    uint32_t hash;
+};
+
+// Shared by dict and set. While every key is a small non-negative integer the
+// table indexes entries directly by key and the hash index is not allocated
+typedef struct runtimeTable {
     uint32_t tableSize;
     uint32_t numEntries;
-    runtimeDictEntry** entries;
+    uint32_t entryCount; // Dense entries in use, including removed ones
+    uint32_t entryCapacity;
+    int8_t* ctrl;
+    uint32_t* slots; // Dense entry index of each full slot
+    bool intKeyed;
+    uint32_t version; // Bumped when keys are added, removed or moved, checked by for-in
+    uint32_t* intIndex; // Dense entry index + 1 by key, 0 if absent
+    uint32_t intIndexSize;
+    void* entries;
+} runtimeTable;
+
+struct runtimeDict {
+    runtimeTable table;
 };
 
 struct runtimeSet {
-    runtimeDict* dict;
+    runtimeTable table;
 };
 
+#define DICT_ENTRIES(dict) ((runtimeDictEntry*) (dict)->table.entries)
+#define SET_ENTRIES(set) ((runtimeSetEntry*) (set)->table.entries)
+
 // List functions
 runtimeList* createRuntimeList(uint32_t size);
 void listAddElement(runtimeList* list, Value value);
@@ -43,6 +83,17 @@ void listRemoveElement(runtimeList* list, uint32_t index);
 Value listGetElement(runtimeList* list, uint32_t index);
 bool listContainsElement(runtimeList* list, Value value);
 uint32_t listIndexOfElement(runtimeList* list, Value value);
+void listAppendRange(runtimeList* list, runtimeList* source, uint32_t start, uint32_t end);
+void listReverseElements(runtimeList* list);
+void listClearElements(runtimeList* list);
+// Sorts with _less, or with comparator(a, b) returning a before b when comparator is not INTERNAL_NULL
+void listSortElements(runtimeList* list, Value comparator);
+
+// Num array functions
+runtimeNumArray* createRuntimeNumArray(uint32_t size);
+void numArrayAddElement(runtimeNumArray* array, double value);
+void numArraySetElement(runtimeNumArray* array, uint32_t index, double value);
+double numArrayGetElement(runtimeNumArray* array, uint32_t index);
 
 // Dict functions
 runtimeDict* createRuntimeDict(uint32_t size);
@@ -61,6 +112,13 @@ void setInsertElement(runtimeSet* set, Value key);
 bool setContainsElement(runtimeSet* set, Value key);
 void setRemoveElement(runtimeSet* set, Value key);
 
+// Set algebra, result must be an empty set
+void setUnion(runtimeSet* result, runtimeSet* a, runtimeSet* b);
+void setIntersect(runtimeSet* result, runtimeSet* a, runtimeSet* b);
+void setDifference(runtimeSet* result, runtimeSet* a, runtimeSet* b);
+bool setIsSubset(runtimeSet* a, runtimeSet* b);
+void setAddList(runtimeSet* set, runtimeList* list);
+
 // General Purpose Functions
 uint32_t hashObject(Value key);
 void DSPrintValue(Value val);
@@ -6,9 +6,13 @@
 #include "errors.h"
 #include "vm.h"
 
-RuntimeMemoryManager* memoryManager;
+#include <stdlib.h>
+#include <string.h>
+#ifdef PRINT_GC_PAUSE
+#include <time.h>
+#endif
 
-Object* rtHead;
+RuntimeMemoryManager* memoryManager;
 
 static inline void newBlock() {
 #ifdef PRINT_MEMORY_INFO
@@ -16,241 +20,389 @@ static inline void newBlock() {
 #endif
     RuntimeBlock* newBlock = (RuntimeBlock*) malloc(sizeof(RuntimeBlock));
     if (newBlock == NULL) objManagerError("Memory allocation failed for new block");
-    newBlock->nextBlock = memoryManager->headBlock;
-    memoryManager->headBlock = newBlock;
-    uint16_t newBlockID = newBlock->nextBlock == NULL ? 0 : newBlock->nextBlock->blockID + 1;
+    uint32_t newBlockID = memoryManager->blockCount++;
     newBlock->blockID = newBlockID;
-    // Insert new free slots
-    Object** stackTop = memoryManager->freeStackTop;
-    Object* newSlot = (Object*) newBlock->block;
-    for (int i = 0; i < RUNTIME_BLOCK_SIZE; i++) {
-        newSlot->blockID = newBlockID;
-        *stackTop++ = newSlot++;
+    atomic_init(&newBlock->markBitMap, 0);
+    newBlock->liveBitMap = 0;
+    // Register block for lookup by blockID
+    if (newBlockID == memoryManager->blockTableCapacity) {
+        memoryManager->blockTableCapacity *= 2;
+        memoryManager->blockTable = (RuntimeBlock**) realloc(memoryManager->blockTable, sizeof(RuntimeBlock*) * memoryManager->blockTableCapacity);
+        if (memoryManager->blockTable == NULL) objManagerError("Memory allocation failed for block table");
+    }
+    memoryManager->blockTable[newBlockID] = newBlock;
+    // Slots keep their blockID for their whole lifetime
+    for (int i = 0; i < RUNTIME_BLOCK_SIZE; i++) newBlock->block[i].blockID = newBlockID;
+}
+
+// Forward declaration
+static void* markWorkerThread(void* arg);
+
+static inline uint32_t markThreadCount() {
+    uint32_t threadCount = GC_MARK_THREAD_COUNT;
+    // Runtime override
+    char* envCount = getenv("CJ_GC_THREADS");
+    if (envCount != NULL) {
+        int count = atoi(envCount);
+        if (count > 0) threadCount = (uint32_t) count;
+    }
+    if (threadCount > GC_MAX_MARK_THREADS) threadCount = GC_MAX_MARK_THREADS;
+    return threadCount;
+}
+
+static inline void initMarkerPool() {
+    MarkerPool* pool = (MarkerPool*) malloc(sizeof(MarkerPool));
+    if (pool == NULL) objManagerError("Memory allocation failed for marker pool");
+    memoryManager->markerPool = pool;
+    pool->threadCount = markThreadCount();
+    pool->workers = (MarkWorker*) malloc(sizeof(MarkWorker) * pool->threadCount);
+    if (pool->workers == NULL) objManagerError("Memory allocation failed for mark workers");
+    for (uint32_t i = 0; i < pool->threadCount; i++) {
+        MarkWorker* worker = &pool->workers[i];
+        worker->markStackCount = 0;
+        worker->markStackCapacity = GC_MARK_STACK_INIT_SIZE;
+        worker->markStack = (Object**) malloc(sizeof(Object*) * GC_MARK_STACK_INIT_SIZE);
+        if (worker->markStack == NULL) objManagerError("Memory allocation failed for mark stack");
+    }
+    pool->grayQueueCount = 0;
+    pool->grayQueueCapacity = GC_MARK_STACK_INIT_SIZE;
+    pool->grayQueue = (Object**) malloc(sizeof(Object*) * GC_MARK_STACK_INIT_SIZE);
+    if (pool->grayQueue == NULL) objManagerError("Memory allocation failed for gray queue");
+    atomic_init(&pool->idleCount, 0);
+    pool->markDone = false;
+    pool->markEpoch = 0;
+    pool->finishedCount = 0;
+    pool->shutdown = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workAvailable, NULL);
+    pthread_cond_init(&pool->markStart, NULL);
+    pthread_cond_init(&pool->markFinished, NULL);
+    // Worker 0 marks on the mutator thread
+    for (uint32_t i = 1; i < pool->threadCount; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, markWorkerThread, &pool->workers[i]) != 0)
+            objManagerError("Failed to start mark worker thread");
     }
-    memoryManager->freeStackTop = stackTop;
+}
+
+static inline void freeMarkerPool() {
+    MarkerPool* pool = memoryManager->markerPool;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->markStart);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 1; i < pool->threadCount; i++) pthread_join(pool->workers[i].thread, NULL);
+    for (uint32_t i = 0; i < pool->threadCount; i++) free(pool->workers[i].markStack);
+    free(pool->workers);
+    free(pool->grayQueue);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workAvailable);
+    pthread_cond_destroy(&pool->markStart);
+    pthread_cond_destroy(&pool->markFinished);
+    free(pool);
 }
 
 void initMemoryManager() {
     memoryManager = (RuntimeMemoryManager*) malloc(sizeof(RuntimeMemoryManager));
     if (memoryManager == NULL) objManagerError("Memory allocation failed for memory manager");
-    memoryManager->freeStackTop = memoryManager->freeStack;
-    memoryManager->headBlock = NULL;
-    // Init runtime head
-    rtHead = NULL;
+    memoryManager->blockCount = 0;
+    memoryManager->blockTableCapacity = 8;
+    memoryManager->blockTable = (RuntimeBlock**) malloc(sizeof(RuntimeBlock*) * memoryManager->blockTableCapacity);
+    if (memoryManager->blockTable == NULL) objManagerError("Memory allocation failed for block table");
     // Allocate head block
     newBlock();
+    memoryManager->allocBlock = memoryManager->blockTable[0];
+    memoryManager->sweepCursor = 1;
+    initMarkerPool();
 }
 
 void freeMemoryManager() {
-    RuntimeBlock* currBlock = memoryManager->headBlock;
-    while (currBlock != NULL) {
-        RuntimeBlock* nextBlock = currBlock->nextBlock;
-        free(currBlock);
-        currBlock = nextBlock;
+    freeMarkerPool();
+    for (uint32_t i = 0; i < memoryManager->blockCount; i++) {
+        RuntimeBlock* block = memoryManager->blockTable[i];
+        // Free payloads of remaining objects
+        uint64_t liveBitMap = block->liveBitMap;
+        while (liveBitMap != 0) {
+            deletePayload(&block->block[__builtin_ctzll(liveBitMap)]);
+            liveBitMap &= liveBitMap - 1;
+        }
+        free(block);
     }
+    free(memoryManager->blockTable);
     free(memoryManager);
 }
 
 // Forward declaration
 static inline void collectGarbage();
+static inline void sweepBlock(RuntimeBlock* block);
+
+// Find the next block with a free slot, sweeping blocks on the way
+static RuntimeBlock* nextAllocBlock() {
+    while (true) {
+        while (memoryManager->sweepCursor < memoryManager->blockCount) {
+            RuntimeBlock* block = memoryManager->blockTable[memoryManager->sweepCursor++];
+            sweepBlock(block);
+            if (block->liveBitMap != BLOCK_FULL_BITMAP) return block;
+        }
+        // Every block is swept and full
+        collectGarbage();
+    }
+}
 
 Object* newObjectSlot() {
-    // First attempt to free garbage if free stack is empty
-    if (memoryManager->freeStackTop == memoryManager->freeStack) collectGarbage();
-    // If free stack is still empty, allocate new block
-    if (memoryManager->freeStackTop == memoryManager->freeStack) newBlock();
-    Object* newSlot = *--memoryManager->freeStackTop;
-    newSlot->next = rtHead;
-    rtHead = newSlot;
-    return newSlot;
+    RuntimeBlock* block = memoryManager->allocBlock;
+    if (block->liveBitMap == BLOCK_FULL_BITMAP) {
+        block = nextAllocBlock();
+        memoryManager->allocBlock = block;
+    }
+    // Take the lowest free slot
+    int slotIndex = __builtin_ctzll(~block->liveBitMap);
+    block->liveBitMap |= 1ULL << slotIndex;
+    return &block->block[slotIndex];
 }
 
 // Print function
 void printRTLL() {
-    Object* currObj = rtHead;
-    while (currObj != NULL) {
-        printObject(currObj);
-        printf("\n");
-        currObj = currObj->next;
+    for (uint32_t i = 0; i < memoryManager->blockCount; i++) {
+        RuntimeBlock* block = memoryManager->blockTable[i];
+        for (int j = 0; j < RUNTIME_BLOCK_SIZE; j++) {
+            if (!(block->liveBitMap & (1ULL << j))) continue;
+            printObject(&block->block[j]);
+            printf("\n");
+        }
     }
 }
 
-// Forward declaration
-static inline void iterateValue(Value val);
+// Mark bits
 
-void iterateList(Value val) {
-    runtimeList* list = VALUE_LIST_VALUE(val);
-    Value* currValPtr = list->list;
-    for (int i=0; i<list->size; i++) {
-        Value currVal = *currValPtr;
-        if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-            Object* currObj = VALUE_OBJ_VAL(currVal);
-            if (!(currObj->isConst || currObj->marked)) {
-                currObj->marked = true;
-                if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-            }
-        }
-        currValPtr++;
-    }
+static inline uint64_t slotBit(RuntimeBlock* block, Object* obj) {
+    return 1ULL << (obj - block->block);
 }
 
-void iterateDict(Value val) {
-    runtimeDict* dict = VALUE_DICT_VALUE(val);
-    for (uint32_t i=0; i < dict->tableSize; i++) {
-        runtimeDictEntry* entry = dict->entries[i];
-        while (entry) {
-            Value currVal = entry->key;
-            if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-                Object* currObj = VALUE_OBJ_VAL(currVal);
-                if (!(currObj->isConst || currObj->marked)) {
-                    currObj->marked = true;
-                    if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-                }
-            }
-            currVal = entry->value;
-            if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-                Object* currObj = VALUE_OBJ_VAL(currVal);
-                if (!(currObj->isConst || currObj->marked)) {
-                    currObj->marked = true;
-                    if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-                }
-            }
-            entry = entry->next;
-        }
+// Returns true if this call set the mark bit
+static inline bool setMarked(Object* obj) {
+    RuntimeBlock* block = memoryManager->blockTable[obj->blockID];
+    uint64_t bit = slotBit(block, obj);
+    if (atomic_load_explicit(&block->markBitMap, memory_order_relaxed) & bit) return false;
+    return !(atomic_fetch_or_explicit(&block->markBitMap, bit, memory_order_relaxed) & bit);
+}
+
+// Gray object stacks
+
+static inline void pushGray(MarkWorker* worker, Object* obj) {
+    if (worker->markStackCount == worker->markStackCapacity) {
+        worker->markStackCapacity *= 2;
+        worker->markStack = (Object**) realloc(worker->markStack, sizeof(Object*) * worker->markStackCapacity);
+        if (worker->markStack == NULL) GCError("Memory allocation failed for mark stack");
     }
+    worker->markStack[worker->markStackCount++] = obj;
 }
 
-void iterateSet(Value val) {
-    runtimeSet* set = VALUE_SET_VALUE(val);
-    runtimeDict* dict = set->dict;
-    for (uint32_t i=0; i < dict->tableSize; i++) {
-        runtimeDictEntry* entry = dict->entries[i];
-        while (entry) {
-            Value currVal = entry->key;
-            if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-                Object* currObj = VALUE_OBJ_VAL(currVal);
-                if (!(currObj->isConst || currObj->marked)) {
-                    currObj->marked = true;
-                    if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-                }
-            }
-            entry = entry->next;
-        }
+static inline void markValue(MarkWorker* worker, Value val) {
+    if (!IS_MARKABLE_VAL(val)) return;
+    Object* obj = VALUE_OBJ_VAL(val);
+    if (obj->isConst || !setMarked(obj)) return;
+    if (IS_ITERABLE_VAL(val)) pushGray(worker, obj);
+}
+
+static inline void iterateList(MarkWorker* worker, runtimeList* list) {
+    Value* currValPtr = list->list;
+    for (int i=0; i<list->size; i++) markValue(worker, *currValPtr++);
+}
+
+static inline void iterateDict(MarkWorker* worker, runtimeDict* dict) {
+    runtimeDictEntry* entry = DICT_ENTRIES(dict);
+    for (uint32_t i=0; i < dict->table.entryCount; i++, entry++) {
+        markValue(worker, entry->key);
+        markValue(worker, entry->value);
     }
 }
 
-void iterateStrObjHashTable(strValueHash* table) {
+static inline void iterateSet(MarkWorker* worker, runtimeSet* set) {
+    runtimeSetEntry* entry = SET_ENTRIES(set);
+    for (uint32_t i=0; i < set->table.entryCount; i++, entry++) markValue(worker, entry->key);
+}
+
+static inline void iterateAttrTable(MarkWorker* worker, attrTable* table) {
     for (uint32_t i=0; i < table->table_size; i++) {
-        strValueEntry* entry = table->entries[i];
-        while (entry != NULL) {
-            Value currVal = entry->value;
-            if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-                Object* currObj = VALUE_OBJ_VAL(currVal);
-                if (!(currObj->isConst || currObj->marked)) {
-                    currObj->marked = true;
-                    if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-                }
-            }
-            entry = entry->next;
-        }
+        attrEntry* entry = &table->entries[i];
+        if (ATTR_ENTRY_USED(entry)) markValue(worker, entry->value);
     }
 }
 
-static inline void iterateValue(Value val) {
-    if (!IS_SYSTEM_DEFINED_TYPE(val.type)) iterateStrObjHashTable(VALUE_ATTRS(val));
+static inline void iterateObject(MarkWorker* worker, Object* obj) {
+    // User defined object attributes
+    if (!IS_SYSTEM_DEFINED_TYPE(obj->type)) {
+        iterateAttrTable(worker, obj->primValue.afterDefAttributes);
+        return;
+    }
+    // Builtin object created by OP_INIT but not yet initialized
+    if (obj->primValue.list == NULL) return;
     // Runtime data structure attributes
-    switch (val.type) {
+    switch (obj->type) {
         case BUILTIN_LIST:
-            iterateList(val);
+            iterateList(worker, obj->primValue.list);
             break;
         case BUILTIN_DICT:
-            iterateDict(val);
+            iterateDict(worker, obj->primValue.dict);
             break;
         case BUILTIN_SET:
-            iterateSet(val);
+            iterateSet(worker, obj->primValue.set);
             break;
         default:
             GCError("Invalid value type for iteration");
     }
 }
 
-static inline void markObject() {
-    VM* currVM = vm;
-    // Iterate stack
-    Value* currStackPtr = currVM->stack;
-    Value currVal = *currStackPtr;
-    while (currStackPtr != currVM->stackTop) {
-        if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-            Object* currObj = VALUE_OBJ_VAL(currVal);
-            if (!(currObj->isConst || currObj->marked)) {
-                currObj->marked = true;
-                if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-            }
+// Work sharing
+
+// Hand the oldest half of the local stack to idle workers
+static inline void donateWork(MarkerPool* pool, MarkWorker* worker) {
+    uint32_t donateCount = worker->markStackCount / 2;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->grayQueueCount + donateCount > pool->grayQueueCapacity) {
+        while (pool->grayQueueCount + donateCount > pool->grayQueueCapacity) pool->grayQueueCapacity *= 2;
+        pool->grayQueue = (Object**) realloc(pool->grayQueue, sizeof(Object*) * pool->grayQueueCapacity);
+        if (pool->grayQueue == NULL) GCError("Memory allocation failed for gray queue");
+    }
+    memcpy(pool->grayQueue + pool->grayQueueCount, worker->markStack, sizeof(Object*) * donateCount);
+    pool->grayQueueCount += donateCount;
+    pthread_cond_broadcast(&pool->workAvailable);
+    pthread_mutex_unlock(&pool->lock);
+    worker->markStackCount -= donateCount;
+    memmove(worker->markStack, worker->markStack + donateCount, sizeof(Object*) * worker->markStackCount);
+}
+
+// Take a batch from the shared queue, returns false once every worker is idle
+static inline bool stealWork(MarkerPool* pool, MarkWorker* worker) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->grayQueueCount == 0 && !pool->markDone) {
+        uint32_t idleCount = atomic_fetch_add(&pool->idleCount, 1) + 1;
+        if (idleCount == pool->threadCount) {
+            pool->markDone = true;
+            pthread_cond_broadcast(&pool->workAvailable);
+        } else {
+            pthread_cond_wait(&pool->workAvailable, &pool->lock);
         }
-        currVal = *currStackPtr++;
+        atomic_fetch_sub(&pool->idleCount, 1);
     }
-    // Iterate global ref array
-    currStackPtr = currVM->globalRefArray;
-    currVal = *currStackPtr;
-    for (int i=0; i<vm->globalRefCount; i++) {
-        if (!IS_INTERNAL_NULL(currVal) && IS_MARKABLE_VAL(currVal)) {
-            Object* currObj = VALUE_OBJ_VAL(currVal);
-            if (!(currObj->isConst || currObj->marked)) {
-                currObj->marked = true;
-                if (IS_ITERABLE_VAL(currVal)) iterateValue(currVal);
-            }
+    if (pool->grayQueueCount == 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return false;
+    }
+    uint32_t stealCount = pool->grayQueueCount < GC_STEAL_BATCH_SIZE ? pool->grayQueueCount : GC_STEAL_BATCH_SIZE;
+    pool->grayQueueCount -= stealCount;
+    for (uint32_t i = 0; i < stealCount; i++) pushGray(worker, pool->grayQueue[pool->grayQueueCount + i]);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+static void drainGrayObjects(MarkerPool* pool, MarkWorker* worker) {
+    while (true) {
+        while (worker->markStackCount > 0) {
+            iterateObject(worker, worker->markStack[--worker->markStackCount]);
+            if (worker->markStackCount > GC_DONATE_THRESHOLD && atomic_load_explicit(&pool->idleCount, memory_order_relaxed) > 0)
+                donateWork(pool, worker);
         }
-        currVal = *currStackPtr++;
+        if (pool->threadCount == 1 || !stealWork(pool, worker)) return;
     }
 }
 
-static inline void sweepObject() {
-#ifdef PRINT_GC_INFO
-    uint32_t removedCount = 0;
-#endif
-#ifdef PRINT_GC_REMOVAL
-    uint32_t totalCount = 0;
-#endif
-//    uint64_t blockBitMap = 0;
-    Object* currObj = rtHead;
-    Object* prevObj = NULL;
-    while (currObj != NULL) {
-        if (currObj->marked) { // Marked object
-            // Unmark object
-            currObj->marked = false;
-            // Move to next object
-            prevObj = currObj;
-            currObj = currObj->next;
-        } else { // Unmarked object
-#ifdef PRINT_GC_REMOVAL
-            printf("Removed Object [%u]: ", totalCount);
-            printObject(currObj);
-            printf("\n");
-#endif
-#ifdef PRINT_GC_INFO
-            removedCount++;
-#endif
-            // LL delete
-            if (prevObj == NULL) {
-                rtHead = currObj->next;
-            } else {
-                prevObj->next = currObj->next;
-            }
-            Object* nextObj = currObj->next;
-            // Push to free stack
-            *memoryManager->freeStackTop++ = currObj;
-            currObj = nextObj;
+static void* markWorkerThread(void* arg) {
+    MarkWorker* worker = (MarkWorker*) arg;
+    MarkerPool* pool = memoryManager->markerPool;
+    uint64_t seenEpoch = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->markEpoch == seenEpoch && !pool->shutdown) pthread_cond_wait(&pool->markStart, &pool->lock);
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
         }
+        seenEpoch = pool->markEpoch;
+        pthread_mutex_unlock(&pool->lock);
+        drainGrayObjects(pool, worker);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finishedCount == pool->threadCount - 1) pthread_cond_signal(&pool->markFinished);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static inline void markObject() {
+    VM* currVM = vm;
+    MarkerPool* pool = memoryManager->markerPool;
+    MarkWorker* mainWorker = &pool->workers[0];
+    // Mark roots: stack
+    for (Value* currStackPtr = currVM->stack; currStackPtr != currVM->stackTop; currStackPtr++)
+        markValue(mainWorker, *currStackPtr);
+    // Mark roots: global ref array
+    for (int i=0; i<currVM->globalRefCount; i++) markValue(mainWorker, currVM->globalRefArray[i]);
+    if (pool->threadCount == 1) {
+        drainGrayObjects(pool, mainWorker);
+        return;
+    }
+    // Wake helper workers, roots reach them through donation
+    pthread_mutex_lock(&pool->lock);
+    pool->grayQueueCount = 0;
+    pool->markDone = false;
+    pool->finishedCount = 0;
+    atomic_store(&pool->idleCount, 0);
+    pool->markEpoch++;
+    pthread_cond_broadcast(&pool->markStart);
+    pthread_mutex_unlock(&pool->lock);
+    drainGrayObjects(pool, mainWorker);
+    // Wait until every helper has left the mark loop
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finishedCount < pool->threadCount - 1) pthread_cond_wait(&pool->markFinished, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Free unmarked objects of a block and clear its marks
+static inline void sweepBlock(RuntimeBlock* block) {
+    uint64_t markBitMap = atomic_load_explicit(&block->markBitMap, memory_order_relaxed);
+    uint64_t deadBitMap = block->liveBitMap & ~markBitMap;
+    while (deadBitMap != 0) {
+        Object* deadObj = &block->block[__builtin_ctzll(deadBitMap)];
 #ifdef PRINT_GC_REMOVAL
-        totalCount++;
+        printf("Removed Object [block %u]: ", block->blockID);
+        printObject(deadObj);
+        printf("\n");
 #endif
+        deletePayload(deadObj);
+        deadBitMap &= deadBitMap - 1;
     }
-#ifdef PRINT_GC_INFO
-    printf("GC removed %u objects\n", removedCount);
-#endif
+    block->liveBitMap &= markBitMap;
+    atomic_store_explicit(&block->markBitMap, 0, memory_order_relaxed);
 }
 
+#ifdef PRINT_GC_PAUSE
+static inline double gcTimeMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+#endif
+
+// Mark only, blocks are swept lazily by allocation
 static inline void collectGarbage() {
+#ifdef PRINT_GC_PAUSE
+    double markStart = gcTimeMs();
+#endif
     markObject();
-    sweepObject();
+    // Grow heap relative to surviving objects, so collections stay proportional to allocation
+    uint32_t liveCount = 0;
+    for (uint32_t i = 0; i < memoryManager->blockCount; i++)
+        liveCount += __builtin_popcountll(atomic_load_explicit(&memoryManager->blockTable[i]->markBitMap, memory_order_relaxed));
+    uint32_t freeCount = memoryManager->blockCount * RUNTIME_BLOCK_SIZE - liveCount;
+    while (freeCount < liveCount * (GC_HEAP_GROWTH_FACTOR - 1) || freeCount == 0) {
+        newBlock();
+        freeCount += RUNTIME_BLOCK_SIZE;
+    }
+    memoryManager->sweepCursor = 0;
+#ifdef PRINT_GC_INFO
+    printf("GC marked %u live objects, %u free slots\n", liveCount, freeCount);
+#endif
+#ifdef PRINT_GC_PAUSE
+    printf("GC pause: mark %.3f ms, %u blocks, %u mark threads\n", gcTimeMs() - markStart,
+           memoryManager->blockCount, memoryManager->markerPool->threadCount);
+#endif
 }
@@ -7,19 +7,62 @@
 
 #include "object.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if RUNTIME_BLOCK_SIZE > 64
+#error "RUNTIME_BLOCK_SIZE must fit in the 64 bit block bitmaps"
+#endif
+
+#define BLOCK_FULL_BITMAP (~0ULL >> (64 - RUNTIME_BLOCK_SIZE))
 
 typedef struct RuntimeBlock RuntimeBlock;
 
 struct RuntimeBlock {
     Object block[RUNTIME_BLOCK_SIZE];
-    RuntimeBlock* nextBlock;
-    uint16_t blockID;
+    _Atomic uint64_t markBitMap; // One mark bit per slot
+    uint64_t liveBitMap; // Allocated slots, clear bits form the block free list
+    uint32_t blockID;
 };
 
+// Per thread marking state
+typedef struct MarkWorker {
+    Object** markStack;
+    uint32_t markStackCount;
+    uint32_t markStackCapacity;
+    pthread_t thread;
+} MarkWorker;
+
+// Marker thread pool, worker 0 is the mutator thread
+typedef struct MarkerPool {
+    MarkWorker* workers;
+    uint32_t threadCount;
+    // Shared gray queue
+    Object** grayQueue;
+    uint32_t grayQueueCount;
+    uint32_t grayQueueCapacity;
+    // Termination
+    _Atomic uint32_t idleCount;
+    bool markDone;
+    // Cycle control
+    uint64_t markEpoch;
+    uint32_t finishedCount;
+    bool shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    pthread_cond_t markStart;
+    pthread_cond_t markFinished;
+} MarkerPool;
+
 typedef struct RuntimeMemoryManager {
-    Object* freeStack[FREE_STACK_SIZE];
-    Object** freeStackTop;
-    RuntimeBlock* headBlock;
+    // Block lookup by blockID
+    RuntimeBlock** blockTable;
+    uint32_t blockCount;
+    uint32_t blockTableCapacity;
+    // Lazy sweeping, blocks below sweepCursor have been swept since the last mark
+    RuntimeBlock* allocBlock;
+    uint32_t sweepCursor;
+    MarkerPool* markerPool;
 } RuntimeMemoryManager;
 
 extern RuntimeMemoryManager* memoryManager;
@@ -0,0 +1,223 @@
+#include "scope.h"
+#include "object.h"
+#include "runtimeDS.h"
+#include "compiler.h"
+#include "errors.h"
+#include "ir.h"
+
+#include <string.h>
+
+#define GET_BYTE(data, shift)  ((uint8_t) (((data) >> ((shift) * 8)) & 0xFF))
+#define GET_WORD(data, shift) ((uint16_t)(((data) >> ((shift) * 8)) & 0xFFFF))
+
+#define OPCODE(line) ((OpCode)((line) & 0xFF))
+#define IS_BRANCH_OP(op) ((op) == OP_JUMP || (op) == OP_JUMP_IF_FALSE || (op) == OP_ITER_NEXT || (op) == OP_FOR_STEP)
+#define JUMP_TARGET(line) GET_WORD(line, 1)
+#define SET_WORD(line, shift, value) (((line) & ~(0xFFFFULL << ((shift) * 8))) | ((uint64_t)(uint16_t)(value) << ((shift) * 8)))
+#define REF_LINE(op, index) ((uint64_t)(op) | ((uint64_t)(index) << 8))
+#define REF_STORE_LINE(op, index, sa) (REF_LINE(op, index) | ((uint64_t)(sa) << 24))
+
+// Locals assigned on every path and on some path to a point
+typedef struct assignedLocals {
+    bool* must;
+    bool* may;
+} assignedLocals;
+
+typedef struct scopeStats {
+    uint32_t locals;
+    uint32_t globals;
+    uint32_t combined;
+} scopeStats;
+
+static void* scopeAlloc(size_t size) {
+    void* ptr = calloc(1, size);
+    if (ptr == NULL) compilationError(0, 0, 0, "Scope resolution allocation failed");
+    return ptr;
+}
+
+static void toAbsoluteJumps(uint64_t* code, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (IS_BRANCH_OP(OPCODE(code[i]))) code[i] = SET_WORD(code[i], 1, (uint16_t)(i + (int16_t) JUMP_TARGET(code[i])));
+    }
+}
+
+static void toRelativeJumps(uint64_t* code, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (IS_BRANCH_OP(OPCODE(code[i]))) code[i] = SET_WORD(code[i], 1, (uint16_t)(int16_t)(JUMP_TARGET(code[i]) - i));
+    }
+}
+
+static void initAssignment(assignedLocals* s, uint16_t localCount) {
+    s->must = scopeAlloc(sizeof(bool) * localCount);
+    s->may = scopeAlloc(sizeof(bool) * localCount);
+}
+
+static void freeAssignment(assignedLocals* s) {
+    free(s->must);
+    free(s->may);
+}
+
+static void copyAssignment(assignedLocals* dst, const assignedLocals* src, uint16_t localCount) {
+    memcpy(dst->must, src->must, sizeof(bool) * localCount);
+    memcpy(dst->may, src->may, sizeof(bool) * localCount);
+}
+
+static bool mergeAssignment(assignedLocals* dst, const assignedLocals* src, uint16_t localCount) {
+    bool changed = false;
+    for (uint16_t i = 0; i < localCount; i++) {
+        if (dst->must[i] && !src->must[i]) {
+            dst->must[i] = false;
+            changed = true;
+        }
+        if (!dst->may[i] && src->may[i]) {
+            dst->may[i] = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static void assignLocal(assignedLocals* s, uint16_t localCount, uint16_t index) {
+    if (index >= localCount) return;
+    s->must[index] = true;
+    s->may[index] = true;
+}
+
+// Special assignments through a combined ref modify the global while the local is unset
+static void transferAssignment(Chunk* c, assignedLocals* s, uint16_t localCount, uint32_t i) {
+    uint64_t line = c->code[i];
+    switch (OPCODE(line)) {
+        case OP_SET_LOCAL_REF_ATTR:
+            assignLocal(s, localCount, GET_WORD(line, 1));
+            break;
+        case OP_SET_COMBINED_REF_ATTR:
+            if (GET_BYTE(line, 5) == ASSIGNMENT_NONE) assignLocal(s, localCount, GET_WORD(line, 1));
+            break;
+        case OP_ITER_INIT:
+            for (uint16_t slot = 0; slot < 3; slot++) assignLocal(s, localCount, GET_WORD(line, 1) + slot);
+            break;
+        case OP_ITER_NEXT:
+            assignLocal(s, localCount, GET_WORD(line, 3) + 1);
+            assignLocal(s, localCount, GET_WORD(line, 5));
+            break;
+        default:
+            break;
+    }
+}
+
+// Propagates assignments to a fixed point, filling the state on entry to each reached block
+static void solveAssignments(irFunction* f, assignedLocals* in, uint16_t localCount, uint16_t paramCount) {
+    Chunk* c = f->chunk;
+    assignedLocals work, taken;
+    initAssignment(&work, localCount);
+    initAssignment(&taken, localCount);
+    // Only parameters are assigned on entry
+    for (uint16_t i = 0; i < localCount && i < paramCount; i++) assignLocal(&in[0], localCount, i);
+    f->reached[0] = true;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t b = 0; b < f->blockCount; b++) {
+            if (!f->reached[b]) continue;
+            irBlock* current = &f->blocks[b];
+            copyAssignment(&work, &in[b], localCount);
+            for (uint32_t i = current->start; i < current->end; i++) {
+                // An exhausted for-in jumps out before writing its loop variable
+                if (i == current->end - 1 && OPCODE(c->code[i]) == OP_ITER_NEXT) copyAssignment(&taken, &work, localCount);
+                transferAssignment(c, &work, localCount, i);
+            }
+            bool iterNext = OPCODE(c->code[current->end - 1]) == OP_ITER_NEXT;
+            for (uint8_t s = 0; s < current->successorCount; s++) {
+                // The jump edge of a block is always its last successor
+                const assignedLocals* out = (iterNext && s == current->successorCount - 1) ? &taken : &work;
+                uint32_t successor = current->successors[s];
+                if (!f->reached[successor]) {
+                    f->reached[successor] = true;
+                    copyAssignment(&in[successor], out, localCount);
+                    changed = true;
+                } else if (mergeAssignment(&in[successor], out, localCount)) {
+                    changed = true;
+                }
+            }
+        }
+    }
+    freeAssignment(&work);
+    freeAssignment(&taken);
+}
+
+// Single slot form of a combined access, or the access itself when only the runtime can tell which slot is set
+static uint64_t resolveAccess(uint64_t line, const assignedLocals* s, const bool* globalMayHold, scopeStats* stats) {
+    OpCode op = OPCODE(line);
+    uint16_t localIndex = GET_WORD(line, 1);
+    uint16_t globalIndex = GET_WORD(line, 3);
+    bool get = op == OP_GET_COMBINED_REF_ATTR;
+    specialAssignment sa = get ? ASSIGNMENT_NONE : GET_BYTE(line, 5);
+    // Plain stores always write the local
+    bool toLocal = (!get && sa == ASSIGNMENT_NONE) || s->must[localIndex] || !globalMayHold[globalIndex];
+    if (toLocal) {
+        stats->locals++;
+        return get ? REF_LINE(OP_GET_LOCAL_REF_ATTR, localIndex) : REF_STORE_LINE(OP_SET_LOCAL_REF_ATTR, localIndex, sa);
+    }
+    if (!s->may[localIndex]) {
+        stats->globals++;
+        return get ? REF_LINE(OP_GET_GLOBAL_REF_ATTR, globalIndex) : REF_STORE_LINE(OP_SET_GLOBAL_REF_ATTR, globalIndex, sa);
+    }
+    stats->combined++;
+    return line;
+}
+
+static void resolveInChunk(callable* function, const bool* globalMayHold, scopeStats* stats) {
+    Chunk* c = function->func;
+    if (c == NULL || c->count == 0) return;
+    uint16_t localCount = c->localRefArraySize > 0 ? c->localRefArraySize : 1;
+    // Methods receive self in the first slot
+    uint16_t paramCount = function->in + (function->type == method ? 1 : 0);
+    toAbsoluteJumps(c->code, c->count);
+    irFunction* f = buildIR(c);
+    assignedLocals* in = scopeAlloc(sizeof(assignedLocals) * (f->blockCount + 1));
+    for (uint32_t b = 0; b < f->blockCount; b++) initAssignment(&in[b], localCount);
+    solveAssignments(f, in, localCount, paramCount);
+    assignedLocals work;
+    initAssignment(&work, localCount);
+    for (uint32_t b = 0; b < f->blockCount; b++) {
+        if (!f->reached[b]) continue;
+        copyAssignment(&work, &in[b], localCount);
+        for (uint32_t i = f->blocks[b].start; i < f->blocks[b].end; i++) {
+            uint64_t line = c->code[i];
+            OpCode op = OPCODE(line);
+            bool combined = (op == OP_GET_COMBINED_REF_ATTR || op == OP_SET_COMBINED_REF_ATTR) && GET_WORD(line, 1) < localCount;
+            // Resolved against the state before the access
+            uint64_t resolved = combined ? resolveAccess(line, &work, globalMayHold, stats) : line;
+            transferAssignment(c, &work, localCount, i);
+            c->code[i] = resolved;
+        }
+    }
+    freeAssignment(&work);
+    for (uint32_t b = 0; b < f->blockCount; b++) freeAssignment(&in[b]);
+    free(in);
+    freeIR(f);
+    toRelativeJumps(c->code, c->count);
+}
+
+void resolveScopes(runtimeList* chunkArray, runtimeList* globalRefList) {
+    // A global holds a value if it was declared or some chunk stores to it
+    bool* globalMayHold = scopeAlloc(sizeof(bool) * (globalRefList->size + 1));
+    for (uint32_t i = 0; i < globalRefList->size; i++) globalMayHold[i] = !IS_INTERNAL_NULL(globalRefList->list[i]);
+    for (uint32_t i = 0; i < chunkArray->size; i++) {
+        Chunk* c = VALUE_CALLABLE_VALUE(chunkArray->list[i])->func;
+        if (c == NULL) continue;
+        for (uint32_t j = 0; j < c->count; j++) {
+            uint64_t line = c->code[j];
+            if (OPCODE(line) == OP_SET_GLOBAL_REF_ATTR && GET_WORD(line, 1) < globalRefList->size) globalMayHold[GET_WORD(line, 1)] = true;
+        }
+    }
+    scopeStats stats = {0, 0, 0};
+    for (uint32_t i = 0; i < chunkArray->size; i++) {
+        resolveInChunk(VALUE_CALLABLE_VALUE(chunkArray->list[i]), globalMayHold, &stats);
+    }
+#ifdef DEBUG_PRINT_OPTIMIZER_STATS
+    printf("Scope resolution: %u local, %u global, %u left combined\n", stats.locals, stats.globals, stats.combined);
+#endif
+    (void) stats;
+    free(globalMayHold);
+}
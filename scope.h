@@ -0,0 +1,10 @@
+#ifndef CJ_2_SCOPE_H
+#define CJ_2_SCOPE_H
+
+#include "primitiveVars.h"
+
+// Resolves each combined local and global access to the one slot it can reach at that point.
+// Runs once every global is declared, when chunks hold relative jumps.
+void resolveScopes(runtimeList* chunkArray, runtimeList* globalRefList);
+
+#endif //CJ_2_SCOPE_H
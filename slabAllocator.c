@@ -0,0 +1,128 @@
+#include "slabAllocator.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static slabClass slabClasses[SLAB_CLASS_COUNT] = {
+        {.chunkSize = 16}, {.chunkSize = 32}, {.chunkSize = 48}, {.chunkSize = 64},
+        {.chunkSize = 96}, {.chunkSize = 128}, {.chunkSize = 192}, {.chunkSize = 256},
+};
+
+// Class index by size in granules, rounded up
+static const uint8_t granuleClass[SLAB_MAX_CHUNK_SIZE / SLAB_GRANULE + 1] = {
+        0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+};
+
+static slabPage* pageHead = NULL;
+
+// Large allocation statistics
+static uint64_t largeAllocCount = 0;
+static uint64_t largeFreeCount = 0;
+
+static inline slabClass* classForSize(size_t size) {
+    return &slabClasses[granuleClass[(size + SLAB_GRANULE - 1) / SLAB_GRANULE]];
+}
+
+static inline bool newPage(slabClass* class) {
+    slabPage* page = (slabPage*) malloc(SLAB_PAGE_SIZE);
+    if (page == NULL) return false;
+    page->next = pageHead;
+    pageHead = page;
+    // Chunks start after the page header, aligned to the granule
+    class->carvePtr = (char*) page + SLAB_GRANULE;
+    class->carveEnd = (char*) page + SLAB_PAGE_SIZE;
+    class->pageCount++;
+    return true;
+}
+
+void* slabAlloc(size_t size) {
+    if (size > SLAB_MAX_CHUNK_SIZE) {
+#ifdef PRINT_SLAB_STATS
+        largeAllocCount++;
+#endif
+        return malloc(size);
+    }
+    slabClass* class = classForSize(size);
+#ifdef PRINT_SLAB_STATS
+    class->allocCount++;
+#endif
+    // Reuse freed chunk
+    slabChunk* chunk = class->freeList;
+    if (chunk != NULL) {
+        class->freeList = chunk->next;
+        return chunk;
+    }
+    // Carve from newest page
+    if (class->carvePtr + class->chunkSize > class->carveEnd && !newPage(class)) return NULL;
+    void* result = class->carvePtr;
+    class->carvePtr += class->chunkSize;
+    return result;
+}
+
+void* slabCalloc(size_t size) {
+    void* result = slabAlloc(size);
+    if (result != NULL) memset(result, 0, size);
+    return result;
+}
+
+void* slabRealloc(void* ptr, size_t oldSize, size_t newSize) {
+    if (ptr == NULL) return slabAlloc(newSize);
+    if (oldSize > SLAB_MAX_CHUNK_SIZE && newSize > SLAB_MAX_CHUNK_SIZE) return realloc(ptr, newSize);
+    // Same size class, nothing to move
+    if (oldSize <= SLAB_MAX_CHUNK_SIZE && newSize <= SLAB_MAX_CHUNK_SIZE && classForSize(oldSize) == classForSize(newSize)) return ptr;
+    void* result = slabAlloc(newSize);
+    if (result == NULL) return NULL;
+    memcpy(result, ptr, oldSize < newSize ? oldSize : newSize);
+    slabFree(ptr, oldSize);
+    return result;
+}
+
+void slabFree(void* ptr, size_t size) {
+    if (ptr == NULL) return;
+    if (size > SLAB_MAX_CHUNK_SIZE) {
+#ifdef PRINT_SLAB_STATS
+        largeFreeCount++;
+#endif
+        free(ptr);
+        return;
+    }
+    slabClass* class = classForSize(size);
+#ifdef PRINT_SLAB_STATS
+    class->freeCount++;
+#endif
+    slabChunk* chunk = (slabChunk*) ptr;
+    chunk->next = class->freeList;
+    class->freeList = chunk;
+}
+
+void freeSlabAllocator() {
+#ifdef PRINT_SLAB_STATS
+    printSlabStats();
+#endif
+    slabPage* page = pageHead;
+    while (page != NULL) {
+        slabPage* nextPage = page->next;
+        free(page);
+        page = nextPage;
+    }
+    pageHead = NULL;
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slabClasses[i].freeList = NULL;
+        slabClasses[i].carvePtr = NULL;
+        slabClasses[i].carveEnd = NULL;
+    }
+}
+
+void printSlabStats() {
+    printf("\nSlab allocator statistics\n");
+    printf("    %-10s %-12s %-12s %-12s %-8s\n", "Chunk", "Allocs", "Frees", "Live", "Pages");
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slabClass* class = &slabClasses[i];
+        printf("    %-10u %-12llu %-12llu %-12llu %-8u\n", class->chunkSize, (unsigned long long) class->allocCount,
+               (unsigned long long) class->freeCount, (unsigned long long) (class->allocCount - class->freeCount), class->pageCount);
+    }
+    printf("    %-10s %-12llu %-12llu %-12llu\n", "Large", (unsigned long long) largeAllocCount,
+           (unsigned long long) largeFreeCount, (unsigned long long) (largeAllocCount - largeFreeCount));
+}
@@ -0,0 +1,47 @@
+#ifndef CJ_2_SLABALLOCATOR_H
+#define CJ_2_SLABALLOCATOR_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size classes are multiples of SLAB_GRANULE up to SLAB_MAX_CHUNK_SIZE,
+// larger requests fall back to malloc
+#define SLAB_GRANULE 16
+#define SLAB_MAX_CHUNK_SIZE 256
+#define SLAB_CLASS_COUNT 8
+
+typedef struct slabChunk slabChunk;
+typedef struct slabPage slabPage;
+
+struct slabChunk {
+    slabChunk* next;
+};
+
+struct slabPage {
+    slabPage* next;
+};
+
+typedef struct slabClass {
+    uint32_t chunkSize;
+    slabChunk* freeList;
+    // Uncarved space of the newest page
+    char* carvePtr;
+    char* carveEnd;
+    // Statistics
+    uint64_t allocCount;
+    uint64_t freeCount;
+    uint32_t pageCount;
+} slabClass;
+
+// Callers pass the allocation size on free, chunks carry no header
+void* slabAlloc(size_t size);
+void* slabCalloc(size_t size);
+void* slabRealloc(void* ptr, size_t oldSize, size_t newSize);
+void slabFree(void* ptr, size_t size);
+
+void freeSlabAllocator();
+void printSlabStats();
+
+#endif //CJ_2_SLABALLOCATOR_H
@@ -13,13 +13,47 @@
 
 #define LOAD_FACTOR_THRESHOLD 0.75
 
+uint16_t builtinSymbols[BUILTIN_NAME_COUNT];
+
+// Symbol ID to name, slot 0 is unused
+static char** symbolNames = NULL;
+static uint32_t symbolCount = 0;
+static uint32_t symbolCapacity = 0;
+
+static char* builtinNameStrings[BUILTIN_NAME_COUNT] = {
+        [NAME_PRINT] = "print",
+        [NAME_HASH_STRING] = "hashString",
+        [NAME_GET] = "get",
+        [NAME_SET] = "set",
+        [NAME_NG] = "_ng",
+        [NAME_ADD] = "_add",
+        [NAME_SUB] = "_sub",
+        [NAME_MUL] = "_mul",
+        [NAME_DIV] = "_div",
+        [NAME_MOD] = "_mod",
+        [NAME_POW] = "_pow",
+        [NAME_EQ] = "_eq",
+        [NAME_LESS] = "_less",
+        [NAME_MORE] = "_more",
+        [NAME_LEQ] = "_leq",
+        [NAME_MEQ] = "_meq",
+};
+
 uint32_t hashString(char* str) {
+    uint32_t length;
+    return hashStringLength(str, &length);
+}
+
+// Hash and measure in one pass
+uint32_t hashStringLength(char* str, uint32_t* length) {
     uint32_t hash = 5381;
     unsigned char c;  // Change to unsigned char
+    char* start = str;
 
     while ((c = *str++))
         hash = ((hash << 5) + hash) + c; /* hashString * 33 + c */
 
+    *length = (uint32_t) (str - start - 1);
     return hash;
 }
 
@@ -28,7 +62,7 @@ HashTable* createHashTable(uint32_t table_size) {
     if (table == NULL) strHashError("String hashString table allocation failed");
     table->table_size = table_size;
     table->num_entries = 0;
-    table->entries = calloc(table->table_size, sizeof(Entry*));
+    table->entries = calloc(table->table_size, sizeof(internedString*));
     if (table->entries == NULL) strHashError("String hashString table allocation failed");
 
     return table;
@@ -38,10 +72,9 @@ void deleteHashTable(HashTable* table) {
     assert(table != NULL);
 
     for (uint32_t i = 0; i < table->table_size; i++) {
-        Entry* entry = table->entries[i];
+        internedString* entry = table->entries[i];
         while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry->key);
+            internedString* next = entry->next;
             free(entry);
             entry = next;
         }
@@ -51,140 +84,25 @@ void deleteHashTable(HashTable* table) {
     free(table);
 }
 
-char* internalInsert(HashTable* table, char* key, uint32_t value) {
-    assert(table != NULL);
-    assert(key != NULL);
-
-    uint32_t pos = hashString(key) % table->table_size;
-    Entry* entry = table->entries[pos];
-
-    while (entry != NULL) {
-        if (strcmp(entry->key, key) == 0) {
-            entry->value = value;
-            strHashError("Inserting duplicate key in string hashString table");
-            return NULL;
-        }
-        entry = entry->next;
-    }
-
-    entry = malloc(sizeof(Entry));
-    if (entry == NULL) strHashError("String hashString table entry allocation failed");
-    char* newKey = strdup(key);
-    entry->key = newKey;
-    entry->value = value;
-    entry->next = table->entries[pos];
-    table->entries[pos] = entry;
-
-    table->num_entries++;
-
-    if ((float)table->num_entries / (float)table->table_size > LOAD_FACTOR_THRESHOLD) {
-        resize(table);
-    }
-    return newKey;
-}
-
-void internalResizeInsert(HashTable* table, char* key, uint32_t value) {
-    assert(table != NULL);
-    assert(key != NULL);
-
-    unsigned int pos = hashString(key) % table->table_size;
-    Entry* entry = table->entries[pos];
-
-    while (entry != NULL) {
-        if (strcmp(entry->key, key) == 0) {
-            entry->value = value;
-            fprintf(stderr, "Hash table error: key already exists\n");
-            return;
-        }
-        entry = entry->next;
-    }
-
-    entry = malloc(sizeof(Entry));
-    assert(entry != NULL);
-    entry->key = key;
-    entry->value = value;
-    entry->next = table->entries[pos];
-    table->entries[pos] = entry;
-
-    table->num_entries++;
-
-    if ((float)table->num_entries / (float) table->table_size > LOAD_FACTOR_THRESHOLD) {
-        resize(table);
-    }
-}
-
-uint32_t* internalFind(HashTable* table, char* key) {
-    assert(table != NULL);
-    assert(key != NULL);
-
-    uint32_t pos = hashString(key) % table->table_size;
-    Entry* entry = table->entries[pos];
-
-    while (entry != NULL) {
-        if (strcmp(entry->key, key) == 0) {
-            return &(entry->value);
-        }
-        entry = entry->next;
-    }
-
-    return NULL;
-}
-
-char* internalFindKeyPtr(HashTable* table, char* key) {
-    assert(table != NULL);
-    assert(key != NULL);
-
-    uint32_t pos = hashString(key) % table->table_size;
-    Entry* entry = table->entries[pos];
-
-    while (entry != NULL) {
-        if (strcmp(entry->key, key) == 0) {
-            return entry->key;
-        }
-        entry = entry->next;
-    }
-
-    return NULL;
-}
-
-void delete(HashTable* table, char* key) {
-    assert(table != NULL);
-    assert(key != NULL);
-
-    uint32_t pos = hashString(key) % table->table_size;
-    Entry** p = &(table->entries[pos]);
-
-    while (*p != NULL) {
-        if (strcmp((*p)->key, key) == 0) {
-            Entry* entry = *p;
-            *p = entry->next;
-            free(entry->key);
-            free(entry);
-            table->num_entries--;
-            return;
-        }
-        p = &((*p)->next);
-    }
-}
-
 void resize(HashTable* table) {
     assert(table != NULL);
 
     if (table->table_size >= (UINT32_MAX / 2)) strHashError("String hashString table size exceeds maximum during resize");
     uint32_t old_table_size = table->table_size;
-    Entry** old_entries = table->entries;
+    internedString** old_entries = table->entries;
 
     table->table_size *= 2;
-    table->num_entries = 0;
-    table->entries = calloc(table->table_size, sizeof(Entry*));
+    table->entries = calloc(table->table_size, sizeof(internedString*));
     if (table->entries == NULL) strHashError("String hashString table reallocation failed");
 
+    // Relink entries by their stored hash
     for (uint32_t i = 0; i < old_table_size; i++) {
-        Entry* entry = old_entries[i];
+        internedString* entry = old_entries[i];
         while (entry != NULL) {
-            internalResizeInsert(table, entry->key, entry->value);
-            Entry* next = entry->next;
-            free(entry);
+            internedString* next = entry->next;
+            uint32_t pos = entry->hash % table->table_size;
+            entry->next = table->entries[pos];
+            table->entries[pos] = entry;
             entry = next;
         }
     }
@@ -196,9 +114,9 @@ void printHashTable(HashTable* table) {
     assert(table != NULL);
 
     for (uint32_t i = 0; i < table->table_size; i++) {
-        Entry* entry = table->entries[i];
+        internedString* entry = table->entries[i];
         while (entry != NULL) {
-            printf("Key: %s, Value: %u\n", entry->key, entry->value);
+            printf("Key: %s, Value: %u\n", entry->chars, entry->refCount);
             entry = entry->next;
         }
     }
@@ -209,14 +127,14 @@ HashTable* stringTable;
 
 void printHashTableStructure(HashTable* table) {
     for (uint32_t i = 0; i < table->table_size; i++) {
-        Entry* entry = table->entries[i];
+        internedString* entry = table->entries[i];
         if (entry != NULL) {
             printf("[%u]: ", i);
         } else {
             printf("[%u]: EMPTY", i);
         }
         while (entry != NULL) {
-            printf("\"%s\"", entry->key);
+            printf("\"%s\"", entry->chars);
 
             entry = entry->next;
             if (entry != NULL) {
@@ -230,40 +148,113 @@ void printHashTableStructure(HashTable* table) {
 
 void initStringHash() {
     stringTable = createHashTable(STRING_TABLE_INIT_SIZE);
+    symbolCapacity = SYMBOL_TABLE_INIT_SIZE;
+    symbolNames = malloc(sizeof(char*) * symbolCapacity);
+    if (symbolNames == NULL) strHashError("Symbol table allocation failed");
+    symbolNames[SYMBOL_NONE] = NULL;
+    symbolCount = 1;
+    for (int i = 0; i < BUILTIN_NAME_COUNT; i++) builtinSymbols[i] = internSymbol(builtinNameStrings[i]);
 }
 
 void deleteStringHash() {
     deleteHashTable(stringTable);
+    free(symbolNames);
+    symbolNames = NULL;
+    symbolCount = 0;
+    symbolCapacity = 0;
 }
 
-char* addReference(char* key) { // Increase reference count and return the key pointer in hashString entry
-    // Find the entry
-    uint32_t* value = internalFind(stringTable, key);
-    if (value == NULL) {
-        // If not found, insert a new entry
-        return internalInsert(stringTable, key, 1);
-    } else {
+static inline internedString* findEntry(char* key, uint32_t hash, uint32_t length) {
+    internedString* entry = stringTable->entries[hash % stringTable->table_size];
+    while (entry != NULL) {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->chars, key, length) == 0) return entry;
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+char* addReference(char* key) { // Increase reference count and return the interned key pointer
+    assert(key != NULL);
+    uint32_t length;
+    uint32_t hash = hashStringLength(key, &length);
+    internedString* entry = findEntry(key, hash, length);
+    if (entry != NULL) {
         // If found, increment the reference count
-        (*value)++;
-        return internalFindKeyPtr(stringTable, key);
+        entry->refCount++;
+        return entry->chars;
     }
+    // If not found, insert a new entry
+    entry = malloc(sizeof(internedString) + length + 1);
+    if (entry == NULL) strHashError("String hashString table entry allocation failed");
+    entry->length = length;
+    entry->hash = hash;
+    entry->refCount = 1;
+    entry->symbol = SYMBOL_NONE;
+    memcpy(entry->chars, key, length + 1);
+    uint32_t pos = hash % stringTable->table_size;
+    entry->next = stringTable->entries[pos];
+    stringTable->entries[pos] = entry;
+    stringTable->num_entries++;
+    if ((float)stringTable->num_entries / (float)stringTable->table_size > LOAD_FACTOR_THRESHOLD) resize(stringTable);
+    return entry->chars;
+}
+
+char* retainReference(char* key) {
+    STRING_HEADER(key)->refCount++;
+    return key;
 }
 
 void removeReference(char* key) {
-    // Find the entry
-    uint32_t* value = internalFind(stringTable, key);
-    if (value == NULL) {
-        fprintf(stderr, "%s\n", key);
-        // Error
-        strHashError("Key not found");
-    } else {
-        // If found, decrement the reference count
-        (*value)--;
-        if (*value == 0) {
-            // If the reference count is 0, delete the entry
-            delete(stringTable, key);
-        }
+    internedString* header = STRING_HEADER(key);
+    if (header->refCount == 0) strHashError("Key not found");
+    // Decrement the reference count
+    if (--header->refCount != 0) return;
+    // If the reference count is 0, unlink and delete the entry
+    internedString** p = &stringTable->entries[header->hash % stringTable->table_size];
+    while (*p != header) {
+        if (*p == NULL) strHashError("Key not found");
+        p = &(*p)->next;
     }
+    *p = header->next;
+    stringTable->num_entries--;
+    free(header);
+}
+
+char* findInterned(char* key) {
+    uint32_t length;
+    uint32_t hash = hashStringLength(key, &length);
+    internedString* entry = findEntry(key, hash, length);
+    return entry == NULL ? NULL : entry->chars;
+}
+
+uint16_t internSymbol(char* name) {
+    char* key = addReference(name);
+    uint16_t symbol = STRING_SYMBOL(key);
+    if (symbol != SYMBOL_NONE) {
+        removeReference(key);
+        return symbol;
+    }
+    // New symbol keeps the reference taken above
+    if (symbolCount > SYMBOL_MAX) strHashError("Symbol table overflow");
+    if (symbolCount == symbolCapacity) {
+        symbolCapacity *= 2;
+        char** newNames = realloc(symbolNames, sizeof(char*) * symbolCapacity);
+        if (newNames == NULL) strHashError("Symbol table reallocation failed");
+        symbolNames = newNames;
+    }
+    symbol = (uint16_t) symbolCount++;
+    symbolNames[symbol] = key;
+    STRING_SYMBOL(key) = symbol;
+    return symbol;
+}
+
+uint32_t symbolTotal() {
+    return symbolCount;
+}
+
+char* symbolName(uint16_t symbol) {
+    if (symbol == SYMBOL_NONE || symbol >= symbolCount) strHashError("Invalid symbol");
+    return symbolNames[symbol];
 }
 
 void printStringHash() {
@@ -273,4 +264,3 @@ void printStringHash() {
 void printStringHashStructure() {
     printHashTableStructure(stringTable);
 }
-
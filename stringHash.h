@@ -5,36 +5,78 @@
 #ifndef CJ_2_STRINGHASH_H
 #define CJ_2_STRINGHASH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-typedef struct Entry {
-    char* key;
-    uint32_t value;
-    struct Entry* next;
-} Entry;
+typedef struct internedString internedString;
+
+// Header stored in front of every interned string, char* handles point at chars
+struct internedString {
+    internedString* next;
+    uint32_t length;
+    uint32_t hash;
+    uint32_t refCount;
+    uint16_t symbol; // Attribute symbol ID, SYMBOL_NONE if the string is not a symbol
+    char chars[];
+};
+
+#define STRING_HEADER(str) ((internedString*) ((str) - offsetof(internedString, chars)))
+#define STRING_HASH(str) (STRING_HEADER(str)->hash)
+#define STRING_LENGTH(str) (STRING_HEADER(str)->length)
+#define STRING_SYMBOL(str) (STRING_HEADER(str)->symbol)
+
+// Attribute and method names are interned into dense symbol IDs at compile time,
+// ID 0 marks an empty attribute table slot
+#define SYMBOL_NONE 0
+#define SYMBOL_MAX (UINT16_MAX - 1)
 
 typedef struct HashTable {
     uint32_t table_size;
     uint32_t num_entries;
-    Entry** entries;
+    internedString** entries;
 } HashTable;
 
+// Names looked up by the runtime itself, symbols for the lifetime of the string table
+typedef enum {
+    NAME_PRINT,
+    NAME_HASH_STRING,
+    NAME_GET,
+    NAME_SET,
+    NAME_NG,
+    NAME_ADD,
+    NAME_SUB,
+    NAME_MUL,
+    NAME_DIV,
+    NAME_MOD,
+    NAME_POW,
+    NAME_EQ,
+    NAME_LESS,
+    NAME_MORE,
+    NAME_LEQ,
+    NAME_MEQ,
+    BUILTIN_NAME_COUNT
+} builtinName;
+
+extern uint16_t builtinSymbols[BUILTIN_NAME_COUNT];
+#define BUILTIN_SYMBOL(name) builtinSymbols[name]
+
 uint32_t hashString(char* str);
+uint32_t hashStringLength(char* str, uint32_t* length);
 HashTable* createHashTable(uint32_t table_size);
 void deleteHashTable(HashTable* table);
-char* internalInsert(HashTable* table, char* key, uint32_t value);
-void internalResizeInsert(HashTable* table, char* key, uint32_t value);
-uint32_t* internalFind(HashTable* table, char* key);
-char* internalFindKeyPtr(HashTable* table, char* key);
-void delete(HashTable* table, char* key);
 void resize(HashTable* table);
 void printHashTable(HashTable* table);
 void printHashTableStructure(HashTable* table);
 
 void initStringHash();
 void deleteStringHash();
-char* addReference(char* key);
-void removeReference(char* key);
+char* addReference(char* key); // Interns key
+char* retainReference(char* key); // Key must be interned
+void removeReference(char* key); // Key must be interned
+char* findInterned(char* key);
+uint16_t internSymbol(char* name); // Symbols keep their string interned
+char* symbolName(uint16_t symbol);
+uint32_t symbolTotal(); // Symbols interned so far, including SYMBOL_NONE
 void printStringHash();
 
 void printStringHashStructure();
@@ -6,10 +6,14 @@
 #include "errors.h"
 #include "common.h"
 #include "debug.h"
+#include "lexScan.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#ifdef PRINT_TOKENIZE_TIME
+#include <time.h>
+#endif
 
 #define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
 #define IS_UPPER_ALPHA(c) ((c) >= 'A' && (c) <= 'Z')
@@ -33,6 +37,18 @@
   Tokenizer->currChar++; \
   Tokenizer->currIndex++; \
 } while(0)
+// Jump to a later character on the same line
+#define ADVANCE_TO(ptr) do { \
+  char* target = (ptr); \
+  Tokenizer->currIndex += target - Tokenizer->currChar; \
+  Tokenizer->currChar = target; \
+} while(0)
+
+#define KEYWORD_COUNT (sizeof(keywords)/sizeof(keywords[0]))
+// Perfect hash over first character, last character and length, collision free for the keyword list
+#define KEYWORD_HASH_SIZE 64
+#define KEYWORD_HASH(start, length) \
+    ((((uint32_t)(unsigned char)(start)[0] << 3) + (uint32_t)(unsigned char)(start)[(length) - 1] * 45 + (length)) & (KEYWORD_HASH_SIZE - 1))
 
 // List of keywords
 const char *keywords[] = {
@@ -41,6 +57,7 @@ const char *keywords[] = {
         "else",
         "while",
         "for",
+        "in",
         "break",
         "continue",
         "return",
@@ -69,6 +86,7 @@ tokenType keywordTypes[] = {
         KEYWORD_ELSE,
         KEYWORD_WHILE,
         KEYWORD_FOR,
+        KEYWORD_IN,
         KEYWORD_BREAK,
         KEYWORD_CONTINUE,
         KEYWORD_RETURN,
@@ -92,6 +110,18 @@ tokenType keywordTypes[] = {
 
 tokenizer* Tokenizer;
 
+// Keyword index for each hash slot, -1 when empty
+static int8_t keywordSlots[KEYWORD_HASH_SIZE];
+
+static void initKeywordSlots() {
+    memset(keywordSlots, -1, sizeof(keywordSlots));
+    for (int i = 0; i < KEYWORD_COUNT; i++) {
+        uint32_t slot = KEYWORD_HASH(keywords[i], strlen(keywords[i]));
+        if (keywordSlots[slot] != -1) parsingError(0, 0, 0, "Keyword hash collision");
+        keywordSlots[slot] = (int8_t) i;
+    }
+}
+
 token* checkAssignRaiseError(char nextChar, tokenType tokenTypeIfNext) {
     if (NEXT_CHAR == nextChar) {
         INC_CHAR();
@@ -99,7 +129,7 @@ token* checkAssignRaiseError(char nextChar, tokenType tokenTypeIfNext) {
         INC_CHAR();
         return t;
     } else { \
-        parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "Invalid expression");
+        parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Invalid expression");
         return NULL;
     }
 }
@@ -116,8 +146,8 @@ char* loadFile(const char* sourcePath) {
     size_t fileSize = ftell(file);
     rewind(file);
 
-    // Allocate memory for the entire file
-    char* buffer = (char*) malloc(fileSize + 1);
+    // Allocate memory for the entire file, padded for the lexer's vector loads
+    char* buffer = (char*) malloc(fileSize + 1 + LEX_SCAN_PADDING);
     if (buffer == NULL) {
         fprintf(stderr, "Not enough memory to read \"%s\".\n", sourcePath);
         return NULL;
@@ -131,114 +161,116 @@ char* loadFile(const char* sourcePath) {
     }
 
     // Null-terminate the buffer
-    buffer[bytesRead] = '\0';
+    memset(buffer + bytesRead, '\0', 1 + LEX_SCAN_PADDING);
 
     fclose(file);
     return buffer;
 }
 
-void initTokenizer(char* sourcefile, char* sourceName) {
+void initTokenizer() {
     Tokenizer = (tokenizer*)malloc(sizeof(tokenizer));
-    Tokenizer->sourceStack[0] = sourcefile;
-    Tokenizer->sourceStackCount = 1;
-    Tokenizer->totalSourceCount = 0;
+    Tokenizer->currSourceIndex = 0;
     Tokenizer->currToken = NULL;
     Tokenizer->startToken = NULL;
-    Tokenizer->sourceTable = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
-    getRefIndex(Tokenizer->sourceTable, sourceName);
+    Tokenizer->lastToken = NULL;
+    Tokenizer->tokenCount = 0;
+    Tokenizer->arena = NULL;
+    initLexScanners();
+    initKeywordSlots();
 }
 
 void freeTokenizer() {
-    token* t = Tokenizer->startToken;
-    while (t != NULL) {
-        token* next = t->nextToken;
-        freeToken(t);
-        t = next;
+    // Tokens and their text all live in the arena
+    tokenArenaBlock* block = Tokenizer->arena;
+    while (block != NULL) {
+        tokenArenaBlock* next = block->next;
+        free(block);
+        block = next;
     }
     free(Tokenizer);
 }
 
+static void* tokenArenaAlloc(size_t size) {
+    // Keep tokens pointer aligned
+    size = (size + 7) & ~(size_t) 7;
+    tokenArenaBlock* block = Tokenizer->arena;
+    if (block == NULL || block->used + size > block->capacity) {
+        size_t capacity = size > TOKEN_ARENA_BLOCK_SIZE ? size : TOKEN_ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(tokenArenaBlock) + capacity);
+        if (block == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Token arena allocation failed");
+        block->next = Tokenizer->arena;
+        block->used = 0;
+        block->capacity = capacity;
+        Tokenizer->arena = block;
+    }
+    void* result = block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+static char* tokenArenaCopy(const char* start, size_t length) {
+    char* str = tokenArenaAlloc(length + 1);
+    memcpy(str, start, length);
+    str[length] = '\0';
+    return str;
+}
+
 token* createToken(tokenType type, char* value, unsigned int line, unsigned int index) {
-    token* t = (token*)malloc(sizeof(token));
+    token* t = tokenArenaAlloc(sizeof(token));
     t->type = type;
     t->value = value;
     t->line = line;
     t->index = index;
-    t->sourceIndex = Tokenizer->totalSourceCount - 1;
-    t->prevToken = NULL;
+    t->sourceIndex = Tokenizer->currSourceIndex;
+    t->prevToken = Tokenizer->lastToken;
     t->nextToken = NULL;
 
-    if (Tokenizer->startToken == NULL) {
+    // Append at the tail
+    if (Tokenizer->lastToken == NULL) {
         Tokenizer->startToken = t;
     } else {
-        token* lastToken = Tokenizer->startToken;
-        while (lastToken->nextToken != NULL) {
-            lastToken = lastToken->nextToken;
-        }
-        lastToken->nextToken = t;
-        t->prevToken = lastToken;
+        Tokenizer->lastToken->nextToken = t;
     }
+    Tokenizer->lastToken = t;
+    Tokenizer->tokenCount++;
     return t;
 }
 
-void freeToken(token* t) {
-    if (t->value != NULL) free(t->value);
-    free(t);
-}
-
 token* nextNumberToken() { // Called when CURR_CHAR location is at first digit
     token* t = NULL;
     unsigned int startingIndex = Tokenizer->currIndex;
     char* startingChar = Tokenizer->currChar;
     // Handle negative numbers
     if (CURR_CHAR == '-') INC_CHAR();
-    // Accept only one decimal point
-    bool hasDecimal = false;
-    while (IS_DIGIT(CURR_CHAR) || CURR_CHAR == '.') {
-        if (CURR_CHAR == '.') {
-            // Raise error if we already have a decimal
-            if (hasDecimal) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "Invalid number");
-            // If the next character is not a digit, break and return the number before the decimal
-            if (!IS_DIGIT(NEXT_CHAR)) break;
-            // Otherwise, we have a decimal
-            hasDecimal = true;
-        }
+    ADVANCE_TO(activeLexScanners.skipDigits(Tokenizer->currChar));
+    // If the next character is not a digit, return the number before the decimal
+    if (CURR_CHAR == '.' && IS_DIGIT(NEXT_CHAR)) {
         INC_CHAR();
+        ADVANCE_TO(activeLexScanners.skipDigits(Tokenizer->currChar));
+        // Accept only one decimal point
+        if (CURR_CHAR == '.') parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Invalid number");
     }
     // Copy number to length
-    unsigned int length = Tokenizer->currIndex - startingIndex;
-    char* str = (char*)malloc(sizeof(char) * (length + 1));
-    for (int i = 0; i < length; i++) str[i] = *(startingChar + i);
-    str[length] = '\0';
+    char* str = tokenArenaCopy(startingChar, Tokenizer->currIndex - startingIndex);
     t = createToken(NUMBER, str, Tokenizer->currLine, startingIndex);
     return t;
 }
 
 token* nextIdentifierToken() { // Called when CURR_CHAR location is at first letter
-    char buf[IDENTIFIER_BUFFER_SIZE]; // Buffer for the identifier
-    int idx = 0;
-    bool isIdentifier = false;
     unsigned int startingIndex = Tokenizer->currIndex;
+    char* startingChar = Tokenizer->currChar;
 
-    // Collect characters until we hit a non-alphabetic character
-    while ((IS_ALPHA(CURR_CHAR) || IS_DIGIT(CURR_CHAR) || CURR_CHAR == '_') && idx < sizeof(buf) - 1) {
-        // Check if we have an identifier ahead of comparing string
-        if (IS_DIGIT(CURR_CHAR) || CURR_CHAR == '_') isIdentifier = true;
-        buf[idx++] = CURR_CHAR;
-        INC_CHAR(); // increment to next char
-    }
-    buf[idx] = '\0'; // null terminate the string
-    // If already an identifier, return identifier token
-    if (isIdentifier) return createToken(IDENTIFIER, strdup(buf), Tokenizer->currLine, startingIndex);
-    // Check if the string matches a keyword
-    for (int i = 0; i < sizeof(keywords)/sizeof(keywords[0]); i++) {
-        if (strcmp(buf, keywords[i]) == 0) {
-            // If it's a keyword, return a token of the keyword's type
-            return createToken(keywordTypes[i], NULL, Tokenizer->currLine, startingIndex);
-        }
+    // Collect characters until we hit a non-identifier character
+    ADVANCE_TO(activeLexScanners.skipIdentifier(startingChar));
+    size_t length = Tokenizer->currIndex - startingIndex;
+    // Check if the string matches a keyword, the only candidate is the one in its hash slot
+    int8_t keyword = keywordSlots[KEYWORD_HASH(startingChar, length)];
+    if (keyword != -1 && strncmp(startingChar, keywords[keyword], length) == 0 && keywords[keyword][length] == '\0') {
+        // If it's a keyword, return a token of the keyword's type
+        return createToken(keywordTypes[keyword], NULL, Tokenizer->currLine, startingIndex);
     }
     // Determined as an identifier
-    return createToken(IDENTIFIER, strdup(buf), Tokenizer->currLine, startingIndex);
+    return createToken(IDENTIFIER, tokenArenaCopy(startingChar, length), Tokenizer->currLine, startingIndex);
 }
 
 token* nextStringToken() { // Called when CURR_CHAR location is at first string character
@@ -246,19 +278,19 @@ token* nextStringToken() { // Called when CURR_CHAR location is at first string
     unsigned int startingIndex = Tokenizer->currIndex;
     char* startingChar = Tokenizer->currChar;
     unsigned int specialCharCount = 0;
-    while (CURR_CHAR != '\0' && CURR_CHAR != '\n' && CURR_CHAR != '"') {
+    while (true) {
+        ADVANCE_TO(activeLexScanners.skipStringBody(Tokenizer->currChar));
+        if (CURR_CHAR != '\\') break;
         // Handle escape characters
-        if (CURR_CHAR == '\\') {
-            INC_CHAR();
-            if (!(CURR_CHAR == 'n' || CURR_CHAR == 't' || CURR_CHAR == '"')) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "Invalid escape character");
-            specialCharCount++;
-        }
+        INC_CHAR();
+        if (!(CURR_CHAR == 'n' || CURR_CHAR == 't' || CURR_CHAR == '"')) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Invalid escape character");
+        specialCharCount++;
         INC_CHAR();
     }
-    if (CURR_CHAR !=  '"') parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "String not closed");
+    if (CURR_CHAR !=  '"') parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "String not closed");
     // Copy string to length
     unsigned int length = (Tokenizer->currIndex - startingIndex) - specialCharCount;
-    char* str = (char*)malloc(sizeof(char) * (length + 1));
+    char* str = tokenArenaAlloc(length + 1);
     char* sourcePtr = startingChar;
     for (int i = 0; i < length; i++) {
         // Handle escape characters
@@ -286,25 +318,22 @@ token* nextStringToken() { // Called when CURR_CHAR location is at first string
 }
 
 void skipWhiteSpace() {
-    while (CURR_CHAR == ' ' || CURR_CHAR == '\t' || CURR_CHAR == '\n') {
-        if (CURR_CHAR == '\n') {
-            INC_LINE();
-            Tokenizer->currChar++;
-            Tokenizer->currIndex = 0;
-        } else {
-            INC_CHAR();
-        }
+    while (true) {
+        ADVANCE_TO(activeLexScanners.skipBlank(Tokenizer->currChar));
+        if (CURR_CHAR != '\n') return;
+        INC_LINE();
+        Tokenizer->currChar++;
+        Tokenizer->currIndex = 0;
     }
 }
 
 token* tokenizeNext() {
     token* t = NULL;
-    // Skip whitespace
+    // Skip whitespace and comments
     skipWhiteSpace();
-    // Skip comments
-    if (CURR_CHAR == '#') {
-        while (CURR_CHAR != '\n' && CURR_CHAR != '\0') INC_CHAR();
-        return tokenizeNext();
+    while (CURR_CHAR == '#') {
+        ADVANCE_TO(activeLexScanners.skipLine(Tokenizer->currChar));
+        skipWhiteSpace();
     }
     // Match set/dict prefix
     if ((CURR_CHAR == 'd' || CURR_CHAR == 's') && NEXT_CHAR == '{') {
@@ -357,7 +386,7 @@ token* tokenizeNext() {
         case '=': CHECK_ASSIGN('=', DOUBLE_EQUAL, EQUAL) break;
         case '\0': return NULL;
 
-        default: parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "Unhandled current character");
+        default: parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Unhandled current character");
     }
 
     INC_CHAR();
@@ -382,44 +411,32 @@ token* nextToken() {
     return result;
 }
 
-refTable* tokenize() {
-    refTable* globalDeclTable = createRefTable(GLOBAL_REF_TABLE_INIT_SIZE);
-    // Continue tokenizing until we reach the end of the source stack
-    while (Tokenizer->sourceStackCount > 0) {
-        // Setup source
-        Tokenizer->currChar = Tokenizer->sourceStack[--Tokenizer->sourceStackCount];
-        Tokenizer->currLine = 0;
-        Tokenizer->currIndex = 0;
-        Tokenizer->totalSourceCount++;
-        // Tokenize
-        token* temp = tokenizeNext();
-        while (temp != NULL) {
-            token* prev = temp;
-            temp = tokenizeNext();
-            if (TOKEN_TYPE(prev) == KEYWORD_GLOBAL) {
-                if (TOKEN_TYPE(temp) != IDENTIFIER) parsingError(prev->line, prev->index, Tokenizer->totalSourceCount-1, "Invalid global statement");
-                // Add to global declaration table
-                getRefIndex(globalDeclTable, temp->value);
-            } else if (TOKEN_TYPE(prev) == KEYWORD_INCLUDE) {
-                if (TOKEN_TYPE(temp) != IDENTIFIER) parsingError(prev->line, prev->index, Tokenizer->totalSourceCount-1, "Expected identifier after include");
-                // Add to open source and add to source list
-                if (!refTableContains(Tokenizer->sourceTable, TOKEN_VALUE(temp))) {
-                    char* newSource = loadFile(TOKEN_VALUE(temp));
-                    if (newSource == NULL) parsingError(prev->line, prev->index, Tokenizer->totalSourceCount-1, "Could not load file");
-                    Tokenizer->sourceStack[Tokenizer->sourceStackCount++] = newSource;
-                    // Attach to error handler
-                    attachSource(newSource, TOKEN_VALUE(temp));
-                    // Add to source table
-                    getRefIndex(Tokenizer->sourceTable, TOKEN_VALUE(temp));
-                }
-            }
-        }
-    }
-    // Free source table
-    freeRefTable(Tokenizer->sourceTable);
-    // Set init token
-    Tokenizer->currToken = Tokenizer->startToken;
-    return globalDeclTable;
+token* tokenize(char* source, uint32_t sourceIndex) {
+#ifdef PRINT_TOKENIZE_TIME
+    struct timespec startTime, endTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    size_t sourceBytes = strlen(source);
+    uint32_t startCount = Tokenizer->tokenCount;
+#endif
+    // Setup source, its tokens start a new list
+    Tokenizer->currChar = source;
+    Tokenizer->currSourceIndex = sourceIndex;
+    Tokenizer->currLine = 0;
+    Tokenizer->currIndex = 0;
+    Tokenizer->startToken = NULL;
+    Tokenizer->lastToken = NULL;
+    // Tokenize
+    while (tokenizeNext() != NULL);
+#ifdef PRINT_TOKENIZE_TIME
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+    double elapsedMs = (endTime.tv_sec - startTime.tv_sec) * 1e3 + (endTime.tv_nsec - startTime.tv_nsec) / 1e6;
+    printf("Tokenized %u tokens from %zu bytes in %.3f ms (%.1f MB/s)\n", Tokenizer->tokenCount - startCount, sourceBytes, elapsedMs, sourceBytes / 1e3 / elapsedMs);
+#endif
+    return Tokenizer->startToken;
+}
+
+void startTokenStream(token* start) {
+    Tokenizer->currToken = start;
 }
 
 bool isAssignmentOperator(tokenType ty) {
@@ -439,12 +456,12 @@ bool isAssignmentOperator(tokenType ty) {
 
 bool isAssignmentStatement() {
     // Check for invalid tokenizer state
-    if (Tokenizer->currToken == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "Uninitialized tokenizer");
-    if (Tokenizer->currToken->prevToken == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "No previous token");
+    if (Tokenizer->currToken == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Uninitialized tokenizer");
+    if (Tokenizer->currToken->prevToken == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "No previous token");
     // Find the first token of the statement
     token* t = Tokenizer->currToken->prevToken;
     // Check if the first token is assignment operator
-    if (isAssignmentOperator(TOKEN_TYPE(t))) parsingError(t->line, t->index, Tokenizer->totalSourceCount-1, "No left hand side of assignment");
+    if (isAssignmentOperator(TOKEN_TYPE(t))) parsingError(t->line, t->index, Tokenizer->currSourceIndex, "No left hand side of assignment");
     // Initial increment
     t = t->nextToken;
     while (t != NULL && TOKEN_TYPE(t) != SEMICOLON) {
@@ -453,6 +470,6 @@ bool isAssignmentStatement() {
         // Increment
         t = t->nextToken;
     }
-    if (t == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->totalSourceCount-1, "Unfinished statement");
+    if (t == NULL) parsingError(Tokenizer->currLine, Tokenizer->currIndex, Tokenizer->currSourceIndex, "Unfinished statement");
     return false;
 }
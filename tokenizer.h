@@ -66,6 +66,7 @@ typedef enum tokenType {
     KEYWORD_ELSE,
     KEYWORD_WHILE,
     KEYWORD_FOR,
+    KEYWORD_IN,
     KEYWORD_BREAK,
     KEYWORD_CONTINUE,
     KEYWORD_RETURN,
@@ -102,28 +103,39 @@ struct token {
     token* nextToken;
 };
 
+// Bump arena for tokens and their text, released as a whole by freeTokenizer
+typedef struct tokenArenaBlock tokenArenaBlock;
+
+struct tokenArenaBlock {
+    tokenArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+};
+
 typedef struct tokenizer {
-    char* sourceStack[INCLUDE_STACK_SIZE];
-    uint32_t sourceStackCount;
-    uint32_t totalSourceCount;
+    uint32_t currSourceIndex; // Error tracer index of the source being tokenized
     char* currChar;
     unsigned int currLine;
     unsigned int currIndex;
     token* currToken;
     token* startToken;
-    refTable* sourceTable;
+    token* lastToken;
+    uint32_t tokenCount;
+    tokenArenaBlock* arena;
 } tokenizer;
 
 char* loadFile(const char* sourcePath);
 
-void initTokenizer(char* sourcefile, char* sourceName);
+void initTokenizer();
 void freeTokenizer();
 
 token* createToken(tokenType type, char* value, unsigned int line, unsigned int index);
-void freeToken(token* t);
 
 token* nextToken();
-refTable* tokenize();
+// Tokens of each source form their own list, valid until the tokenizer is freed
+token* tokenize(char* source, uint32_t sourceIndex);
+void startTokenStream(token* start);
 
 bool isAssignmentOperator(tokenType ty);
 
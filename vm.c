@@ -6,6 +6,7 @@
 #include "errors.h"
 #include "objectManager.h"
 #include "compiler.h"
+#include "stringHash.h"
 
 #include <math.h>
 #include <string.h>
@@ -29,6 +30,31 @@
 #define STACK_PUSH(obj) (*vm->stackTop++ = (obj))
 #define STACK_POP() (*(--vm->stackTop))
 
+// Operands of specialized number ops are proven numbers, no type checks
+#define NUM_OPERAND(capture, target) \
+    switch (capture) { \
+        case CAPTURE_NONE: target = VALUE_NUMBER_VALUE(STACK_POP()); break; \
+        case CAPTURE_PAYLOAD: target = (int32_t) GET_DWORD(4); break; \
+        case CAPTURE_CONSTANT: target = VALUE_NUMBER_VALUE(CONST_REF(GET_WORD(localAddrSlot))); localAddrSlot += 2; break; \
+        default: target = VALUE_NUMBER_VALUE(LOCAL_REF(GET_WORD(localAddrSlot))); localAddrSlot += 2; \
+    }
+// Stores into the destination local when one is encoded, a payload operand owns those bytes
+#define BINARY_RESULT(result) { \
+        Value binaryResult = (result); \
+        if (GET_NIBBLE(2) != CAPTURE_PAYLOAD && GET_NIBBLE(3) != CAPTURE_PAYLOAD && GET_WORD(BINARY_DEST_WORD) != 0) { \
+            LOCAL_REF(GET_WORD(BINARY_DEST_WORD) - 1) = binaryResult; \
+        } else { \
+            STACK_PUSH(binaryResult); \
+        } \
+    }
+#define NUM_BINARY_OP(result) { \
+        uint8_t localAddrSlot = 2; \
+        double rightVal, leftVal; \
+        NUM_OPERAND(GET_NIBBLE(3), rightVal) \
+        NUM_OPERAND(GET_NIBBLE(2), leftVal) \
+        BINARY_RESULT((result)) \
+    }
+
 VM* vm;
 uint64_t** ipStack[VM_LOCAL_REF_TABLE_STACK_INIT_SIZE];
 uint64_t*** ipStackTop;
@@ -186,25 +212,28 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                 break;
             }
             case OP_GET_ATTR: {
-                Value attrName = CONST_REF(GET_BYTE(1));
-                if (VALUE_TYPE(attrName) != BUILTIN_STR) runtimeError("Attribute name is not a string");
                 Value obj = STACK_POP();
-                Value attrObj = getAttr(obj, VALUE_STR_VALUE(attrName));
+                Value attrObj = getAttr(obj, GET_WORD(1));
                 // Insert new object
                 STACK_PUSH(attrObj);
                 break;
             }
             case OP_GET_ATTR_CALL: {
-                Value attrName = CONST_REF(GET_BYTE(1));
-                if (VALUE_TYPE(attrName) != BUILTIN_STR) runtimeError("Attribute name is not a string");
                 Value obj = STACK_POP();
-                Value attrObj = getAttr(obj, VALUE_STR_VALUE(attrName));
+                Value attrObj = getAttr(obj, GET_WORD(1));
                 // Insert new object
                 STACK_PUSH(attrObj);
                 // Reinsert self
                 STACK_PUSH(obj);
                 break;
             }
+            case OP_GET_CLASS_ATTR_CALL: {
+                // Receiver class was resolved by the optimizer
+                Value obj = STACK_POP();
+                STACK_PUSH(CLASS_FIND_ATTR(classArray[GET_WORD(3)], GET_WORD(1)));
+                STACK_PUSH(obj);
+                break;
+            }
             case OP_GET_GLOBAL_REF_ATTR: {
                 // Push attribute object
                 Value retrievedObj = GLOBAL_REF(GET_WORD(1));
@@ -345,10 +374,19 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                         break;
                     }
                     case CAPTURE_PAYLOAD: {
-                        rightVal = GET_DWORD(4);
+                        rightVal = (int32_t) GET_DWORD(4);
                         rightIsNum = true;
                         break;
                     }
+                    case CAPTURE_CONSTANT: {
+                        rightObj = CONST_REF(GET_WORD(localAddrSlot));
+                        if (VALUE_TYPE(rightObj) == VAL_NUMBER) {
+                            rightIsNum = true;
+                            rightVal = VALUE_NUMBER_VALUE(rightObj);
+                        }
+                        localAddrSlot += 2;
+                        break;
+                    }
                     case CAPTURE_VARIABLE: {
                         rightObj = LOCAL_REF(GET_WORD(localAddrSlot));
                         if (VALUE_TYPE(rightObj) == VAL_NUMBER) {
@@ -374,10 +412,19 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                         break;
                     }
                     case CAPTURE_PAYLOAD: {
-                        leftVal = GET_DWORD(4);
+                        leftVal = (int32_t) GET_DWORD(4);
                         leftIsNum = true;
                         break;
                     }
+                    case CAPTURE_CONSTANT: {
+                        leftObj = CONST_REF(GET_WORD(localAddrSlot));
+                        if (VALUE_TYPE(leftObj) == VAL_NUMBER) {
+                            leftIsNum = true;
+                            leftVal = VALUE_NUMBER_VALUE(leftObj);
+                        }
+                        localAddrSlot += 2;
+                        break;
+                    }
                     case CAPTURE_VARIABLE: {
                         leftObj = LOCAL_REF(GET_WORD(localAddrSlot));
                         if (VALUE_TYPE(leftObj) == VAL_NUMBER) {
@@ -390,11 +437,11 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                         runtimeError("Unknown left capture type");
                 }
                 if (rightIsNum && leftIsNum) {
-                    STACK_PUSH(NUMBER_VAL(payloadNumBinaryOp(leftVal,rightVal, op)));
+                    BINARY_RESULT(NUMBER_VAL(payloadNumBinaryOp(leftVal,rightVal, op)))
                 } else {
                     if (IS_INTERNAL_NULL(rightObj)) rightObj = NUMBER_VAL(rightVal);
                     if (IS_INTERNAL_NULL(leftObj)) leftObj = NUMBER_VAL(leftVal);
-                    STACK_PUSH(binaryOperation(leftObj, rightObj, op));
+                    BINARY_RESULT(binaryOperation(leftObj, rightObj, op))
                 }
                 break;
             }
@@ -419,10 +466,19 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                         break;
                     }
                     case CAPTURE_PAYLOAD: {
-                        rightVal = GET_DWORD(4);
+                        rightVal = (int32_t) GET_DWORD(4);
                         rightIsNum = true;
                         break;
                     }
+                    case CAPTURE_CONSTANT: {
+                        rightObj = CONST_REF(GET_WORD(localAddrSlot));
+                        if (VALUE_TYPE(rightObj) == VAL_NUMBER) {
+                            rightIsNum = true;
+                            rightVal = VALUE_NUMBER_VALUE(rightObj);
+                        }
+                        localAddrSlot += 2;
+                        break;
+                    }
                     case CAPTURE_VARIABLE: {
                         rightObj = LOCAL_REF(GET_WORD(localAddrSlot));
                         if (VALUE_TYPE(rightObj) == VAL_NUMBER) {
@@ -448,10 +504,19 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                         break;
                     }
                     case CAPTURE_PAYLOAD: {
-                        leftVal = GET_DWORD(4);
+                        leftVal = (int32_t) GET_DWORD(4);
                         leftIsNum = true;
                         break;
                     }
+                    case CAPTURE_CONSTANT: {
+                        leftObj = CONST_REF(GET_WORD(localAddrSlot));
+                        if (VALUE_TYPE(leftObj) == VAL_NUMBER) {
+                            leftIsNum = true;
+                            leftVal = VALUE_NUMBER_VALUE(leftObj);
+                        }
+                        localAddrSlot += 2;
+                        break;
+                    }
                     case CAPTURE_VARIABLE: {
                         leftObj = LOCAL_REF(GET_WORD(localAddrSlot));
                         if (VALUE_TYPE(leftObj) == VAL_NUMBER) {
@@ -464,16 +529,27 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                         runtimeError("Unknown left capture type");
                 }
                 if (rightIsNum && leftIsNum) {
-                    STACK_PUSH(payloadNumBinaryComp(leftVal,rightVal, op));
+                    BINARY_RESULT(payloadNumBinaryComp(leftVal,rightVal, op))
                 } else {
                     if (IS_INTERNAL_NULL(rightObj)) rightObj = NUMBER_VAL(rightVal);
                     if (IS_INTERNAL_NULL(leftObj)) leftObj = NUMBER_VAL(leftVal);
-                    STACK_PUSH(binaryOperation(leftObj, rightObj, op));
+                    BINARY_RESULT(binaryOperation(leftObj, rightObj, op))
                 }
                 break;
             }
+            case OP_ADD_NUM: NUM_BINARY_OP(NUMBER_VAL(leftVal + rightVal)) break;
+            case OP_SUB_NUM: NUM_BINARY_OP(NUMBER_VAL(leftVal - rightVal)) break;
+            case OP_MUL_NUM: NUM_BINARY_OP(NUMBER_VAL(leftVal * rightVal)) break;
+            case OP_DIV_NUM: NUM_BINARY_OP(NUMBER_VAL(leftVal / rightVal)) break;
+            case OP_MOD_NUM: NUM_BINARY_OP(NUMBER_VAL(fmod(leftVal, rightVal))) break;
+            case OP_POW_NUM: NUM_BINARY_OP(NUMBER_VAL(pow(leftVal, rightVal))) break;
+            case OP_LESS_NUM: NUM_BINARY_OP(BOOL_VAL(leftVal < rightVal)) break;
+            case OP_MORE_NUM: NUM_BINARY_OP(BOOL_VAL(leftVal > rightVal)) break;
+            case OP_LESS_EQUAL_NUM: NUM_BINARY_OP(BOOL_VAL(leftVal <= rightVal)) break;
+            case OP_MORE_EQUAL_NUM: NUM_BINARY_OP(BOOL_VAL(leftVal >= rightVal)) break;
+            case OP_EQUAL_NUM: NUM_BINARY_OP(BOOL_VAL(leftVal == rightVal)) break;
             case OP_NEGATE:
-                STACK_PUSH(unaryOperation(STACK_POP(), "_ng"));
+                STACK_PUSH(unaryOperation(STACK_POP(), BUILTIN_SYMBOL(NAME_NG)));
                 break;
             case OP_NOT: {
                 Value obj = STACK_POP();
@@ -511,6 +587,120 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                 }
                 break;
             }
+            case OP_ITER_INIT: {
+                // State slots hold the iterable, the cursor and the size or table version at loop entry
+                uint16_t stateIndex = GET_WORD(1);
+                Value iterable = STACK_POP();
+                uint32_t snapshot = 0;
+                switch (VALUE_TYPE(iterable)) {
+                    case BUILTIN_LIST: snapshot = VALUE_LIST_VALUE(iterable)->size; break;
+                    case BUILTIN_NUM_ARRAY: snapshot = VALUE_NUM_ARRAY_VALUE(iterable)->size; break;
+                    case BUILTIN_DICT: snapshot = VALUE_DICT_VALUE(iterable)->table.version; break;
+                    case BUILTIN_SET: snapshot = VALUE_SET_VALUE(iterable)->table.version; break;
+                    default: runtimeError("For-in target is not a list, dict, set or numArray");
+                }
+                LOCAL_REF(stateIndex) = iterable;
+                LOCAL_REF(stateIndex + 1) = NUMBER_VAL(0);
+                LOCAL_REF(stateIndex + 2) = NUMBER_VAL(snapshot);
+                break;
+            }
+            case OP_ITER_NEXT: {
+                uint16_t stateIndex = GET_WORD(3);
+                Value iterable = LOCAL_REF(stateIndex);
+                uint32_t cursor = (uint32_t) VALUE_NUMBER_VALUE(LOCAL_REF(stateIndex + 1));
+                uint32_t snapshot = (uint32_t) VALUE_NUMBER_VALUE(LOCAL_REF(stateIndex + 2));
+                bool hasNext = false;
+                Value element;
+                switch (VALUE_TYPE(iterable)) {
+                    case BUILTIN_LIST: {
+                        runtimeList* list = VALUE_LIST_VALUE(iterable);
+                        if (list->size != snapshot) listError("List size changed during for-in iteration");
+                        if (cursor < list->size) {
+                            element = list->list[cursor++];
+                            hasNext = true;
+                        }
+                        break;
+                    }
+                    case BUILTIN_NUM_ARRAY: {
+                        runtimeNumArray* array = VALUE_NUM_ARRAY_VALUE(iterable);
+                        if (array->size != snapshot) numArrayError("NumArray size changed during for-in iteration");
+                        if (cursor < array->size) {
+                            element = NUMBER_VAL(array->data[cursor++]);
+                            hasNext = true;
+                        }
+                        break;
+                    }
+                    case BUILTIN_DICT: {
+                        runtimeDict* dict = VALUE_DICT_VALUE(iterable);
+                        if (dict->table.version != snapshot) dictError("Dict keys changed during for-in iteration");
+                        // Skip the holes left by removed entries
+                        while (cursor < dict->table.entryCount) {
+                            element = DICT_ENTRIES(dict)[cursor++].key;
+                            if (!IS_INTERNAL_NULL(element)) {
+                                hasNext = true;
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    case BUILTIN_SET: {
+                        runtimeSet* set = VALUE_SET_VALUE(iterable);
+                        if (set->table.version != snapshot) setError("Set changed during for-in iteration");
+                        while (cursor < set->table.entryCount) {
+                            element = SET_ENTRIES(set)[cursor++].key;
+                            if (!IS_INTERNAL_NULL(element)) {
+                                hasNext = true;
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    default:
+                        runtimeError("For-in state is corrupted");
+                }
+                if (!hasNext) {
+                    int16_t jumpInc = GET_WORD(1);
+                    ip--;
+                    ip += jumpInc;
+                    break;
+                }
+                LOCAL_REF(stateIndex + 1) = NUMBER_VAL(cursor);
+                LOCAL_REF(GET_WORD(5)) = element;
+                break;
+            }
+            case OP_FOR_STEP: {
+                uint8_t counterIndex = GET_BYTE(3);
+                Value step = CONST_REF(GET_BYTE(4));
+                uint8_t flags = GET_BYTE(7);
+                Value bound = (flags & FOR_STEP_CONST_BOUND) ? CONST_REF(GET_BYTE(5)) : LOCAL_REF(GET_BYTE(5));
+                specialAssignment sa = flags & ~FOR_STEP_CONST_BOUND;
+                OpCode compareOp = GET_BYTE(6);
+                bool loop;
+                if (VALUE_TYPE(LOCAL_REF(counterIndex)) == VAL_NUMBER && VALUE_TYPE(bound) == VAL_NUMBER) {
+                    // Step the counter in place
+                    double i = VALUE_NUMBER_VALUE(LOCAL_REF(counterIndex));
+                    i = (sa == ASSIGNMENT_ADD) ? i + VALUE_NUMBER_VALUE(step) : i - VALUE_NUMBER_VALUE(step);
+                    VALUE_NUMBER_VALUE(LOCAL_REF(counterIndex)) = i;
+                    double limit = VALUE_NUMBER_VALUE(bound);
+                    switch (compareOp) {
+                        case OP_LESS: loop = i < limit; break;
+                        case OP_MORE: loop = i > limit; break;
+                        case OP_LESS_EQUAL: loop = i <= limit; break;
+                        default: loop = i >= limit; break;
+                    }
+                } else { // Operator overloads
+                    LOCAL_REF(counterIndex) = performValueModification(sa, LOCAL_REF(counterIndex), step);
+                    Value condition = binaryOperation(LOCAL_REF(counterIndex), bound, compareOp);
+                    if (VALUE_TYPE(condition) != VAL_BOOL) runtimeError("Condition is not a boolean");
+                    loop = VALUE_BOOL_VALUE(condition);
+                }
+                if (loop) {
+                    int16_t jumpInc = GET_WORD(1);
+                    ip--;
+                    ip += jumpInc;
+                }
+                break;
+            }
             case OP_RETURN:
                 // Pop ip from stack
                 ipStackTop--;
@@ -551,7 +741,7 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                     // Check index is num
                     if (VALUE_TYPE(index) != VAL_NUMBER) runtimeError("Index is not a num");
                     // Get index set method
-                    Value indexSetMethod = getAttr(target, "set");
+                    Value indexSetMethod = getAttr(target, BUILTIN_SYMBOL(NAME_SET));
                     // Prepare input array
                     Value inputs[2] = {index, value};
                     // Execute index set method
@@ -560,20 +750,18 @@ void execChunk(Chunk* chunk, Value* dataSection) {
                 break;
             }
             case OP_SET_ATTR: {
-                // Get attribute name
-                Value attrName = CONST_REF(GET_BYTE(1));
-                // Check if attribute name is a string
-                if (VALUE_TYPE(attrName) != BUILTIN_STR) runtimeError("Attribute name is not a string");
+                // Get attribute symbol
+                uint16_t attrSymbol = GET_WORD(1);
                 // Get special assignment
-                specialAssignment sa = GET_BYTE(2);
+                specialAssignment sa = GET_BYTE(3);
                 // Get Value and target objects
                 Value value = STACK_POP();
                 Value target = STACK_POP();
                 if (IS_SYSTEM_DEFINED_TYPE(target.type)) runtimeError("Unable to set attribute on system defined type");
                 if (sa != ASSIGNMENT_NONE) {
-                    attrSpecialAssignment(sa, target, VALUE_STR_VALUE(attrName), value);
+                    attrSpecialAssignment(sa, target, attrSymbol, value);
                 } else {
-                    strValInsert(target.obj->primValue.afterDefAttributes, VALUE_STR_VALUE(attrName), value);
+                    attrTableInsert(target.obj->primValue.afterDefAttributes, attrSymbol, value);
                 }
                 break;
             }
@@ -680,76 +868,76 @@ void initVM(Value* globalRefArray, callable** functionArray, uint16_t globalRefC
 #endif
 }
 
-Value unaryOperation(Value obj1, char* op) {
+Value unaryOperation(Value obj1, uint16_t op) {
     Value opFunction = ignoreNullGetAttr(obj1, op);
     if (IS_INTERNAL_NULL(opFunction)) runtimeError("No operator function found");
     return execInput(opFunction, obj1, NULL, 0);
 }
 
 Value binaryOperation(Value v1, Value v2, OpCode op) {
-    char* leftOpStr = NULL;
-    char* rightOpStr = NULL;
+    uint16_t leftOpSymbol = SYMBOL_NONE;
+    uint16_t rightOpSymbol = SYMBOL_NONE;
     switch (op) {
         case OP_ADD: {
-            leftOpStr = "_add";
-            rightOpStr = "_add";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_ADD);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_ADD);
             break;
         }
         case OP_SUB: {
-            leftOpStr = "_sub";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_SUB);
             break;
         }
         case OP_MUL: {
-            leftOpStr = "_mul";
-            rightOpStr = "_mul";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_MUL);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_MUL);
             break;
         }
         case OP_DIV: {
-            leftOpStr = "_div";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_DIV);
             break;
         }
         case OP_MOD: {
-            leftOpStr = "_mod";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_MOD);
             break;
         }
         case OP_POW: {
-            leftOpStr = "_pow";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_POW);
             break;
         }
         case OP_EQUAL: {
-            leftOpStr = "_eq";
-            rightOpStr = "_eq";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_EQ);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_EQ);
             break;
         }
         case OP_LESS: {
-            leftOpStr = "_less";
-            rightOpStr = "_meq";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_LESS);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_MEQ);
             break;
         }
         case OP_MORE: {
-            leftOpStr = "_more";
-            rightOpStr = "_leq";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_MORE);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_LEQ);
             break;
         }
         case OP_LESS_EQUAL: {
-            leftOpStr = "_leq";
-            rightOpStr = "_more";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_LEQ);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_MORE);
             break;
         }
         case OP_MORE_EQUAL: {
-            leftOpStr = "_meq";
-            rightOpStr = "_less";
+            leftOpSymbol = BUILTIN_SYMBOL(NAME_MEQ);
+            rightOpSymbol = BUILTIN_SYMBOL(NAME_LESS);
             break;
         }
         default:
             runtimeError("Invalid binary operation type");
     }
-    Value opFunction = ignoreNullGetAttr(v1, leftOpStr);
+    Value opFunction = ignoreNullGetAttr(v1, leftOpSymbol);
     if (!IS_INTERNAL_NULL(opFunction)) {
         return execInput(opFunction, v1, &v2, 1);
     }
-    if (rightOpStr != NULL) {
-        opFunction = ignoreNullGetAttr(v2, rightOpStr);
+    if (rightOpSymbol != SYMBOL_NONE) {
+        opFunction = ignoreNullGetAttr(v2, rightOpSymbol);
         if (!IS_INTERNAL_NULL(opFunction)) {
             return execInput(opFunction, v2, &v1, 1);
         }
@@ -804,26 +992,26 @@ void indexSpecialAssignment(specialAssignment sa , Value target, Value index, Va
     Value retrievedObj = objGetIndexRef(target, index);
     Value modifiedValue = performValueModification(sa, retrievedObj, value); 
     // Get index set method
-    Value indexSetMethod = getAttr(target, "set");
+    Value indexSetMethod = getAttr(target, BUILTIN_SYMBOL(NAME_SET));
     // Prepare input array
     Value inputs[2] = {index, modifiedValue};
     // Execute index set method
     execInput(indexSetMethod, target, inputs, 2);
 }
 
-void attrSpecialAssignment(specialAssignment sa, Value target, char* attrName, Value value) {
+void attrSpecialAssignment(specialAssignment sa, Value target, uint16_t attrSymbol, Value value) {
     // Get attribute original Value
-    Value originalAttribute = getAttr(target, attrName); // getAttr is protected from NULL target
+    Value originalAttribute = getAttr(target, attrSymbol); // getAttr is protected from NULL target
     // Modify Value and re-insert as attribute
     Value modifiedValue = performValueModification(sa, originalAttribute, value);
-    strValInsert(target.obj->primValue.afterDefAttributes, attrName, modifiedValue);
+    attrTableInsert(target.obj->primValue.afterDefAttributes, attrSymbol, modifiedValue);
 }
 
 Value objGetIndexRef(Value target, Value index) {
     // Get index object
     if (VALUE_TYPE(index) != VAL_NUMBER) runtimeError("Index object is not num");
     // Get index reference method
-    Value indexRefMethod = getAttr(target, "get");
+    Value indexRefMethod = getAttr(target, BUILTIN_SYMBOL(NAME_GET));
     if (VALUE_CALLABLE_VALUE(indexRefMethod)->out == 0) runtimeError("Index reference method has no output");
     return execInput(indexRefMethod, target, &index, 1);
 }
@@ -29,13 +29,13 @@ bool compareValue(Value v1, Value v2);
 
 void initVM(Value* globalRefArray, callable** functionArray, uint16_t globalRefCount);
 
-Value unaryOperation(Value obj1, char* op);
+Value unaryOperation(Value obj1, uint16_t op);
 Value binaryOperation(Value v1, Value v2, OpCode op);
 
 Value performValueModification(specialAssignment sa, Value value, Value modValue);
 
 void indexSpecialAssignment(specialAssignment sa , Value target, Value index, Value value);
-void attrSpecialAssignment(specialAssignment sa, Value target, char* attrName, Value value);
+void attrSpecialAssignment(specialAssignment sa, Value target, uint16_t attrSymbol, Value value);
 
 Value objGetIndexRef(Value target, Value index);
 